@@ -0,0 +1,395 @@
+/******************************************************************************/
+/* anim.c (sprite animation)                                                  */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "anim.h"
+
+unsigned long  G_anim_cell_offset[VDP_MAX_ENTRIES];
+unsigned short G_anim_control[VDP_MAX_ENTRIES];
+
+/* statistics */
+unsigned long  G_anim_num_active;
+unsigned long  G_anim_num_changed;
+
+/* per entry state (decoded from word 1 when the entry is scheduled) */
+static unsigned char  S_anim_frame[VDP_MAX_ENTRIES];
+static unsigned char  S_anim_num_frames[VDP_MAX_ENTRIES];
+static unsigned char  S_anim_delay[VDP_MAX_ENTRIES];
+static unsigned long  S_anim_stride[VDP_MAX_ENTRIES];
+
+/* timing wheel (a doubly linked list of entries per slot) */
+static short          S_anim_wheel[ANIM_WHEEL_SIZE];
+
+static short          S_anim_next[VDP_MAX_ENTRIES];
+static short          S_anim_prev[VDP_MAX_ENTRIES];
+static short          S_anim_slot[VDP_MAX_ENTRIES];
+
+static unsigned long  S_anim_tick;
+
+/* one past the highest entry updated since the last reset */
+static int            S_anim_num_entries;
+
+/* the state that is saved & restored by anim_save() / anim_load() */
+/* (the rest is decoded from it again, and the wheel is relinked)   */
+static struct
+{
+  void*         ptr;
+  unsigned long size;
+} S_anim_state[] =
+{
+  { G_anim_control,       sizeof(G_anim_control)      },
+  { S_anim_frame,         sizeof(S_anim_frame)        },
+  { S_anim_slot,          sizeof(S_anim_slot)         },
+  { &S_anim_tick,         sizeof(S_anim_tick)         },
+  { &S_anim_num_entries,  sizeof(S_anim_num_entries)  }
+};
+
+#define ANIM_NUM_STATE_PARTS                                                   \
+  (int) (sizeof(S_anim_state) / sizeof(S_anim_state[0]))
+
+/******************************************************************************/
+/* anim_reset()                                                               */
+/******************************************************************************/
+int anim_reset()
+{
+  int k;
+
+  /* only the entries updated since the last reset need clearing */
+  for (k = 0; k < S_anim_num_entries; k++)
+  {
+    G_anim_cell_offset[k] = 0;
+    G_anim_control[k] = 0;
+
+    S_anim_frame[k] = 0;
+    S_anim_num_frames[k] = 1;
+    S_anim_delay[k] = 0;
+    S_anim_stride[k] = 0;
+  }
+
+  for (k = 0; k < VDP_MAX_ENTRIES; k++)
+    S_anim_slot[k] = -1;
+
+  for (k = 0; k < ANIM_WHEEL_SIZE; k++)
+    S_anim_wheel[k] = -1;
+
+  S_anim_num_entries = 0;
+  S_anim_tick = 0;
+
+  G_anim_num_active = 0;
+  G_anim_num_changed = 0;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* anim_unlink()                                                              */
+/******************************************************************************/
+static void anim_unlink(int entry)
+{
+  int slot;
+
+  slot = S_anim_slot[entry];
+
+  if (slot < 0)
+    return;
+
+  if (S_anim_prev[entry] >= 0)
+    S_anim_next[S_anim_prev[entry]] = S_anim_next[entry];
+  else
+    S_anim_wheel[slot] = S_anim_next[entry];
+
+  if (S_anim_next[entry] >= 0)
+    S_anim_prev[S_anim_next[entry]] = S_anim_prev[entry];
+
+  S_anim_slot[entry] = -1;
+
+  G_anim_num_active -= 1;
+}
+
+/******************************************************************************/
+/* anim_link()                                                                */
+/******************************************************************************/
+static void anim_link(int entry, int slot)
+{
+  S_anim_prev[entry] = -1;
+  S_anim_next[entry] = S_anim_wheel[slot];
+
+  if (S_anim_wheel[slot] >= 0)
+    S_anim_prev[S_anim_wheel[slot]] = (short) entry;
+
+  S_anim_wheel[slot] = (short) entry;
+  S_anim_slot[entry] = (short) slot;
+
+  G_anim_num_active += 1;
+}
+
+/******************************************************************************/
+/* anim_decode()                                                              */
+/******************************************************************************/
+static void anim_decode(int entry)
+{
+  unsigned short val;
+
+  int num_columns;
+  int num_rows;
+
+  /* decode the control word & compute the stride between frames */
+  val = G_anim_control[entry];
+
+  num_columns = ((val >> 13) & 0x0003) + 1;
+  num_rows = ((val >> 11) & 0x0003) + 1;
+
+  S_anim_num_frames[entry] = ((val >> 8) & 0x0007) + 1;
+  S_anim_delay[entry] = val & 0x00FF;
+  S_anim_stride[entry] = VDP_BYTES_PER_CELL * num_columns * num_rows;
+}
+
+/******************************************************************************/
+/* anim_update_entry()                                                        */
+/******************************************************************************/
+int anim_update_entry(int entry)
+{
+  unsigned short val;
+
+  if ((entry < 0) || (entry >= VDP_MAX_ENTRIES))
+    return 1;
+
+  if ((unsigned long) entry >= G_vdp_nametable_num_words / VDP_ENTRY_SIZE)
+    return 1;
+
+  if (entry >= S_anim_num_entries)
+    S_anim_num_entries = entry + 1;
+
+  /* decode word 1 */
+  val = G_vdp_nametable_buf[VDP_ENTRY_SIZE * entry + 1];
+
+  G_anim_control[entry] = val;
+
+  anim_decode(entry);
+
+  /* keep the current frame if there still is one */
+  if (S_anim_frame[entry] >= S_anim_num_frames[entry])
+    S_anim_frame[entry] = 0;
+
+  G_anim_cell_offset[entry] = S_anim_frame[entry] * S_anim_stride[entry];
+
+  /* (re)schedule the next frame */
+  anim_unlink(entry);
+
+  if ((S_anim_num_frames[entry] > 1) && (S_anim_delay[entry] > 0))
+  {
+    anim_link(entry, 
+              (S_anim_tick + S_anim_delay[entry]) & (ANIM_WHEEL_SIZE - 1));
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* anim_tick()                                                                */
+/******************************************************************************/
+int anim_tick()
+{
+  int entry;
+  int next;
+  int slot;
+
+  S_anim_tick += 1;
+
+  G_anim_num_changed = 0;
+
+  /* advance the entries due this tick (each one moves to a later */
+  /* slot, since every delay is shorter than the wheel)           */
+  slot = S_anim_tick & (ANIM_WHEEL_SIZE - 1);
+
+  entry = S_anim_wheel[slot];
+
+  S_anim_wheel[slot] = -1;
+
+  while (entry >= 0)
+  {
+    next = S_anim_next[entry];
+
+    S_anim_frame[entry] += 1;
+
+    if (S_anim_frame[entry] >= S_anim_num_frames[entry])
+      S_anim_frame[entry] = 0;
+
+    G_anim_cell_offset[entry] = S_anim_frame[entry] * S_anim_stride[entry];
+
+    S_anim_slot[entry] = -1;
+    G_anim_num_active -= 1;
+
+    anim_link(entry, 
+              (S_anim_tick + S_anim_delay[entry]) & (ANIM_WHEEL_SIZE - 1));
+
+    G_anim_num_changed += 1;
+
+    entry = next;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* anim_state_size()                                                          */
+/******************************************************************************/
+unsigned long anim_state_size()
+{
+  int k;
+
+  unsigned long num_bytes;
+
+  num_bytes = 0;
+
+  for (k = 0; k < ANIM_NUM_STATE_PARTS; k++)
+    num_bytes += S_anim_state[k].size;
+
+  return num_bytes;
+}
+
+/******************************************************************************/
+/* anim_save()                                                                */
+/******************************************************************************/
+int anim_save(unsigned char* dst)
+{
+  int k;
+
+  if (dst == NULL)
+    return 1;
+
+  for (k = 0; k < ANIM_NUM_STATE_PARTS; k++)
+  {
+    memcpy(dst, S_anim_state[k].ptr, S_anim_state[k].size);
+    dst += S_anim_state[k].size;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* anim_find_part()                                                           */
+/******************************************************************************/
+static unsigned char* anim_find_part(unsigned char* src, void* ptr)
+{
+  int k;
+
+  for (k = 0; k < ANIM_NUM_STATE_PARTS; k++)
+  {
+    if (S_anim_state[k].ptr == ptr)
+      return src;
+
+    src += S_anim_state[k].size;
+  }
+
+  return NULL;
+}
+
+/******************************************************************************/
+/* anim_check()                                                               */
+/******************************************************************************/
+int anim_check(unsigned char* src)
+{
+  int k;
+  int num_entries;
+
+  unsigned short  control;
+  unsigned char   frame;
+  short           slot;
+
+  unsigned char*  controls;
+  unsigned char*  frames;
+  unsigned char*  slots;
+
+  if (src == NULL)
+    return 1;
+
+  /* (the parts are copied out, as the block may not be aligned) */
+  controls = anim_find_part(src, G_anim_control);
+  frames = anim_find_part(src, S_anim_frame);
+  slots = anim_find_part(src, S_anim_slot);
+
+  memcpy( &num_entries, anim_find_part(src, &S_anim_num_entries), 
+          sizeof(num_entries));
+
+  /* the entry count & every slot are used as indices */
+  if ((num_entries < 0) || (num_entries > VDP_MAX_ENTRIES))
+    return 1;
+
+  for (k = 0; k < VDP_MAX_ENTRIES; k++)
+  {
+    memcpy(&control, &controls[k * sizeof(control)], sizeof(control));
+    memcpy(&slot, &slots[k * sizeof(slot)], sizeof(slot));
+
+    frame = frames[k];
+
+    if ((slot < -1) || (slot >= ANIM_WHEEL_SIZE))
+      return 1;
+
+    /* each frame must be one of its entry's frames */
+    if (k < num_entries)
+    {
+      if (frame > ((control >> 8) & 0x0007))
+        return 1;
+    }
+    else if ((frame != 0) || (slot != -1))
+      return 1;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* anim_load()                                                                */
+/******************************************************************************/
+int anim_load(unsigned char* src)
+{
+  int k;
+  int slot;
+
+  if (src == NULL)
+    return 1;
+
+  for (k = 0; k < ANIM_NUM_STATE_PARTS; k++)
+  {
+    memcpy(S_anim_state[k].ptr, src, S_anim_state[k].size);
+    src += S_anim_state[k].size;
+  }
+
+  /* decode the entries again (the ones past the last updated entry */
+  /* are as anim_reset() left them)                                 */
+  for (k = 0; k < VDP_MAX_ENTRIES; k++)
+  {
+    if (k < S_anim_num_entries)
+      anim_decode(k);
+    else
+    {
+      S_anim_num_frames[k] = 1;
+      S_anim_delay[k] = 0;
+      S_anim_stride[k] = 0;
+    }
+
+    G_anim_cell_offset[k] = S_anim_frame[k] * S_anim_stride[k];
+  }
+
+  /* relink the scheduled entries into the wheel */
+  for (k = 0; k < ANIM_WHEEL_SIZE; k++)
+    S_anim_wheel[k] = -1;
+
+  G_anim_num_active = 0;
+  G_anim_num_changed = 0;
+
+  for (k = 0; k < VDP_MAX_ENTRIES; k++)
+  {
+    slot = S_anim_slot[k];
+
+    if (slot >= 0)
+      anim_link(k, slot);
+  }
+
+  return 0;
+}
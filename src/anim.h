@@ -0,0 +1,44 @@
+/******************************************************************************/
+/* anim.h (sprite animation)                                                  */
+/******************************************************************************/
+
+#ifndef ANIM_H
+#define ANIM_H
+
+#include "vdp.h"
+
+/* each animated entry shows its frames in turn, for delay time ticks  */
+/* apiece. a frame is columns x rows cells, stored after the previous  */
+/* one, so it is found by adding a fixed stride to the entry's address */
+/* (a delay time of 0 holds the current frame).                        */
+
+/* entries are kept on a timing wheel by the tick of their next frame, */
+/* so a tick only visits the entries whose frame changes               */
+#define ANIM_WHEEL_SIZE 256 /* more than the longest delay */
+
+/* bytes added to each entry's cell address for its current frame */
+extern unsigned long  G_anim_cell_offset[VDP_MAX_ENTRIES];
+
+/* word 1 of each entry, as of when it was last scheduled */
+extern unsigned short G_anim_control[VDP_MAX_ENTRIES];
+
+/* statistics */
+extern unsigned long  G_anim_num_active;
+extern unsigned long  G_anim_num_changed;
+
+/* function declarations */
+int anim_reset();
+
+int anim_update_entry(int entry);
+int anim_tick();
+
+/* the whole animation state, as a block of anim_state_size() bytes */
+unsigned long anim_state_size();
+
+int anim_save(unsigned char* dst);
+int anim_load(unsigned char* src);
+
+/* (returns 1 if a block is not a valid state, e.g. from a corrupt file) */
+int anim_check(unsigned char* src);
+
+#endif
@@ -0,0 +1,307 @@
+/******************************************************************************/
+/* bank.c (paged cell bank)                                                   */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bank.h"
+
+int            G_bank_active = 0;
+
+unsigned char* G_bank_pages[BANK_MAX_PAGES];
+
+unsigned long  G_bank_num_loaded;
+unsigned long  G_bank_num_evicted;
+unsigned long  G_bank_num_resident;
+
+static bank_page_func S_bank_page_func = NULL;
+
+static unsigned long  S_bank_num_bytes;
+static unsigned long  S_bank_num_pages;
+
+static unsigned long  S_bank_cache_limit = BANK_CACHE_LIMIT_DEFAULT;
+
+/* page buffers (allocated as needed, up to the cache limit) */
+static unsigned char* S_bank_slot_buf[BANK_MAX_PAGES];
+static long           S_bank_slot_page[BANK_MAX_PAGES];
+
+static unsigned long  S_bank_num_slots;
+static unsigned long  S_bank_max_slots;
+
+/* page state (when it was last used, and the frame it is pinned for) */
+static unsigned long  S_bank_page_used[BANK_MAX_PAGES];
+static unsigned long  S_bank_page_frame[BANK_MAX_PAGES];
+
+static unsigned long  S_bank_clock;
+static unsigned long  S_bank_frame;
+
+/******************************************************************************/
+/* bank_set_cache_limit()                                                     */
+/******************************************************************************/
+int bank_set_cache_limit(unsigned long num_bytes)
+{
+  S_bank_cache_limit = num_bytes;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* bank_close()                                                               */
+/******************************************************************************/
+int bank_close()
+{
+  unsigned long k;
+
+  for (k = 0; k < S_bank_num_slots; k++)
+  {
+    free(S_bank_slot_buf[k]);
+    S_bank_slot_buf[k] = NULL;
+  }
+
+  for (k = 0; k < S_bank_num_pages; k++)
+    G_bank_pages[k] = NULL;
+
+  S_bank_num_slots = 0;
+  S_bank_num_pages = 0;
+  S_bank_num_bytes = 0;
+
+  S_bank_page_func = NULL;
+
+  G_bank_active = 0;
+
+  G_bank_num_resident = 0;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* bank_open()                                                                */
+/******************************************************************************/
+int bank_open(unsigned long num_bytes, bank_page_func func)
+{
+  unsigned long k;
+
+  bank_close();
+
+  if ((num_bytes > BANK_MAX_SIZE) || (func == NULL))
+    return 1;
+
+  S_bank_page_func = func;
+
+  S_bank_num_bytes = num_bytes;
+  S_bank_num_pages = (num_bytes + BANK_PAGE_SIZE - 1) / BANK_PAGE_SIZE;
+
+  /* nothing is resident until it is first used */
+  for (k = 0; k < S_bank_num_pages; k++)
+  {
+    G_bank_pages[k] = NULL;
+
+    S_bank_page_used[k] = 0;
+    S_bank_page_frame[k] = 0;
+  }
+
+  /* keep enough pages for any one frame's worth of sprites */
+  S_bank_max_slots = S_bank_cache_limit / BANK_PAGE_SIZE;
+
+  if (S_bank_max_slots < BANK_MIN_PAGES)
+    S_bank_max_slots = BANK_MIN_PAGES;
+
+  if (S_bank_max_slots > S_bank_num_pages)
+    S_bank_max_slots = S_bank_num_pages;
+
+  S_bank_clock = 0;
+  S_bank_frame = 1;
+
+  G_bank_num_loaded = 0;
+  G_bank_num_evicted = 0;
+  G_bank_num_resident = 0;
+
+  G_bank_active = 1;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* bank_begin_frame()                                                         */
+/******************************************************************************/
+int bank_begin_frame()
+{
+  /* unpin the pages used by the previous frame */
+  S_bank_frame += 1;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* bank_find_slot()                                                           */
+/******************************************************************************/
+static long bank_find_slot()
+{
+  unsigned long k;
+
+  long slot;
+  long page;
+
+  /* allocate a new page buffer while under the limit */
+  if (S_bank_num_slots < S_bank_max_slots)
+  {
+    S_bank_slot_buf[S_bank_num_slots] = malloc(BANK_PAGE_SIZE);
+
+    if (S_bank_slot_buf[S_bank_num_slots] != NULL)
+    {
+      S_bank_slot_page[S_bank_num_slots] = -1;
+      S_bank_num_slots += 1;
+
+      return S_bank_num_slots - 1;
+    }
+  }
+
+  /* otherwise evict the least recently used page not pinned this frame */
+  slot = -1;
+
+  for (k = 0; k < S_bank_num_slots; k++)
+  {
+    page = S_bank_slot_page[k];
+
+    if (page < 0)
+      return k;
+
+    if (S_bank_page_frame[page] == S_bank_frame)
+      continue;
+
+    if ((slot < 0) ||
+        (S_bank_page_used[page] < S_bank_page_used[S_bank_slot_page[slot]]))
+    {
+      slot = k;
+    }
+  }
+
+  if (slot < 0)
+    return -1;
+
+  page = S_bank_slot_page[slot];
+
+  G_bank_pages[page] = NULL;
+  S_bank_slot_page[slot] = -1;
+
+  G_bank_num_evicted += 1;
+  G_bank_num_resident -= 1;
+
+  return slot;
+}
+
+/******************************************************************************/
+/* bank_count_slots()                                                         */
+/******************************************************************************/
+static unsigned long bank_count_slots(unsigned long first, unsigned long last,
+                                      unsigned long num_needed)
+{
+  unsigned long k;
+  unsigned long num_slots;
+
+  long page;
+
+  /* count the slots that could be (re)used, up to the number needed: */
+  /* those not yet allocated, empty ones, and ones holding pages that */
+  /* are not pinned this frame (other than those in the range itself) */
+  num_slots = S_bank_max_slots - S_bank_num_slots;
+
+  for (k = 0; (k < S_bank_num_slots) && (num_slots < num_needed); k++)
+  {
+    page = S_bank_slot_page[k];
+
+    if (page < 0)
+      num_slots += 1;
+    else if ((S_bank_page_frame[page] != S_bank_frame) &&
+             (((unsigned long) page < first) || ((unsigned long) page > last)))
+    {
+      num_slots += 1;
+    }
+  }
+
+  return num_slots;
+}
+
+/******************************************************************************/
+/* bank_touch()                                                               */
+/******************************************************************************/
+int bank_touch(unsigned long addr, unsigned long num_bytes)
+{
+  unsigned long page;
+  unsigned long first;
+  unsigned long last;
+  unsigned long page_bytes;
+  unsigned long num_needed;
+
+  long slot;
+
+  if ((num_bytes == 0) || (addr + num_bytes > S_bank_num_bytes))
+    return 1;
+
+  first = addr >> BANK_PAGE_SHIFT;
+  last = (addr + num_bytes - 1) >> BANK_PAGE_SHIFT;
+
+  /* make sure every page the range covers can be loaded before pinning */
+  /* any of them (so a range that does not fit wastes no slots)          */
+  num_needed = 0;
+
+  for (page = first; page <= last; page++)
+  {
+    if (G_bank_pages[page] == NULL)
+      num_needed += 1;
+  }
+
+  if ((num_needed > 0) && 
+      (bank_count_slots(first, last, num_needed) < num_needed))
+  {
+    return 1;
+  }
+
+  /* pin the resident pages first, so loading the others cannot evict them */
+  for (page = first; page <= last; page++)
+  {
+    S_bank_clock += 1;
+
+    if (G_bank_pages[page] != NULL)
+    {
+      S_bank_page_used[page] = S_bank_clock;
+      S_bank_page_frame[page] = S_bank_frame;
+    }
+  }
+
+  /* then load & pin the rest */
+  for (page = first; page <= last; page++)
+  {
+    if (G_bank_pages[page] != NULL)
+      continue;
+
+    slot = bank_find_slot();
+
+    if (slot < 0)
+      return 1;
+
+    page_bytes = S_bank_num_bytes - (page << BANK_PAGE_SHIFT);
+
+    if (page_bytes > BANK_PAGE_SIZE)
+      page_bytes = BANK_PAGE_SIZE;
+
+    if (S_bank_page_func(page, S_bank_slot_buf[slot], page_bytes))
+      return 1;
+
+    S_bank_slot_page[slot] = page;
+
+    G_bank_pages[page] = S_bank_slot_buf[slot];
+
+    G_bank_num_loaded += 1;
+    G_bank_num_resident += 1;
+
+    S_bank_clock += 1;
+
+    S_bank_page_used[page] = S_bank_clock;
+    S_bank_page_frame[page] = S_bank_frame;
+  }
+
+  return 0;
+}
@@ -0,0 +1,47 @@
+/******************************************************************************/
+/* bank.h (paged cell bank)                                                   */
+/******************************************************************************/
+
+#ifndef BANK_H
+#define BANK_H
+
+/* a paged bank is read from the cart a page at a time, on first use,  */
+/* into an lru cache of pages. the pages used by a frame are loaded &   */
+/* pinned before it is drawn, so the renderer can read them directly.   */
+#define BANK_PAGE_SHIFT 16
+#define BANK_PAGE_SIZE  (1 << BANK_PAGE_SHIFT) /* 64 KB (one lz block) */
+#define BANK_PAGE_MASK  (BANK_PAGE_SIZE - 1)
+
+#define BANK_MAX_SIZE   (1 << 27) /* 128 MB (22 bit cell addresses) */
+#define BANK_MAX_PAGES  (BANK_MAX_SIZE / BANK_PAGE_SIZE)
+
+#define BANK_MIN_PAGES  16
+#define BANK_CACHE_LIMIT_DEFAULT  (1 << 24) /* 16 MB */
+
+/* address of a byte in a resident page */
+#define BANK_PTR(addr)                                                         \
+  (G_bank_pages[(addr) >> BANK_PAGE_SHIFT] + ((addr) & BANK_PAGE_MASK))
+
+/* reads page 'page' (num_bytes long) of the cart into dst */
+typedef int (*bank_page_func)(unsigned long page,
+                              unsigned char* dst, unsigned long num_bytes);
+
+extern int            G_bank_active;
+
+extern unsigned char* G_bank_pages[BANK_MAX_PAGES];
+
+/* statistics */
+extern unsigned long  G_bank_num_loaded;
+extern unsigned long  G_bank_num_evicted;
+extern unsigned long  G_bank_num_resident;
+
+/* function declarations */
+int bank_set_cache_limit(unsigned long num_bytes);
+
+int bank_open(unsigned long num_bytes, bank_page_func func);
+int bank_close();
+
+int bank_begin_frame();
+int bank_touch(unsigned long addr, unsigned long num_bytes);
+
+#endif
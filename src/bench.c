@@ -0,0 +1,472 @@
+/******************************************************************************/
+/* bench.c (headless benchmark)                                               */
+/******************************************************************************/
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#include "anim.h"
+#include "bank.h"
+#include "blit.h"
+#include "pcache.h"
+#include "pool.h"
+#include "rom.h"
+#include "state.h"
+#include "vdp.h"
+
+/* 64 bit fnv-1a */
+#define BENCH_FNV_OFFSET  0xCBF29CE484222325UL
+#define BENCH_FNV_PRIME   0x00000100000001B3UL
+
+/* frames drawn with each sprite line routine when comparing them */
+#define BENCH_SPRITE_FRAMES 100
+
+/* frames drawn with the background rotated & not when timing it */
+/* (the matrix turns it by about 30 degrees, in 8.8 fixed point)  */
+#define BENCH_AFFINE_FRAMES 100
+
+#define BENCH_AFFINE_COS    0x00DE
+#define BENCH_AFFINE_SIN    0x0080
+
+/* frames drawn as rgb555 & converted afterwards (as the driver */
+/* would), and drawn as argb8888 directly, when comparing them  */
+#define BENCH_FORMAT_FRAMES 100
+
+static unsigned int S_bench_converted[VDP_SCREEN_SIZE];
+static unsigned int S_bench_drawn[VDP_SCREEN_SIZE];
+
+/******************************************************************************/
+/* bench_compare_times()                                                      */
+/******************************************************************************/
+static int bench_compare_times(const void* a, const void* b)
+{
+  if (*((Uint64*) a) < *((Uint64*) b))
+    return -1;
+  else if (*((Uint64*) a) > *((Uint64*) b))
+    return 1;
+  else
+    return 0;
+}
+
+/******************************************************************************/
+/* bench_hash_frame()                                                         */
+/******************************************************************************/
+unsigned long bench_hash_frame()
+{
+  int k;
+
+  unsigned long hash;
+
+  /* hash the framebuffer a byte at a time (low byte first), */
+  /* so that the result does not depend on the host          */
+  hash = BENCH_FNV_OFFSET;
+
+  for (k = 0; k < VDP_SCREEN_SIZE; k++)
+  {
+    hash = (hash ^ (G_vdp_fb_rgb[k] & 0xFF)) * BENCH_FNV_PRIME;
+    hash = (hash ^ ((G_vdp_fb_rgb[k] >> 8) & 0xFF)) * BENCH_FNV_PRIME;
+  }
+
+  return hash;
+}
+
+/******************************************************************************/
+/* bench_sprite_lines()                                                       */
+/******************************************************************************/
+static int bench_sprite_lines()
+{
+  int k;
+  int generic;
+
+  Uint64  freq;
+  Uint64  start;
+  Uint64  total[2];
+
+  unsigned long hash;
+  unsigned long num_lines;
+
+  int mismatch;
+
+  /* redraw the current frame with the routines specialized by width */
+  /* and with the generic one, alternately, so that both see the same */
+  /* conditions (& check that they draw the same pixels)              */
+  freq = SDL_GetPerformanceFrequency();
+
+  hash = bench_hash_frame();
+  num_lines = G_vdp_num_sprite_lines;
+
+  total[0] = 0;
+  total[1] = 0;
+
+  mismatch = 0;
+
+  for (k = 0; k < 2 * BENCH_SPRITE_FRAMES; k++)
+  {
+    generic = k % 2;
+
+    vdp_set_generic_sprites(generic);
+
+    start = SDL_GetPerformanceCounter();
+
+    vdp_invalidate_frame();
+    vdp_draw_frame();
+
+    total[generic] += SDL_GetPerformanceCounter() - start;
+
+    if (bench_hash_frame() != hash)
+      mismatch = 1;
+  }
+
+  vdp_set_generic_sprites(0);
+
+  fprintf(stdout, "Sprite lines: %lu per frame, %.3f ms specialized, "
+                  "%.3f ms generic, %.1f ns saved per line%s\n", 
+          num_lines, 
+          total[0] * 1000.0 / freq / BENCH_SPRITE_FRAMES, 
+          total[1] * 1000.0 / freq / BENCH_SPRITE_FRAMES, 
+          (num_lines > 0) ? 
+            (((double) total[1] - (double) total[0]) * 
+             (1000000000.0 / freq) / BENCH_SPRITE_FRAMES / num_lines) : 0.0, 
+          mismatch ? " (MISMATCH)" : "");
+
+  return mismatch;
+}
+
+/******************************************************************************/
+/* bench_affine()                                                             */
+/******************************************************************************/
+static int bench_affine()
+{
+  int k;
+  int affine;
+
+  Uint64  freq;
+  Uint64  start;
+  Uint64  total[2];
+
+  unsigned short mode;
+  unsigned short matrix[VDP_MATRIX_SIZE];
+  unsigned short center_x;
+  unsigned short center_y;
+
+  if (G_vdp_tilemap_num_words == 0)
+    return 0;
+
+  /* redraw the current frame with the background scrolled & rotated, */
+  /* alternately, putting the registers back afterwards               */
+  freq = SDL_GetPerformanceFrequency();
+
+  mode = G_vdp_bg_mode;
+  memcpy(matrix, G_vdp_bg_matrix, sizeof(matrix));
+  center_x = G_vdp_bg_center_x;
+  center_y = G_vdp_bg_center_y;
+
+  G_vdp_bg_matrix[VDP_MATRIX_A] = BENCH_AFFINE_COS;
+  G_vdp_bg_matrix[VDP_MATRIX_B] = (unsigned short) (0x10000 - BENCH_AFFINE_SIN);
+  G_vdp_bg_matrix[VDP_MATRIX_C] = BENCH_AFFINE_SIN;
+  G_vdp_bg_matrix[VDP_MATRIX_D] = BENCH_AFFINE_COS;
+  G_vdp_bg_center_x = VDP_SCREEN_W / 2;
+  G_vdp_bg_center_y = VDP_SCREEN_H / 2;
+
+  total[0] = 0;
+  total[1] = 0;
+
+  for (k = 0; k < 2 * BENCH_AFFINE_FRAMES; k++)
+  {
+    affine = k % 2;
+
+    G_vdp_bg_mode = affine ? VDP_BG_MODE_AFFINE : 0;
+
+    start = SDL_GetPerformanceCounter();
+
+    vdp_invalidate_frame();
+    vdp_draw_frame();
+
+    total[affine] += SDL_GetPerformanceCounter() - start;
+  }
+
+  G_vdp_bg_mode = mode;
+  memcpy(G_vdp_bg_matrix, matrix, sizeof(matrix));
+  G_vdp_bg_center_x = center_x;
+  G_vdp_bg_center_y = center_y;
+
+  vdp_invalidate_frame();
+  vdp_draw_frame();
+
+  fprintf(stdout, "Affine bg:  %.3f ms scrolled, %.3f ms rotated per frame\n", 
+          total[0] * 1000.0 / freq / BENCH_AFFINE_FRAMES, 
+          total[1] * 1000.0 / freq / BENCH_AFFINE_FRAMES);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* bench_formats()                                                            */
+/******************************************************************************/
+static int bench_formats()
+{
+  int k;
+  int direct;
+  int first;
+  int last;
+
+  Uint64  freq;
+  Uint64  start;
+  Uint64  total[2];
+
+  int mismatch;
+
+  /* redraw the current frame into rgb555 & convert the whole of it */
+  /* to argb8888, and draw it as argb8888 directly, alternately     */
+  freq = SDL_GetPerformanceFrequency();
+
+  total[0] = 0;
+  total[1] = 0;
+
+  for (k = 0; k < 2 * BENCH_FORMAT_FRAMES; k++)
+  {
+    direct = k % 2;
+
+    start = SDL_GetPerformanceCounter();
+
+    vdp_invalidate_frame();
+
+    if (direct != 0)
+    {
+      vdp_set_format(VDP_FORMAT_ARGB8888);
+      vdp_prepare_frame();
+      vdp_dirty_lines(S_bench_drawn, &first, &last);
+      vdp_draw_lines( &S_bench_drawn[VDP_SCREEN_W * first], 
+                      VDP_SCREEN_W, first, last);
+    }
+    else
+    {
+      vdp_set_format(VDP_FORMAT_RGB555);
+      vdp_draw_frame();
+      vdp_convert_lines(S_bench_converted, VDP_SCREEN_W, 
+                        VDP_FORMAT_ARGB8888, 
+                        G_vdp_fb_rgb, VDP_SCREEN_W, VDP_SCREEN_H);
+    }
+
+    total[direct] += SDL_GetPerformanceCounter() - start;
+  }
+
+  vdp_set_format(VDP_FORMAT_RGB555);
+
+  mismatch = memcmp(S_bench_converted, S_bench_drawn, 
+                    sizeof(S_bench_drawn)) ? 1 : 0;
+
+  fprintf(stdout, "Formats:    %.3f ms rgb555 & converted, "
+                  "%.3f ms argb8888 per frame%s\n", 
+          total[0] * 1000.0 / freq / BENCH_FORMAT_FRAMES, 
+          total[1] * 1000.0 / freq / BENCH_FORMAT_FRAMES, 
+          mismatch ? " (MISMATCH)" : "");
+
+  return mismatch;
+}
+
+/******************************************************************************/
+/* bench_run()                                                                */
+/******************************************************************************/
+int bench_run(int num_frames)
+{
+  int k;
+
+  Uint64  freq;
+  Uint64  start;
+  Uint64  total;
+
+  Uint64* times;
+
+  unsigned long num_snapshots;
+  unsigned long num_bytes;
+
+  int mismatch;
+
+  if (num_frames <= 0)
+    return 1;
+
+  times = malloc(num_frames * sizeof(Uint64));
+
+  if (times == NULL)
+    return 1;
+
+  freq = SDL_GetPerformanceFrequency();
+
+  /* render the frames back to back */
+  total = 0;
+
+  state_reset();
+
+  for (k = 0; k < num_frames; k++)
+  {
+    start = SDL_GetPerformanceCounter();
+
+    /* measure full redraws (every line is unchanged after the first), */
+    /* with the animations advanced a tick per frame                   */
+    anim_tick();
+
+    vdp_invalidate_frame();
+    vdp_draw_frame();
+
+    times[k] = SDL_GetPerformanceCounter() - start;
+    total += times[k];
+
+    /* keep each frame's state (timed separately) */
+    state_push();
+  }
+
+  /* convert to nanoseconds & sort for the percentiles */
+  for (k = 0; k < num_frames; k++)
+    times[k] = (Uint64) (times[k] * (1000000000.0 / freq));
+
+  qsort(times, num_frames, sizeof(Uint64), bench_compare_times);
+
+  fprintf(stdout, "Frames:     %d (%s, %d workers)\n", 
+          num_frames, blit_mode_name(G_blit_mode), G_pool_num_threads);
+  fprintf(stdout, "Total:      %.3f ms\n", total * 1000.0 / freq);
+  fprintf(stdout, "Frames/sec: %.1f\n", 
+          (total > 0) ? (num_frames * (double) freq / total) : 0.0);
+  fprintf(stdout, "ns/frame:   mean %.0f, p50 %lu, p90 %lu, p99 %lu, max %lu\n", 
+          total * (1000000000.0 / freq) / num_frames, 
+          (unsigned long) times[num_frames / 2], 
+          (unsigned long) times[(num_frames * 90) / 100], 
+          (unsigned long) times[(num_frames * 99) / 100], 
+          (unsigned long) times[num_frames - 1]);
+  fprintf(stdout, "Sprites:    %lu drawn, %lu visited, %lu culled, "
+                  "%lu dropped\n", 
+          G_vdp_num_sprites_drawn, 
+          G_vdp_num_sprites_visited, 
+          G_vdp_num_sprites_culled, 
+          G_vdp_num_sprites_dropped);
+
+  fprintf(stdout, "Animation:  %lu active, %lu changed last tick\n", 
+          G_anim_num_active, G_anim_num_changed);
+
+  fprintf(stdout, "Sprite cache: %.1f%% hits, %lu entries, %lu KB\n", 
+          (G_pcache_num_hits + G_pcache_num_misses > 0) ? 
+            (100.0 * G_pcache_num_hits / 
+             (G_pcache_num_hits + G_pcache_num_misses)) : 0.0, 
+          G_pcache_num_entries, G_pcache_num_bytes / 1024);
+
+  if (G_bank_active)
+  {
+    fprintf(stdout, "Pages:      %lu loaded, %lu evicted, %lu resident, "
+                    "%lu sprites unpaged\n", 
+            G_bank_num_loaded, G_bank_num_evicted, G_bank_num_resident, 
+            G_vdp_num_sprites_unpaged);
+  }
+
+  fprintf(stdout, "Hash:       %016lx\n", bench_hash_frame());
+
+  /* compare the sprite line routines on the last frame */
+  mismatch = bench_sprite_lines();
+
+  /* time the affine background on it */
+  bench_affine();
+
+  /* time drawing it in the display's usual format */
+  if (bench_formats())
+    mismatch = 1;
+
+  /* step back through the kept states */
+  num_snapshots = G_state_num_snapshots;
+  num_bytes = G_state_rewind_bytes;
+
+  while (state_pop() == 0)
+    continue;
+
+  if (G_state_num_pushed > 0)
+  {
+    fprintf(stdout, "Rewind:     %lu snapshots in %lu KB, "
+                    "push mean %.1f us, max %.1f us, "
+                    "pop mean %.1f us, max %.1f us\n", 
+            num_snapshots, num_bytes / 1024, 
+            G_state_push_ns_total / 1000.0 / G_state_num_pushed, 
+            G_state_push_ns_max / 1000.0, 
+            (G_state_num_popped > 0) ? 
+              (G_state_pop_ns_total / 1000.0 / G_state_num_popped) : 0.0, 
+            G_state_pop_ns_max / 1000.0);
+  }
+
+  free(times);
+
+  return mismatch;
+}
+
+/******************************************************************************/
+/* bench_load()                                                               */
+/******************************************************************************/
+int bench_load(char* filename, int num_loads)
+{
+  int k;
+
+  Uint64  freq;
+  Uint64  start;
+  Uint64  total;
+
+  Uint64* times;
+
+  unsigned long num_bytes;
+
+  if (num_loads <= 0)
+    return 1;
+
+  times = malloc(num_loads * sizeof(Uint64));
+
+  if (times == NULL)
+    return 1;
+
+  freq = SDL_GetPerformanceFrequency();
+
+  /* load the cart back to back (the file stays in the page cache, */
+  /* so this measures parsing & decompression rather than the disk) */
+  total = 0;
+
+  for (k = 0; k < num_loads; k++)
+  {
+    start = SDL_GetPerformanceCounter();
+
+    if (rom_load(filename))
+    {
+      free(times);
+      return 1;
+    }
+
+    times[k] = SDL_GetPerformanceCounter() - start;
+    total += times[k];
+  }
+
+  /* convert to nanoseconds & sort for the percentiles */
+  for (k = 0; k < num_loads; k++)
+    times[k] = (Uint64) (times[k] * (1000000000.0 / freq));
+
+  qsort(times, num_loads, sizeof(Uint64), bench_compare_times);
+
+  num_bytes = 2 * (G_vdp_nametable_num_words + 
+                   G_vdp_pals_num_words + 
+                   G_vdp_tilemap_num_words) + G_vdp_bank_num_bytes;
+
+  fprintf(stdout, "Loads:      %d (%s, %s)\n", 
+          num_loads, 
+          G_rom_mapped ? "mapped" : "read", 
+          G_rom_packed ? "packed" : "raw");
+  fprintf(stdout, "ns/load:    mean %.0f, p50 %lu, min %lu, max %lu\n", 
+          total * (1000000000.0 / freq) / num_loads, 
+          (unsigned long) times[num_loads / 2], 
+          (unsigned long) times[0], 
+          (unsigned long) times[num_loads - 1]);
+  fprintf(stdout, "MB/sec:     %.1f (%lu KB of cart data)\n", 
+          (total > 0) ? 
+            (num_bytes * (double) num_loads * freq / total / 1000000.0) : 0.0, 
+          num_bytes / 1024);
+
+  free(times);
+
+  return 0;
+}
@@ -0,0 +1,15 @@
+/******************************************************************************/
+/* bench.h (headless benchmark)                                               */
+/******************************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+/* function declarations (bench_run() returns 1 if the frames could */
+/* not be drawn, or if routines that should agree drew differently) */
+unsigned long bench_hash_frame();
+
+int bench_run(int num_frames);
+int bench_load(char* filename, int num_loads);
+
+#endif
@@ -0,0 +1,730 @@
+/******************************************************************************/
+/* blit.c (cell row blitters)                                                 */
+/******************************************************************************/
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blit.h"
+
+#include "cell.h"
+#include "vdp.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLIT_X86
+#include <immintrin.h>
+#endif
+
+/* the sprite blitters are the cell blitters specialized for each run   */
+/* length: flattening inlines the cell blitter with the length constant, */
+/* so its loop is unrolled (the run length argument is ignored)          */
+#ifdef __GNUC__
+#define BLIT_FLATTEN __attribute__((flatten))
+#else
+#define BLIT_FLATTEN
+#endif
+
+/* log2 of the background layer width (for the affine blitters) */
+#define BLIT_LAYER_SHIFT 9
+
+#define BLIT_DEFINE_SPRITE_8BPP(name, blit, num_cells)                         \
+static void name( unsigned short* dst,                                         \
+                  unsigned char* pixels,                                       \
+                  unsigned char* masks,                                        \
+                  int run_length,                                              \
+                  unsigned short* pal)                                         \
+{                                                                              \
+  (void) run_length;                                                           \
+                                                                               \
+  blit(dst, pixels, masks, num_cells, pal);                                    \
+}
+
+#define BLIT_DEFINE_SPRITE_RGB(name, blit, num_cells)                          \
+static void name( unsigned short* dst,                                         \
+                  unsigned short* pixels,                                      \
+                  unsigned char* masks,                                        \
+                  int run_length)                                              \
+{                                                                              \
+  (void) run_length;                                                           \
+                                                                               \
+  blit(dst, pixels, masks, num_cells);                                         \
+}
+
+#define BLIT_DEFINE_SPRITE_BLITTERS(mode, attr)                                \
+attr BLIT_DEFINE_SPRITE_8BPP(blit_sprite_8bpp_1_##mode,                        \
+                             blit_cells_8bpp_##mode, 1)                        \
+attr BLIT_DEFINE_SPRITE_8BPP(blit_sprite_8bpp_2_##mode,                        \
+                             blit_cells_8bpp_##mode, 2)                        \
+attr BLIT_DEFINE_SPRITE_8BPP(blit_sprite_8bpp_3_##mode,                        \
+                             blit_cells_8bpp_##mode, 3)                        \
+attr BLIT_DEFINE_SPRITE_8BPP(blit_sprite_8bpp_4_##mode,                        \
+                             blit_cells_8bpp_##mode, 4)                        \
+attr BLIT_DEFINE_SPRITE_RGB( blit_sprite_rgb_1_##mode,                         \
+                             blit_cells_rgb_##mode, 1)                         \
+attr BLIT_DEFINE_SPRITE_RGB( blit_sprite_rgb_2_##mode,                         \
+                             blit_cells_rgb_##mode, 2)                         \
+attr BLIT_DEFINE_SPRITE_RGB( blit_sprite_rgb_3_##mode,                         \
+                             blit_cells_rgb_##mode, 3)                         \
+attr BLIT_DEFINE_SPRITE_RGB( blit_sprite_rgb_4_##mode,                         \
+                             blit_cells_rgb_##mode, 4)                         \
+                                                                               \
+static blit_8bpp_func S_blit_sprite_8bpp_##mode[BLIT_SPRITE_MAX_CELLS] =       \
+{                                                                              \
+  blit_sprite_8bpp_1_##mode, blit_sprite_8bpp_2_##mode,                        \
+  blit_sprite_8bpp_3_##mode, blit_sprite_8bpp_4_##mode                         \
+};                                                                             \
+                                                                               \
+static blit_rgb_func S_blit_sprite_rgb_##mode[BLIT_SPRITE_MAX_CELLS] =         \
+{                                                                              \
+  blit_sprite_rgb_1_##mode, blit_sprite_rgb_2_##mode,                          \
+  blit_sprite_rgb_3_##mode, blit_sprite_rgb_4_##mode                           \
+};
+
+/******************************************************************************/
+/* blit_cells_4bpp_scalar()                                                   */
+/******************************************************************************/
+static void blit_cells_4bpp_scalar( unsigned short* dst, 
+                                    unsigned char* src, 
+                                    int num_cells, 
+                                    unsigned short* pal)
+{
+  int m;
+  int n;
+
+  unsigned short pal_offset;
+
+  for (m = 0; m < num_cells; m++)
+  {
+    for (n = 0; n < VDP_CELL_W_H; n++)
+    {
+      if (n % 2 == 0)
+        pal_offset = (src[n / 2] >> 4) & 0x0F;
+      else
+        pal_offset = src[n / 2] & 0x0F;
+
+      if (pal_offset != 0)
+        dst[n] = pal[pal_offset];
+    }
+
+    dst += VDP_CELL_W_H;
+    src += VDP_BYTES_PER_CELL;
+  }
+}
+
+/******************************************************************************/
+/* blit_cells_8bpp_scalar()                                                   */
+/******************************************************************************/
+static void blit_cells_8bpp_scalar( unsigned short* dst, 
+                                    unsigned char* pixels, 
+                                    unsigned char* masks, 
+                                    int num_cells, 
+                                    unsigned short* pal)
+{
+  int m;
+  int n;
+
+  for (m = 0; m < num_cells; m++)
+  {
+    if (*masks == 0xFF)
+    {
+      for (n = 0; n < VDP_CELL_W_H; n++)
+        dst[n] = pal[pixels[n]];
+    }
+    else if (*masks != 0x00)
+    {
+      for (n = 0; n < VDP_CELL_W_H; n++)
+      {
+        if (*masks & (1 << n))
+          dst[n] = pal[pixels[n]];
+      }
+    }
+
+    dst += VDP_CELL_W_H;
+    pixels += CELL_PIXEL_BYTES;
+    masks += CELL_MASK_BYTES;
+  }
+}
+
+/******************************************************************************/
+/* blit_cells_rgb_scalar()                                                    */
+/******************************************************************************/
+static void blit_cells_rgb_scalar(unsigned short* dst, 
+                                  unsigned short* pixels, 
+                                  unsigned char* masks, 
+                                  int num_cells)
+{
+  int m;
+  int n;
+
+  for (m = 0; m < num_cells; m++)
+  {
+    if (masks[m] == 0xFF)
+      memcpy(dst, pixels, VDP_CELL_W_H * sizeof(unsigned short));
+    else if (masks[m] != 0x00)
+    {
+      for (n = 0; n < VDP_CELL_W_H; n++)
+      {
+        if (masks[m] & (1 << n))
+          dst[n] = pixels[n];
+      }
+    }
+
+    dst += VDP_CELL_W_H;
+    pixels += VDP_CELL_W_H;
+  }
+}
+
+BLIT_DEFINE_SPRITE_BLITTERS(scalar, BLIT_FLATTEN)
+
+/******************************************************************************/
+/* blit_affine_scalar()                                                       */
+/******************************************************************************/
+static void blit_affine_scalar( unsigned short* dst, 
+                                unsigned short* layer, 
+                                unsigned long u, unsigned long v, 
+                                unsigned long du, unsigned long dv, 
+                                int num_pixels)
+{
+  int k;
+
+  for (k = 0; k < num_pixels; k++)
+  {
+    dst[k] = layer[(((v >> 8) & (VDP_LAYER_H - 1)) << BLIT_LAYER_SHIFT) | 
+                   ((u >> 8) & (VDP_LAYER_W - 1))];
+
+    u += du;
+    v += dv;
+  }
+}
+
+#ifdef BLIT_X86
+
+/* the 16 color palette is split into a table of low bytes and a table */
+/* of high bytes, so that each can be looked up with one byte shuffle  */
+
+/******************************************************************************/
+/* blit_load_pal_ssse3()                                                      */
+/******************************************************************************/
+__attribute__((target("ssse3")))
+static void blit_load_pal_ssse3(unsigned short* pal, 
+                                __m128i* pal_lo, 
+                                __m128i* pal_hi)
+{
+  __m128i p_0;
+  __m128i p_1;
+
+  __m128i even;
+  __m128i odd;
+
+  p_0 = _mm_loadu_si128((__m128i*) &pal[0]);
+  p_1 = _mm_loadu_si128((__m128i*) &pal[8]);
+
+  even = _mm_setr_epi8( 0,  2,  4,  6,  8, 10, 12, 14, 
+                       -1, -1, -1, -1, -1, -1, -1, -1);
+  odd = _mm_setr_epi8(  1,  3,  5,  7,  9, 11, 13, 15, 
+                       -1, -1, -1, -1, -1, -1, -1, -1);
+
+  *pal_lo = _mm_unpacklo_epi64( _mm_shuffle_epi8(p_0, even), 
+                                _mm_shuffle_epi8(p_1, even));
+  *pal_hi = _mm_unpacklo_epi64( _mm_shuffle_epi8(p_0, odd), 
+                                _mm_shuffle_epi8(p_1, odd));
+}
+
+/******************************************************************************/
+/* blit_expand_4bpp_ssse3()                                                   */
+/******************************************************************************/
+__attribute__((target("ssse3")))
+static __m128i blit_expand_4bpp_ssse3(unsigned char* src)
+{
+  int     packed;
+  __m128i val;
+
+  /* the left pixel of each pair is in the high nibble */
+  memcpy(&packed, src, sizeof(packed));
+
+  val = _mm_cvtsi32_si128(packed);
+
+  return _mm_unpacklo_epi8( _mm_and_si128(_mm_srli_epi16(val, 4), 
+                                          _mm_set1_epi8(0x0F)), 
+                            _mm_and_si128(val, _mm_set1_epi8(0x0F)));
+}
+
+/******************************************************************************/
+/* blit_cell_row_ssse3()                                                      */
+/******************************************************************************/
+__attribute__((target("ssse3")))
+static void blit_cell_row_ssse3(unsigned short* dst, 
+                                __m128i idx, 
+                                __m128i pal_lo, 
+                                __m128i pal_hi)
+{
+  int     transparent;
+
+  __m128i color;
+  __m128i mask;
+
+  /* idx holds 8 palette offsets in its low half */
+  mask = _mm_cmpeq_epi8(idx, _mm_setzero_si128());
+
+  transparent = _mm_movemask_epi8(mask) & 0xFF;
+
+  if (transparent == 0xFF)
+    return;
+
+  color = _mm_unpacklo_epi8(_mm_shuffle_epi8(pal_lo, idx), 
+                            _mm_shuffle_epi8(pal_hi, idx));
+
+  if (transparent != 0x00)
+  {
+    mask = _mm_unpacklo_epi8(mask, mask);
+
+    color = _mm_or_si128( _mm_and_si128(mask, 
+                                        _mm_loadu_si128((__m128i*) dst)), 
+                          _mm_andnot_si128(mask, color));
+  }
+
+  _mm_storeu_si128((__m128i*) dst, color);
+}
+
+/******************************************************************************/
+/* blit_cells_4bpp_ssse3()                                                    */
+/******************************************************************************/
+__attribute__((target("ssse3")))
+static void blit_cells_4bpp_ssse3(unsigned short* dst, 
+                                  unsigned char* src, 
+                                  int num_cells, 
+                                  unsigned short* pal)
+{
+  int     m;
+
+  __m128i pal_lo;
+  __m128i pal_hi;
+
+  blit_load_pal_ssse3(pal, &pal_lo, &pal_hi);
+
+  for (m = 0; m < num_cells; m++)
+  {
+    blit_cell_row_ssse3(dst, blit_expand_4bpp_ssse3(src), pal_lo, pal_hi);
+
+    dst += VDP_CELL_W_H;
+    src += VDP_BYTES_PER_CELL;
+  }
+}
+
+/******************************************************************************/
+/* blit_cells_8bpp_ssse3()                                                    */
+/******************************************************************************/
+__attribute__((target("ssse3")))
+static void blit_cells_8bpp_ssse3(unsigned short* dst, 
+                                  unsigned char* pixels, 
+                                  unsigned char* masks, 
+                                  int num_cells, 
+                                  unsigned short* pal)
+{
+  int     m;
+
+  __m128i pal_lo;
+  __m128i pal_hi;
+
+  blit_load_pal_ssse3(pal, &pal_lo, &pal_hi);
+
+  for (m = 0; m < num_cells; m++)
+  {
+    if (masks[CELL_MASK_BYTES * m] != 0x00)
+    {
+      blit_cell_row_ssse3(dst, 
+                          _mm_loadl_epi64((__m128i*) pixels), 
+                          pal_lo, pal_hi);
+    }
+
+    dst += VDP_CELL_W_H;
+    pixels += CELL_PIXEL_BYTES;
+  }
+}
+
+/******************************************************************************/
+/* blit_cells_rgb_ssse3()                                                     */
+/******************************************************************************/
+__attribute__((target("ssse3")))
+static void blit_cells_rgb_ssse3( unsigned short* dst, 
+                                  unsigned short* pixels, 
+                                  unsigned char* masks, 
+                                  int num_cells)
+{
+  int     m;
+
+  __m128i bits;
+  __m128i mask;
+  __m128i color;
+
+  /* mask bit n selects pixel n */
+  bits = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+
+  for (m = 0; m < num_cells; m++)
+  {
+    if (masks[m] != 0x00)
+    {
+      color = _mm_loadu_si128((__m128i*) pixels);
+
+      if (masks[m] != 0xFF)
+      {
+        mask = _mm_and_si128(_mm_set1_epi16(masks[m]), bits);
+        mask = _mm_cmpeq_epi16(mask, bits);
+
+        color = _mm_or_si128(_mm_and_si128(mask, color), 
+                             _mm_andnot_si128(mask, 
+                                              _mm_loadu_si128((__m128i*) dst)));
+      }
+
+      _mm_storeu_si128((__m128i*) dst, color);
+    }
+
+    dst += VDP_CELL_W_H;
+    pixels += VDP_CELL_W_H;
+  }
+}
+
+/******************************************************************************/
+/* blit_cell_pair_avx2()                                                      */
+/******************************************************************************/
+__attribute__((target("avx2")))
+static void blit_cell_pair_avx2(unsigned short* dst, 
+                                __m128i idx, 
+                                __m128i pal_lo, 
+                                __m128i pal_hi)
+{
+  int     transparent;
+
+  __m128i lo;
+  __m128i hi;
+
+  __m256i color;
+  __m256i mask;
+
+  /* idx holds 16 palette offsets (two cell rows) */
+  transparent = _mm_movemask_epi8(_mm_cmpeq_epi8(idx, _mm_setzero_si128()));
+
+  if (transparent == 0xFFFF)
+    return;
+
+  lo = _mm_shuffle_epi8(pal_lo, idx);
+  hi = _mm_shuffle_epi8(pal_hi, idx);
+
+  color = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_unpacklo_epi8(lo, hi)), 
+            _mm_unpackhi_epi8(lo, hi), 1);
+
+  if (transparent != 0x0000)
+  {
+    mask = _mm256_cmpeq_epi16(_mm256_cvtepu8_epi16(idx), 
+                              _mm256_setzero_si256());
+
+    color = _mm256_blendv_epi8( color, 
+                                _mm256_loadu_si256((__m256i*) dst), 
+                                mask);
+  }
+
+  _mm256_storeu_si256((__m256i*) dst, color);
+}
+
+/******************************************************************************/
+/* blit_cells_4bpp_avx2()                                                     */
+/******************************************************************************/
+__attribute__((target("avx2")))
+static void blit_cells_4bpp_avx2( unsigned short* dst, 
+                                  unsigned char* src, 
+                                  int num_cells, 
+                                  unsigned short* pal)
+{
+  int     m;
+
+  __m128i pal_lo;
+  __m128i pal_hi;
+
+  blit_load_pal_ssse3(pal, &pal_lo, &pal_hi);
+
+  for (m = 0; m + 1 < num_cells; m += 2)
+  {
+    blit_cell_pair_avx2(dst, 
+                        _mm_unpacklo_epi64( 
+                          blit_expand_4bpp_ssse3(src), 
+                          blit_expand_4bpp_ssse3(src + VDP_BYTES_PER_CELL)), 
+                        pal_lo, pal_hi);
+
+    dst += 2 * VDP_CELL_W_H;
+    src += 2 * VDP_BYTES_PER_CELL;
+  }
+
+  if (m < num_cells)
+    blit_cell_row_ssse3(dst, blit_expand_4bpp_ssse3(src), pal_lo, pal_hi);
+}
+
+/******************************************************************************/
+/* blit_cells_8bpp_avx2()                                                     */
+/******************************************************************************/
+__attribute__((target("avx2")))
+static void blit_cells_8bpp_avx2( unsigned short* dst, 
+                                  unsigned char* pixels, 
+                                  unsigned char* masks, 
+                                  int num_cells, 
+                                  unsigned short* pal)
+{
+  int     m;
+
+  __m128i pal_lo;
+  __m128i pal_hi;
+
+  blit_load_pal_ssse3(pal, &pal_lo, &pal_hi);
+
+  for (m = 0; m + 1 < num_cells; m += 2)
+  {
+    if ((masks[0] != 0x00) || (masks[CELL_MASK_BYTES] != 0x00))
+    {
+      blit_cell_pair_avx2(dst, 
+                          _mm_unpacklo_epi64( 
+                            _mm_loadl_epi64((__m128i*) pixels), 
+                            _mm_loadl_epi64((__m128i*) 
+                                            (pixels + CELL_PIXEL_BYTES))), 
+                          pal_lo, pal_hi);
+    }
+
+    dst += 2 * VDP_CELL_W_H;
+    pixels += 2 * CELL_PIXEL_BYTES;
+    masks += 2 * CELL_MASK_BYTES;
+  }
+
+  if ((m < num_cells) && (masks[0] != 0x00))
+  {
+    blit_cell_row_ssse3(dst, 
+                        _mm_loadl_epi64((__m128i*) pixels), 
+                        pal_lo, pal_hi);
+  }
+}
+
+/******************************************************************************/
+/* blit_cells_rgb_avx2()                                                      */
+/******************************************************************************/
+__attribute__((target("avx2")))
+static void blit_cells_rgb_avx2(unsigned short* dst, 
+                                unsigned short* pixels, 
+                                unsigned char* masks, 
+                                int num_cells)
+{
+  int     m;
+
+  __m256i bits;
+  __m256i mask;
+  __m256i color;
+
+  /* mask bit n of each cell in the pair selects its pixel n */
+  bits = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 
+                           1, 2, 4, 8, 16, 32, 64, 128);
+
+  for (m = 0; m + 1 < num_cells; m += 2)
+  {
+    if ((masks[m] != 0x00) || (masks[m + 1] != 0x00))
+    {
+      color = _mm256_loadu_si256((__m256i*) pixels);
+
+      if ((masks[m] != 0xFF) || (masks[m + 1] != 0xFF))
+      {
+        mask = _mm256_and_si256(
+                 _mm256_inserti128_si256( 
+                   _mm256_castsi128_si256(_mm_set1_epi16(masks[m])), 
+                   _mm_set1_epi16(masks[m + 1]), 1), 
+                 bits);
+        mask = _mm256_cmpeq_epi16(mask, bits);
+
+        color = _mm256_blendv_epi8( _mm256_loadu_si256((__m256i*) dst), 
+                                    color, 
+                                    mask);
+      }
+
+      _mm256_storeu_si256((__m256i*) dst, color);
+    }
+
+    dst += 2 * VDP_CELL_W_H;
+    pixels += 2 * VDP_CELL_W_H;
+  }
+
+  if (m < num_cells)
+    blit_cells_rgb_ssse3(dst, pixels, masks + m, 1);
+}
+
+BLIT_DEFINE_SPRITE_BLITTERS(ssse3, __attribute__((target("ssse3"), flatten)))
+BLIT_DEFINE_SPRITE_BLITTERS(avx2, __attribute__((target("avx2"), flatten)))
+
+/******************************************************************************/
+/* blit_affine_avx2()                                                         */
+/******************************************************************************/
+__attribute__((target("avx2")))
+static void blit_affine_avx2( unsigned short* dst, 
+                              unsigned short* layer, 
+                              unsigned long u, unsigned long v, 
+                              unsigned long du, unsigned long dv, 
+                              int num_pixels)
+{
+  int     k;
+
+  __m256i steps;
+  __m256i pos_u;
+  __m256i pos_v;
+  __m256i step_u;
+  __m256i step_v;
+
+  __m256i mask_w;
+  __m256i mask_h;
+  __m256i index;
+  __m256i color;
+
+  /* step 8 pixels at a time (in 32 bits, since only the low 17 bits */
+  /* of each coordinate matter, so bit 31 can be dropped as well)     */
+  steps = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+  pos_u = _mm256_add_epi32( _mm256_set1_epi32((int) (u & 0x7FFFFFFF)), 
+                            _mm256_mullo_epi32( 
+                              _mm256_set1_epi32((int) (du & 0x7FFFFFFF)), 
+                              steps));
+  pos_v = _mm256_add_epi32( _mm256_set1_epi32((int) (v & 0x7FFFFFFF)), 
+                            _mm256_mullo_epi32( 
+                              _mm256_set1_epi32((int) (dv & 0x7FFFFFFF)), 
+                              steps));
+
+  step_u = _mm256_set1_epi32((int) ((8 * du) & 0x7FFFFFFF));
+  step_v = _mm256_set1_epi32((int) ((8 * dv) & 0x7FFFFFFF));
+
+  mask_w = _mm256_set1_epi32(VDP_LAYER_W - 1);
+  mask_h = _mm256_set1_epi32(VDP_LAYER_H - 1);
+
+  for (k = 0; k + 8 <= num_pixels; k += 8)
+  {
+    index = _mm256_or_si256(
+              _mm256_slli_epi32(_mm256_and_si256( _mm256_srli_epi32(pos_v, 8), 
+                                                  mask_h), 
+                                BLIT_LAYER_SHIFT), 
+              _mm256_and_si256(_mm256_srli_epi32(pos_u, 8), mask_w));
+
+    /* gather 32 bits at each pixel & keep the low 16 (the layer is */
+    /* padded, so the last pixel can be gathered this way too)      */
+    color = _mm256_i32gather_epi32((int const*) layer, index, 2);
+    color = _mm256_and_si256(color, _mm256_set1_epi32(0xFFFF));
+
+    color = _mm256_permute4x64_epi64( _mm256_packus_epi32(color, color), 
+                                      0x08);
+
+    _mm_storeu_si128((__m128i*) &dst[k], _mm256_castsi256_si128(color));
+
+    pos_u = _mm256_add_epi32(pos_u, step_u);
+    pos_v = _mm256_add_epi32(pos_v, step_v);
+  }
+
+  blit_affine_scalar( dst + k, layer, u + k * du, v + k * dv, du, dv, 
+                      num_pixels - k);
+}
+
+#endif
+
+/* blitters (scalar until a mode is selected) */
+blit_4bpp_func G_blit_cells_4bpp = blit_cells_4bpp_scalar;
+blit_8bpp_func G_blit_cells_8bpp = blit_cells_8bpp_scalar;
+blit_rgb_func  G_blit_cells_rgb = blit_cells_rgb_scalar;
+
+blit_8bpp_func G_blit_sprite_8bpp[BLIT_SPRITE_MAX_CELLS] = 
+{
+  blit_sprite_8bpp_1_scalar, blit_sprite_8bpp_2_scalar, 
+  blit_sprite_8bpp_3_scalar, blit_sprite_8bpp_4_scalar
+};
+
+blit_rgb_func  G_blit_sprite_rgb[BLIT_SPRITE_MAX_CELLS] = 
+{
+  blit_sprite_rgb_1_scalar, blit_sprite_rgb_2_scalar, 
+  blit_sprite_rgb_3_scalar, blit_sprite_rgb_4_scalar
+};
+
+blit_affine_func G_blit_affine = blit_affine_scalar;
+
+int            G_blit_mode = BLIT_MODE_SCALAR;
+
+/******************************************************************************/
+/* blit_set_mode()                                                            */
+/******************************************************************************/
+int blit_set_mode(int mode)
+{
+  /* determine the best mode supported by this cpu */
+  if (mode == BLIT_MODE_AUTO)
+  {
+    if (SDL_HasAVX2())
+      mode = BLIT_MODE_AVX2;
+    else if (SDL_HasSSSE3())
+      mode = BLIT_MODE_SSSE3;
+    else
+      mode = BLIT_MODE_SCALAR;
+  }
+
+#ifdef BLIT_X86
+  if ((mode == BLIT_MODE_AVX2) && SDL_HasAVX2())
+  {
+    G_blit_cells_4bpp = blit_cells_4bpp_avx2;
+    G_blit_cells_8bpp = blit_cells_8bpp_avx2;
+    G_blit_cells_rgb = blit_cells_rgb_avx2;
+
+    memcpy(G_blit_sprite_8bpp, S_blit_sprite_8bpp_avx2, 
+           sizeof(G_blit_sprite_8bpp));
+    memcpy(G_blit_sprite_rgb, S_blit_sprite_rgb_avx2, 
+           sizeof(G_blit_sprite_rgb));
+
+    G_blit_affine = blit_affine_avx2;
+  }
+  else if ((mode == BLIT_MODE_SSSE3) && SDL_HasSSSE3())
+  {
+    G_blit_cells_4bpp = blit_cells_4bpp_ssse3;
+    G_blit_cells_8bpp = blit_cells_8bpp_ssse3;
+    G_blit_cells_rgb = blit_cells_rgb_ssse3;
+
+    memcpy(G_blit_sprite_8bpp, S_blit_sprite_8bpp_ssse3, 
+           sizeof(G_blit_sprite_8bpp));
+    memcpy(G_blit_sprite_rgb, S_blit_sprite_rgb_ssse3, 
+           sizeof(G_blit_sprite_rgb));
+
+    G_blit_affine = blit_affine_scalar;
+  }
+  else
+#endif
+  if (mode == BLIT_MODE_SCALAR)
+  {
+    G_blit_cells_4bpp = blit_cells_4bpp_scalar;
+    G_blit_cells_8bpp = blit_cells_8bpp_scalar;
+    G_blit_cells_rgb = blit_cells_rgb_scalar;
+
+    memcpy(G_blit_sprite_8bpp, S_blit_sprite_8bpp_scalar, 
+           sizeof(G_blit_sprite_8bpp));
+    memcpy(G_blit_sprite_rgb, S_blit_sprite_rgb_scalar, 
+           sizeof(G_blit_sprite_rgb));
+
+    G_blit_affine = blit_affine_scalar;
+  }
+  else
+    return 1;
+
+  G_blit_mode = mode;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* blit_mode_name()                                                           */
+/******************************************************************************/
+char* blit_mode_name(int mode)
+{
+  if (mode == BLIT_MODE_AVX2)
+    return "avx2";
+  else if (mode == BLIT_MODE_SSSE3)
+    return "ssse3";
+  else if (mode == BLIT_MODE_SCALAR)
+    return "scalar";
+  else
+    return "auto";
+}
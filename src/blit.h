@@ -0,0 +1,74 @@
+/******************************************************************************/
+/* blit.h (cell row blitters)                                                 */
+/******************************************************************************/
+
+#ifndef BLIT_H
+#define BLIT_H
+
+enum
+{
+  BLIT_MODE_AUTO = 0, 
+  BLIT_MODE_SCALAR, 
+  BLIT_MODE_SSSE3, 
+  BLIT_MODE_AVX2, 
+  BLIT_NUM_MODES 
+};
+
+/* each blitter draws a run of whole (unclipped) cell rows, 8 pixels  */
+/* per cell, with palette offset 0 treated as transparent. the source */
+/* is either the 4 bpp bank (cells are VDP_BYTES_PER_CELL apart) or   */
+/* the decoded cache (cells are CELL_PIXEL_BYTES / CELL_MASK_BYTES    */
+/* apart). the rgb blitters copy palette-resolved pixels (cells are   */
+/* VDP_CELL_W_H pixels & one mask byte apart). all modes produce      */
+/* identical output.                                                  */
+typedef void (*blit_4bpp_func)(unsigned short* dst, 
+                               unsigned char* src, 
+                               int num_cells, 
+                               unsigned short* pal);
+
+typedef void (*blit_8bpp_func)(unsigned short* dst, 
+                               unsigned char* pixels, 
+                               unsigned char* masks, 
+                               int num_cells, 
+                               unsigned short* pal);
+
+typedef void (*blit_rgb_func)( unsigned short* dst, 
+                               unsigned short* pixels, 
+                               unsigned char* masks, 
+                               int num_cells);
+
+/* the affine blitter samples a run of pixels from the background    */
+/* layer along a line, from (u, v) stepping by (du, dv) per pixel,    */
+/* all in 8.8 fixed point & wrapping around the layer (so only the    */
+/* low 17 bits of each matter). the layer is read as 32 bit words, so */
+/* it must be followed by BLIT_AFFINE_PAD pixels of padding.          */
+#define BLIT_AFFINE_PAD 2
+
+typedef void (*blit_affine_func)( unsigned short* dst, 
+                                  unsigned short* layer, 
+                                  unsigned long u, unsigned long v, 
+                                  unsigned long du, unsigned long dv, 
+                                  int num_pixels);
+
+extern blit_4bpp_func G_blit_cells_4bpp;
+extern blit_8bpp_func G_blit_cells_8bpp;
+extern blit_rgb_func  G_blit_cells_rgb;
+
+/* the sprite blitters draw a whole row of a sprite that is entirely */
+/* onscreen, with the loop unrolled for its width: entry n - 1 draws */
+/* n cells (& ignores the number of cells passed to it)              */
+#define BLIT_SPRITE_MAX_CELLS 4
+
+extern blit_8bpp_func G_blit_sprite_8bpp[BLIT_SPRITE_MAX_CELLS];
+extern blit_rgb_func  G_blit_sprite_rgb[BLIT_SPRITE_MAX_CELLS];
+
+extern blit_affine_func G_blit_affine;
+
+extern int            G_blit_mode;
+
+/* function declarations */
+int blit_set_mode(int mode);
+
+char* blit_mode_name(int mode);
+
+#endif
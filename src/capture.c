@@ -0,0 +1,361 @@
+/******************************************************************************/
+/* capture.c (video capture)                                                  */
+/******************************************************************************/
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+#include "vdp.h"
+
+/* converted frame sizes (a y4m frame starts with a "FRAME\n" marker) */
+#define CAPTURE_RGB_FRAME_SIZE  (3 * VDP_SCREEN_SIZE)
+#define CAPTURE_Y4M_FRAME_SIZE  (6 + VDP_SCREEN_SIZE + VDP_SCREEN_SIZE / 2)
+
+/* 5 bit color component to 8 bits */
+#define CAPTURE_EXPAND(c)       (((c) << 3) | ((c) >> 2))
+
+/* the main thread only advances the head of the ring, and the writer */
+/* only advances the tail, so a frame is handed off without a lock    */
+/* (the semaphore is posted once per frame, and once more to quit)    */
+static unsigned short S_capture_buffers[CAPTURE_NUM_BUFFERS][VDP_SCREEN_SIZE];
+
+static SDL_atomic_t   S_capture_head;   /* advanced by the main thread */
+static SDL_atomic_t   S_capture_tail;   /* advanced by the writer      */
+
+static SDL_Thread*    S_capture_thread = NULL;
+static SDL_sem*       S_capture_sem = NULL;
+
+static SDL_atomic_t   S_capture_quit;
+
+/* output (owned by the writer thread while capturing) */
+static FILE*          S_capture_fp = NULL;
+
+static int            S_capture_format;
+static int            S_capture_failed;
+
+static unsigned char* S_capture_write_buf = NULL;
+static unsigned long  S_capture_write_pos;
+static unsigned long  S_capture_num_bytes;
+
+int                   G_capture_active = 0;
+
+unsigned long         G_capture_num_written;
+unsigned long         G_capture_num_dropped;
+
+/******************************************************************************/
+/* capture_flush()                                                            */
+/******************************************************************************/
+static void capture_flush()
+{
+  if ((S_capture_write_pos > 0) && (S_capture_failed == 0))
+  {
+    if (fwrite( S_capture_write_buf, 1,
+                S_capture_write_pos, S_capture_fp) != S_capture_write_pos)
+    {
+      S_capture_failed = 1;
+    }
+
+    S_capture_num_bytes += S_capture_write_pos;
+  }
+
+  S_capture_write_pos = 0;
+}
+
+/******************************************************************************/
+/* capture_convert_rgb()                                                      */
+/******************************************************************************/
+static void capture_convert_rgb(unsigned char* dst, unsigned short* src)
+{
+  int k;
+
+  /* rgb555 to rgb24 */
+  for (k = 0; k < VDP_SCREEN_SIZE; k++)
+  {
+    dst[0] = (unsigned char) CAPTURE_EXPAND((src[k] >> 10) & 0x1F);
+    dst[1] = (unsigned char) CAPTURE_EXPAND((src[k] >> 5) & 0x1F);
+    dst[2] = (unsigned char) CAPTURE_EXPAND(src[k] & 0x1F);
+
+    dst += 3;
+  }
+}
+
+/******************************************************************************/
+/* capture_convert_y4m()                                                      */
+/******************************************************************************/
+static void capture_convert_y4m(unsigned char* dst, unsigned short* src)
+{
+  int m;
+  int n;
+  int k;
+
+  unsigned long r;
+  unsigned long g;
+  unsigned long b;
+  unsigned long c;
+
+  unsigned char* y_plane;
+  unsigned char* u_plane;
+  unsigned char* v_plane;
+
+  unsigned short* pixel;
+
+  memcpy(dst, "FRAME\n", 6);
+
+  y_plane = dst + 6;
+  u_plane = y_plane + VDP_SCREEN_SIZE;
+  v_plane = u_plane + VDP_SCREEN_SIZE / 4;
+
+  /* luma per pixel */
+  for (k = 0; k < VDP_SCREEN_SIZE; k++)
+  {
+    r = CAPTURE_EXPAND((src[k] >> 10) & 0x1F);
+    g = CAPTURE_EXPAND((src[k] >> 5) & 0x1F);
+    b = CAPTURE_EXPAND(src[k] & 0x1F);
+
+    y_plane[k] = (unsigned char) ((77 * r + 150 * g + 29 * b + 128) >> 8);
+  }
+
+  /* chroma per 2x2 block, from the block's average color (the sums */
+  /* are biased by 128 << 8, so that they are never negative)        */
+  for (m = 0; m < VDP_SCREEN_H; m += 2)
+  {
+    for (n = 0; n < VDP_SCREEN_W; n += 2)
+    {
+      r = 0;
+      g = 0;
+      b = 0;
+
+      for (k = 0; k < 4; k++)
+      {
+        pixel = &src[(m + k / 2) * VDP_SCREEN_W + n + (k % 2)];
+
+        r += CAPTURE_EXPAND((*pixel >> 10) & 0x1F);
+        g += CAPTURE_EXPAND((*pixel >> 5) & 0x1F);
+        b += CAPTURE_EXPAND(*pixel & 0x1F);
+      }
+
+      r = (r + 2) / 4;
+      g = (g + 2) / 4;
+      b = (b + 2) / 4;
+
+      c = (128 * b + 32768 + 128 - 43 * r - 85 * g) >> 8;
+      *u_plane++ = (unsigned char) ((c > 255) ? 255 : c);
+
+      c = (128 * r + 32768 + 128 - 107 * g - 21 * b) >> 8;
+      *v_plane++ = (unsigned char) ((c > 255) ? 255 : c);
+    }
+  }
+}
+
+/******************************************************************************/
+/* capture_thread()                                                           */
+/******************************************************************************/
+static int capture_thread(void* data)
+{
+  int tail;
+
+  unsigned long frame_size;
+
+  (void) data;
+
+  frame_size = (S_capture_format == CAPTURE_FORMAT_Y4M) ?
+    CAPTURE_Y4M_FRAME_SIZE : CAPTURE_RGB_FRAME_SIZE;
+
+  while (1)
+  {
+    SDL_SemWait(S_capture_sem);
+
+    /* the quit post comes after every frame's post */
+    tail = SDL_AtomicGet(&S_capture_tail);
+
+    if (tail == SDL_AtomicGet(&S_capture_head))
+    {
+      if (SDL_AtomicGet(&S_capture_quit))
+        break;
+
+      continue;
+    }
+
+    /* convert the frame onto the end of the write buffer */
+    if (S_capture_write_pos + frame_size > CAPTURE_WRITE_SIZE)
+      capture_flush();
+
+    if (S_capture_format == CAPTURE_FORMAT_Y4M)
+    {
+      capture_convert_y4m(&S_capture_write_buf[S_capture_write_pos],
+                          S_capture_buffers[tail % CAPTURE_NUM_BUFFERS]);
+    }
+    else
+    {
+      capture_convert_rgb(&S_capture_write_buf[S_capture_write_pos],
+                          S_capture_buffers[tail % CAPTURE_NUM_BUFFERS]);
+    }
+
+    S_capture_write_pos += frame_size;
+
+    /* hand the buffer back */
+    SDL_AtomicSet(&S_capture_tail, tail + 1);
+
+    G_capture_num_written += 1;
+  }
+
+  capture_flush();
+
+  return 0;
+}
+
+/******************************************************************************/
+/* capture_start()                                                            */
+/******************************************************************************/
+int capture_start(char* filename, int frame_rate)
+{
+  unsigned long length;
+
+  capture_stop();
+
+  if ((filename == NULL) || (frame_rate <= 0))
+    return 1;
+
+  /* determine the format from the extension */
+  length = strlen(filename);
+
+  if ((length >= 4) && (!strcmp(&filename[length - 4], ".y4m")))
+    S_capture_format = CAPTURE_FORMAT_Y4M;
+  else
+    S_capture_format = CAPTURE_FORMAT_RAW;
+
+  /* open the file & write the stream header */
+  S_capture_fp = fopen(filename, "wb");
+
+  if (S_capture_fp == NULL)
+    return 1;
+
+  if (S_capture_format == CAPTURE_FORMAT_Y4M)
+  {
+    fprintf(S_capture_fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg "
+                          "XCOLORRANGE=FULL\n",
+            VDP_SCREEN_W, VDP_SCREEN_H, frame_rate);
+  }
+
+  S_capture_write_buf = malloc(CAPTURE_WRITE_SIZE);
+
+  if (S_capture_write_buf == NULL)
+  {
+    capture_stop();
+    return 1;
+  }
+
+  S_capture_write_pos = 0;
+  S_capture_num_bytes = 0;
+  S_capture_failed = 0;
+
+  SDL_AtomicSet(&S_capture_head, 0);
+  SDL_AtomicSet(&S_capture_tail, 0);
+  SDL_AtomicSet(&S_capture_quit, 0);
+
+  G_capture_num_written = 0;
+  G_capture_num_dropped = 0;
+
+  /* start the writer */
+  S_capture_sem = SDL_CreateSemaphore(0);
+
+  if (S_capture_sem == NULL)
+  {
+    capture_stop();
+    return 1;
+  }
+
+  S_capture_thread = SDL_CreateThread(capture_thread, "capture", NULL);
+
+  if (S_capture_thread == NULL)
+  {
+    capture_stop();
+    return 1;
+  }
+
+  G_capture_active = 1;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* capture_stop()                                                             */
+/******************************************************************************/
+int capture_stop()
+{
+  /* let the writer finish the frames in the ring */
+  if (S_capture_thread != NULL)
+  {
+    SDL_AtomicSet(&S_capture_quit, 1);
+    SDL_SemPost(S_capture_sem);
+
+    SDL_WaitThread(S_capture_thread, NULL);
+    S_capture_thread = NULL;
+  }
+
+  if (S_capture_sem != NULL)
+  {
+    SDL_DestroySemaphore(S_capture_sem);
+    S_capture_sem = NULL;
+  }
+
+  if (S_capture_fp != NULL)
+  {
+    if (fclose(S_capture_fp) != 0)
+      S_capture_failed = 1;
+
+    S_capture_fp = NULL;
+  }
+
+  if (S_capture_write_buf != NULL)
+  {
+    free(S_capture_write_buf);
+    S_capture_write_buf = NULL;
+  }
+
+  if (G_capture_active)
+  {
+    fprintf(stdout, "Capture: %lu frames written, %lu dropped, %lu KB%s\n",
+            G_capture_num_written, G_capture_num_dropped,
+            S_capture_num_bytes / 1024,
+            S_capture_failed ? " (write failed)" : "");
+  }
+
+  G_capture_active = 0;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* capture_frame()                                                            */
+/******************************************************************************/
+int capture_frame(unsigned short* fb)
+{
+  int head;
+
+  if ((G_capture_active == 0) || (fb == NULL))
+    return 1;
+
+  /* drop the frame if the writer has not freed up a buffer */
+  head = SDL_AtomicGet(&S_capture_head);
+
+  if (head - SDL_AtomicGet(&S_capture_tail) >= CAPTURE_NUM_BUFFERS)
+  {
+    G_capture_num_dropped += 1;
+    return 1;
+  }
+
+  memcpy( S_capture_buffers[head % CAPTURE_NUM_BUFFERS], fb,
+          VDP_SCREEN_SIZE * sizeof(unsigned short));
+
+  /* publish it (the atomic set orders the copy before it) */
+  SDL_AtomicSet(&S_capture_head, head + 1);
+  SDL_SemPost(S_capture_sem);
+
+  return 0;
+}
@@ -0,0 +1,36 @@
+/******************************************************************************/
+/* capture.h (video capture)                                                  */
+/******************************************************************************/
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+enum
+{
+  CAPTURE_FORMAT_RAW = 0, /* rgb24, no header or framing        */
+  CAPTURE_FORMAT_Y4M,     /* yuv 4:2:0 (full range bt.601)      */
+  CAPTURE_NUM_FORMATS
+};
+
+/* each captured frame is copied into a ring of buffers, which a writer */
+/* thread converts & writes out. if the writer falls behind and the     */
+/* ring is full, the frame is dropped (and counted) instead of waiting. */
+#define CAPTURE_NUM_BUFFERS 16
+
+/* converted frames are gathered & written out in chunks this size */
+#define CAPTURE_WRITE_SIZE  (1 << 21) /* 2 MB */
+
+extern int           G_capture_active;
+
+/* statistics */
+extern unsigned long G_capture_num_written;
+extern unsigned long G_capture_num_dropped;
+
+/* function declarations (the format is y4m if the filename ends */
+/* in ".y4m", and raw otherwise)                                  */
+int capture_start(char* filename, int frame_rate);
+int capture_stop();
+
+int capture_frame(unsigned short* fb);
+
+#endif
@@ -0,0 +1,250 @@
+/******************************************************************************/
+/* cell.c (decoded cell cache)                                                */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vdp.h"
+
+#include "bank.h"
+#include "cell.h"
+
+unsigned char* G_cell_pixels = NULL;
+unsigned char* G_cell_masks = NULL;
+
+unsigned long  G_cell_num_cached = 0;
+
+unsigned char* G_cell_rows_used = NULL;
+unsigned char* G_cell_rows_opaque = NULL;
+
+unsigned long  G_cell_num_classified = 0;
+
+static unsigned long S_cell_cache_limit = CELL_CACHE_LIMIT_DEFAULT;
+
+/******************************************************************************/
+/* cell_set_cache_limit()                                                     */
+/******************************************************************************/
+int cell_set_cache_limit(unsigned long num_bytes)
+{
+  S_cell_cache_limit = num_bytes;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* cell_clear_cache()                                                         */
+/******************************************************************************/
+int cell_clear_cache()
+{
+  if (G_cell_pixels != NULL)
+  {
+    free(G_cell_pixels);
+    G_cell_pixels = NULL;
+  }
+
+  if (G_cell_masks != NULL)
+  {
+    free(G_cell_masks);
+    G_cell_masks = NULL;
+  }
+
+  G_cell_num_cached = 0;
+
+  if (G_cell_rows_used != NULL)
+  {
+    free(G_cell_rows_used);
+    G_cell_rows_used = NULL;
+  }
+
+  if (G_cell_rows_opaque != NULL)
+  {
+    free(G_cell_rows_opaque);
+    G_cell_rows_opaque = NULL;
+  }
+
+  G_cell_num_classified = 0;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* cell_classify()                                                            */
+/******************************************************************************/
+static int cell_classify(unsigned long first_cell, unsigned long num_cells)
+{
+  unsigned long k;
+  int           m;
+  int           n;
+
+  unsigned char* src;
+  unsigned char* used;
+  unsigned char* opaque;
+
+  src = &G_vdp_bank_buf[VDP_BYTES_PER_CELL * first_cell];
+  used = &G_cell_rows_used[first_cell];
+  opaque = &G_cell_rows_opaque[first_cell];
+
+  /* check each row of 4 bpp pixels for opaque & transparent ones */
+  for (k = 0; k < num_cells; k++)
+  {
+    used[k] = 0;
+    opaque[k] = CELL_ALL_ROWS;
+
+    for (m = 0; m < VDP_CELL_W_H; m++)
+    {
+      for (n = 0; n < VDP_CELL_W_H / 2; n++)
+      {
+        if (src[n] != 0)
+          used[k] |= 1 << m;
+
+        if (((src[n] & 0xF0) == 0) || ((src[n] & 0x0F) == 0))
+          opaque[k] &= ~(1 << m);
+      }
+
+      src += VDP_CELL_W_H / 2;
+    }
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* cell_decode()                                                              */
+/******************************************************************************/
+static int cell_decode(unsigned long first_cell, unsigned long num_cells)
+{
+  unsigned long k;
+  int           n;
+
+  unsigned char* src;
+  unsigned char* pixels;
+  unsigned char* masks;
+
+  src = &G_vdp_bank_buf[VDP_BYTES_PER_CELL * first_cell];
+  pixels = &G_cell_pixels[CELL_PIXEL_BYTES * first_cell];
+  masks = &G_cell_masks[CELL_MASK_BYTES * first_cell];
+
+  /* unpack each row of 4 bpp pixels */
+  for (k = 0; k < num_cells * VDP_CELL_W_H; k++)
+  {
+    *masks = 0;
+
+    for (n = 0; n < VDP_CELL_W_H; n += 2)
+    {
+      pixels[n + 0] = (src[n / 2] >> 4) & 0x0F;
+      pixels[n + 1] = src[n / 2] & 0x0F;
+
+      if (pixels[n + 0] != 0)
+        *masks |= 1 << (n + 0);
+
+      if (pixels[n + 1] != 0)
+        *masks |= 1 << (n + 1);
+    }
+
+    src += VDP_CELL_W_H / 2;
+    pixels += VDP_CELL_W_H;
+    masks += 1;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* cell_build_cache()                                                         */
+/******************************************************************************/
+int cell_build_cache()
+{
+  unsigned long num_cells;
+
+  cell_clear_cache();
+
+  /* paged banks are not resident, so they are drawn from the pages */
+  /* (and their cells are left unclassified)                        */
+  if (G_bank_active)
+    return 0;
+
+  num_cells = G_vdp_bank_num_bytes / VDP_BYTES_PER_CELL;
+
+  if (num_cells == 0)
+    return 0;
+
+  /* classify every cell in the bank */
+  G_cell_rows_used = malloc(num_cells);
+  G_cell_rows_opaque = malloc(num_cells);
+
+  if ((G_cell_rows_used == NULL) || (G_cell_rows_opaque == NULL))
+  {
+    cell_clear_cache();
+    return 1;
+  }
+
+  cell_classify(0, num_cells);
+
+  G_cell_num_classified = num_cells;
+
+  /* determine how many cells fit in the cache */
+
+  if (num_cells > S_cell_cache_limit / CELL_BYTES_PER_CELL)
+    num_cells = S_cell_cache_limit / CELL_BYTES_PER_CELL;
+
+  if (num_cells == 0)
+    return 0;
+
+  /* allocate the cache */
+  G_cell_pixels = malloc(num_cells * CELL_PIXEL_BYTES);
+  G_cell_masks = malloc(num_cells * CELL_MASK_BYTES);
+
+  if ((G_cell_pixels == NULL) || (G_cell_masks == NULL))
+  {
+    cell_clear_cache();
+    return 1;
+  }
+
+  cell_decode(0, num_cells);
+
+  G_cell_num_cached = num_cells;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* cell_update_cache()                                                        */
+/******************************************************************************/
+int cell_update_cache(unsigned long addr, unsigned long num_bytes)
+{
+  unsigned long first_cell;
+  unsigned long last_cell;
+
+  /* determine the cells that overlap this range of the bank */
+  first_cell = addr / VDP_BYTES_PER_CELL;
+  last_cell = (addr + num_bytes + VDP_BYTES_PER_CELL - 1) / VDP_BYTES_PER_CELL;
+
+  if (last_cell > G_cell_num_classified)
+    last_cell = G_cell_num_classified;
+
+  if (first_cell >= last_cell)
+    return 0;
+
+  cell_classify(first_cell, last_cell - first_cell);
+
+  /* and the cached ones among them */
+  if (last_cell > G_cell_num_cached)
+    last_cell = G_cell_num_cached;
+
+  if (first_cell >= last_cell)
+    return 0;
+
+  cell_decode(first_cell, last_cell - first_cell);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* cell_cache_bytes()                                                         */
+/******************************************************************************/
+unsigned long cell_cache_bytes()
+{
+  return G_cell_num_cached * CELL_BYTES_PER_CELL + 2 * G_cell_num_classified;
+}
@@ -0,0 +1,44 @@
+/******************************************************************************/
+/* cell.h (decoded cell cache)                                                */
+/******************************************************************************/
+
+#ifndef CELL_H
+#define CELL_H
+
+/* each cached cell is stored as 8 bits per pixel (the palette offset), */
+/* with one opacity mask byte per row (bit n is set if pixel n is not   */
+/* transparent). cells are cached in order from the start of the bank,  */
+/* up to the cache limit; cells past that are drawn from the bank.      */
+#define CELL_PIXEL_BYTES    VDP_PIXELS_PER_CELL
+#define CELL_MASK_BYTES     VDP_CELL_W_H
+
+#define CELL_BYTES_PER_CELL (CELL_PIXEL_BYTES + CELL_MASK_BYTES)
+
+#define CELL_CACHE_LIMIT_DEFAULT  (1 << 24) /* 16 MB (entire bank) */
+
+/* every cell in a resident bank (cached or not) is also classified by */
+/* row: bit n of its used byte is set if row n has an opaque pixel, &  */
+/* bit n of its opaque byte if every pixel in row n is opaque. a cell  */
+/* is empty if no rows are used, & opaque if every row is opaque.      */
+#define CELL_ALL_ROWS       0xFF
+
+extern unsigned char* G_cell_pixels;
+extern unsigned char* G_cell_masks;
+
+extern unsigned long  G_cell_num_cached;
+
+extern unsigned char* G_cell_rows_used;
+extern unsigned char* G_cell_rows_opaque;
+
+extern unsigned long  G_cell_num_classified;
+
+/* function declarations */
+int cell_set_cache_limit(unsigned long num_bytes);
+
+int cell_clear_cache();
+int cell_build_cache();
+int cell_update_cache(unsigned long addr, unsigned long num_bytes);
+
+unsigned long cell_cache_bytes();
+
+#endif
@@ -0,0 +1,1112 @@
+/******************************************************************************/
+/* check.c (renderer self-check)                                              */
+/******************************************************************************/
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+#include "anim.h"
+#include "bench.h"
+#include "blit.h"
+#include "cell.h"
+#include "pcache.h"
+#include "pool.h"
+#include "rom.h"
+#include "vdp.h"
+
+/* synthetic bank (cells 0-63 are opaque, 64-127 are transparent, */
+/* and the rest are a mix of both)                                 */
+#define CHECK_NUM_CELLS     4096
+#define CHECK_NUM_PALS      16
+
+#define CHECK_OPAQUE_CELLS  0
+#define CHECK_CLEAR_CELLS   64
+#define CHECK_MIXED_CELLS   128
+
+/* 64 bit fnv-1a prime (the frame hashes are folded into the scene's) */
+#define CHECK_HASH_OFFSET   0xCBF29CE484222325UL
+#define CHECK_HASH_PRIME    0x00000100000001B3UL
+
+/* the cart scene (the background scene written out as a cart, then only */
+/* scrolled, as a mapped bank cannot be written, and reloaded with some  */
+/* tiles, colors, cells & a sprite changed from a second cart, which is  */
+/* the first with this suffix added to its name)                         */
+#define CHECK_CART_SEED       100
+#define CHECK_CART_FRAMES     8
+
+#define CHECK_CART_GOLDEN     0x4D0FD1AE388D2DC2UL
+#define CHECK_CART_GOLDEN_15  0x57E4D419733C67C2UL
+
+#define CHECK_EDIT_SUFFIX     ".edit"
+
+typedef struct check_scene
+{
+  char*         name;
+  int           line_limit;
+
+  void          (*setup)();
+  void          (*step)(int frame);
+
+  unsigned long golden;
+
+  /* (with the unused top bit of each pixel cleared, as it is lost  */
+  /* when the frames drawn in the other formats are converted back) */
+  unsigned long golden_15;
+} check_scene;
+
+typedef struct check_config
+{
+  int           blit_mode;
+  int           num_threads;
+
+  unsigned long cell_cache_limit;
+  unsigned long pcache_limit;
+
+  int           generic_sprites;
+  int           format;
+} check_config;
+
+static unsigned long S_check_seed;
+
+/* frames drawn in formats other than rgb555 (converted back to */
+/* rgb555 in the framebuffer, so they hash the same as its own) */
+static unsigned int S_check_target[VDP_SCREEN_SIZE];
+
+static char* S_check_format_names[VDP_NUM_FORMATS] = 
+  { "rgb555", "rgb565", "bgr555", "bgr565", "argb8888", "abgr8888" };
+
+static char* S_check_edit_filename;
+
+/******************************************************************************/
+/* check_random()                                                             */
+/******************************************************************************/
+static unsigned long check_random(unsigned long n)
+{
+  /* 32 bit lcg (so that the scenes do not depend on the host) */
+  S_check_seed = (S_check_seed * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+
+  return ((S_check_seed >> 16) & 0x7FFF) % n;
+}
+
+/******************************************************************************/
+/* check_fill_cell()                                                          */
+/******************************************************************************/
+static void check_fill_cell(unsigned long cell)
+{
+  int k;
+
+  unsigned char* dst;
+  unsigned char  hi;
+  unsigned char  lo;
+
+  dst = &G_vdp_bank_buf[VDP_BYTES_PER_CELL * cell];
+
+  /* about a quarter of the mixed pixels are transparent */
+  for (k = 0; k < VDP_BYTES_PER_CELL; k++)
+  {
+    hi = (unsigned char) check_random(16);
+    lo = (unsigned char) check_random(16);
+
+    if (cell < CHECK_CLEAR_CELLS)
+    {
+      hi |= (hi == 0) ? 1 : 0;
+      lo |= (lo == 0) ? 1 : 0;
+    }
+    else if (cell < CHECK_MIXED_CELLS)
+    {
+      hi = 0;
+      lo = 0;
+    }
+    else
+    {
+      hi = (check_random(4) == 0) ? 0 : hi;
+      lo = (check_random(4) == 0) ? 0 : lo;
+    }
+
+    dst[k] = (unsigned char) ((hi << 4) | lo);
+  }
+}
+
+/******************************************************************************/
+/* check_fill_cart()                                                          */
+/******************************************************************************/
+static void check_fill_cart()
+{
+  unsigned long k;
+
+  /* cells */
+  for (k = 0; k < CHECK_NUM_CELLS; k++)
+    check_fill_cell(k);
+
+  G_vdp_bank_num_bytes = CHECK_NUM_CELLS * VDP_BYTES_PER_CELL;
+
+  cell_build_cache();
+
+  /* palettes */
+  for (k = 0; k < CHECK_NUM_PALS * VDP_COLORS_PER_PAL; k++)
+    G_vdp_pals_buf[k] = (unsigned short) ((check_random(256) << 8) |
+                                          check_random(256));
+
+  G_vdp_pals_num_words = CHECK_NUM_PALS * VDP_COLORS_PER_PAL;
+}
+
+/******************************************************************************/
+/* check_fill_tile()                                                          */
+/******************************************************************************/
+static void check_fill_tile(int tile)
+{
+  unsigned long cell;
+
+  cell = check_random(CHECK_NUM_CELLS);
+
+  G_vdp_tilemap_buf[VDP_TILE_SIZE * tile + 0] =
+    (unsigned short) (((cell >> 8) & 0x3F00) | check_random(CHECK_NUM_PALS));
+  G_vdp_tilemap_buf[VDP_TILE_SIZE * tile + 1] =
+    (unsigned short) (cell & 0xFFFF);
+}
+
+/******************************************************************************/
+/* check_set_entry()                                                          */
+/******************************************************************************/
+static void check_set_entry(int entry, int x, int y,
+                            int num_columns, int num_rows, int pal,
+                            unsigned long cell, int num_frames, int delay)
+{
+  unsigned short* e;
+
+  e = &G_vdp_nametable_buf[VDP_ENTRY_SIZE * entry];
+
+  x &= VDP_POS_WRAP - 1;
+  y &= VDP_POS_WRAP - 1;
+
+  e[0] = (unsigned short) (((y & 0x100) << 1) | (x & 0x100) | (pal & 0xFF));
+  e[1] = (unsigned short) ( ((num_columns - 1) << 13) |
+                            ((num_rows - 1) << 11) |
+                            ((num_frames - 1) << 8) |
+                            delay);
+  e[2] = (unsigned short) ((cell >> 16) & 0x3F);
+  e[3] = (unsigned short) (cell & 0xFFFF);
+  e[4] = (unsigned short) (((x & 0xFF) << 8) | (y & 0xFF));
+}
+
+/******************************************************************************/
+/* check_random_entry()                                                       */
+/******************************************************************************/
+static void check_random_entry(int entry, int x, int y)
+{
+  int num_columns;
+  int num_rows;
+
+  num_columns = 1 + (int) check_random(4);
+  num_rows = 1 + (int) check_random(4);
+
+  check_set_entry(entry, x, y, num_columns, num_rows,
+                  (int) check_random(CHECK_NUM_PALS),
+                  CHECK_MIXED_CELLS +
+                    check_random(CHECK_NUM_CELLS - CHECK_MIXED_CELLS - 16),
+                  1, 0);
+}
+
+/******************************************************************************/
+/* check_move_entry()                                                         */
+/******************************************************************************/
+static void check_move_entry(int entry, int dx, int dy)
+{
+  unsigned short* e;
+
+  int x;
+  int y;
+
+  e = &G_vdp_nametable_buf[VDP_ENTRY_SIZE * entry];
+
+  x = ((e[0] & 0x100) | (e[4] >> 8)) + dx;
+  y = (((e[0] >> 1) & 0x100) | (e[4] & 0xFF)) + dy;
+
+  x &= VDP_POS_WRAP - 1;
+  y &= VDP_POS_WRAP - 1;
+
+  e[0] = (unsigned short) ((e[0] & 0xFCFF) | ((y & 0x100) << 1) | (x & 0x100));
+  e[4] = (unsigned short) (((x & 0xFF) << 8) | (y & 0xFF));
+}
+
+/******************************************************************************/
+/* check_sizes_setup()                                                        */
+/******************************************************************************/
+static void check_sizes_setup()
+{
+  int k;
+
+  check_fill_cart();
+
+  /* every size, four times over, on a grid */
+  for (k = 0; k < 64; k++)
+  {
+    check_set_entry(k, 8 + (k % 8) * 39, 4 + (k / 8) * 27,
+                    1 + (k % 4), 1 + ((k / 4) % 4), k % CHECK_NUM_PALS,
+                    CHECK_MIXED_CELLS + check_random(3900), 1, 0);
+  }
+
+  G_vdp_nametable_num_words = 64 * VDP_ENTRY_SIZE;
+}
+
+/******************************************************************************/
+/* check_sizes_step()                                                         */
+/******************************************************************************/
+static void check_sizes_step(int frame)
+{
+  int k;
+
+  /* drift each sprite by up to a pixel or two, and change a color */
+  for (k = 0; k < 64; k++)
+    check_move_entry(k, (k % 5) - 2, (k % 3) - 1);
+
+  G_vdp_pals_buf[ (frame % CHECK_NUM_PALS) * VDP_COLORS_PER_PAL +
+                  1 + (frame % 15)] = (unsigned short) check_random(0x8000);
+}
+
+/******************************************************************************/
+/* check_overlap_setup()                                                      */
+/******************************************************************************/
+static void check_overlap_setup()
+{
+  int k;
+  int kind;
+  int num_columns;
+  int num_rows;
+
+  check_fill_cart();
+
+  /* a pile of opaque, transparent & mixed sprites in the middle */
+  for (k = 0; k < 256; k++)
+  {
+    kind = (int) check_random(3);
+
+    if (kind == 2)
+    {
+      check_random_entry(k, 80 + check_random(160), 50 + check_random(124));
+      continue;
+    }
+
+    num_columns = 1 + (int) check_random(4);
+    num_rows = 1 + (int) check_random(4);
+
+    check_set_entry(k, 80 + check_random(160), 50 + check_random(124),
+                    num_columns, num_rows,
+                    (int) check_random(CHECK_NUM_PALS),
+                    ((kind == 0) ? CHECK_OPAQUE_CELLS : CHECK_CLEAR_CELLS) +
+                      check_random(65 - num_columns * num_rows),
+                    1, 0);
+  }
+
+  G_vdp_nametable_num_words = 256 * VDP_ENTRY_SIZE;
+}
+
+/******************************************************************************/
+/* check_overlap_step()                                                       */
+/******************************************************************************/
+static void check_overlap_step(int frame)
+{
+  int k;
+  int n;
+  int a;
+  int b;
+
+  unsigned short temp;
+
+  /* swap the draw order of a few pairs, and replace a sprite */
+  for (k = 0; k < 4 + (frame % 2); k++)
+  {
+    a = (int) check_random(256);
+    b = (int) check_random(256);
+
+    for (n = 0; n < VDP_ENTRY_SIZE; n++)
+    {
+      temp = G_vdp_nametable_buf[VDP_ENTRY_SIZE * a + n];
+
+      G_vdp_nametable_buf[VDP_ENTRY_SIZE * a + n] =
+        G_vdp_nametable_buf[VDP_ENTRY_SIZE * b + n];
+      G_vdp_nametable_buf[VDP_ENTRY_SIZE * b + n] = temp;
+    }
+  }
+
+  check_random_entry( (int) check_random(256),
+                      80 + check_random(160), 50 + check_random(124));
+}
+
+/******************************************************************************/
+/* check_edges_setup()                                                        */
+/******************************************************************************/
+static void check_edges_setup()
+{
+  int k;
+  int offset;
+
+  check_fill_cart();
+
+  /* sprites straddling each edge of the screen (the left & top ones */
+  /* by wrapping around), followed by some that are entirely offscreen */
+  for (k = 0; k < 128; k++)
+  {
+    offset = k / 4;
+
+    if (k % 4 == 0)
+      check_random_entry(k, VDP_POS_WRAP - offset, check_random(224));
+    else if (k % 4 == 1)
+      check_random_entry(k, VDP_SCREEN_W - offset, check_random(224));
+    else if (k % 4 == 2)
+      check_random_entry(k, check_random(320), VDP_POS_WRAP - offset);
+    else
+      check_random_entry(k, check_random(320), VDP_SCREEN_H - offset);
+  }
+
+  for (k = 128; k < 144; k++)
+    check_random_entry(k, 330 + check_random(140), 234 + check_random(240));
+
+  G_vdp_nametable_num_words = 144 * VDP_ENTRY_SIZE;
+}
+
+/******************************************************************************/
+/* check_edges_step()                                                         */
+/******************************************************************************/
+static void check_edges_step(int frame)
+{
+  int k;
+
+  /* move the edge sprites across their edges */
+  for (k = 0; k < 128; k++)
+  {
+    if (k % 4 < 2)
+      check_move_entry(k, 1 + (frame % 2), 0);
+    else
+      check_move_entry(k, 0, 1 + (frame % 2));
+  }
+}
+
+/******************************************************************************/
+/* check_many_setup()                                                         */
+/******************************************************************************/
+static void check_many_setup()
+{
+  int k;
+
+  check_fill_cart();
+
+  /* every entry, anywhere, over the background (with a line limit) */
+  for (k = 0; k < VDP_MAX_ENTRIES; k++)
+    check_random_entry(k, check_random(512), check_random(512));
+
+  G_vdp_nametable_num_words = VDP_NAMETABLE_SIZE;
+
+  for (k = 0; k < VDP_MAX_TILES; k++)
+    check_fill_tile(k);
+
+  G_vdp_tilemap_num_words = VDP_TILEMAP_SIZE;
+}
+
+/******************************************************************************/
+/* check_many_step()                                                          */
+/******************************************************************************/
+static void check_many_step(int frame)
+{
+  int k;
+
+  G_vdp_bg_scroll_x += 3;
+  G_vdp_bg_scroll_y += 1 + (frame % 2);
+
+  for (k = 0; k < 32; k++)
+  {
+    check_move_entry( (int) check_random(VDP_MAX_ENTRIES),
+                      (int) check_random(9) - 4, (int) check_random(9) - 4);
+  }
+}
+
+/******************************************************************************/
+/* check_anim_setup()                                                         */
+/******************************************************************************/
+static void check_anim_setup()
+{
+  int k;
+  int num_columns;
+  int num_rows;
+  int num_frames;
+
+  check_fill_cart();
+
+  /* animated sprites, with every frame count & a range of delays */
+  for (k = 0; k < 512; k++)
+  {
+    num_columns = 1 + (int) check_random(4);
+    num_rows = 1 + (int) check_random(4);
+    num_frames = 1 + (int) check_random(8);
+
+    check_set_entry(k, (int) check_random(340) - 16,
+                    (int) check_random(240) - 16,
+                    num_columns, num_rows,
+                    (int) check_random(CHECK_NUM_PALS),
+                    CHECK_MIXED_CELLS +
+                      check_random( CHECK_NUM_CELLS - CHECK_MIXED_CELLS -
+                                    num_columns * num_rows * num_frames),
+                    num_frames, (int) check_random(8));
+  }
+
+  G_vdp_nametable_num_words = 512 * VDP_ENTRY_SIZE;
+}
+
+/******************************************************************************/
+/* check_anim_step()                                                          */
+/******************************************************************************/
+static void check_anim_step(int frame)
+{
+  int k;
+
+  /* change the delay of an entry now & then (it is rescheduled) */
+  if (frame % 4 == 3)
+  {
+    k = (int) check_random(512);
+
+    G_vdp_nametable_buf[VDP_ENTRY_SIZE * k + 1] = (unsigned short)
+      ((G_vdp_nametable_buf[VDP_ENTRY_SIZE * k + 1] & 0xFF00) |
+       check_random(8));
+  }
+
+  for (k = 0; k <= frame % 3; k++)
+    anim_tick();
+}
+
+/******************************************************************************/
+/* check_bg_setup()                                                           */
+/******************************************************************************/
+static void check_bg_setup()
+{
+  int k;
+
+  check_fill_cart();
+
+  /* the background with a few sprites over it */
+  for (k = 0; k < VDP_MAX_TILES; k++)
+    check_fill_tile(k);
+
+  G_vdp_tilemap_num_words = VDP_TILEMAP_SIZE;
+
+  for (k = 0; k < 16; k++)
+    check_random_entry(k, check_random(320), check_random(224));
+
+  G_vdp_nametable_num_words = 16 * VDP_ENTRY_SIZE;
+}
+
+/******************************************************************************/
+/* check_bg_step()                                                            */
+/******************************************************************************/
+static void check_bg_step(int frame)
+{
+  int k;
+
+  unsigned long cell;
+
+  /* scroll, replace some tiles, change a color, and rewrite some cells */
+  G_vdp_bg_scroll_x += 5;
+  G_vdp_bg_scroll_y += (unsigned short) (frame % 3);
+
+  for (k = 0; k < 20; k++)
+    check_fill_tile((int) check_random(VDP_MAX_TILES));
+
+  G_vdp_pals_buf[check_random(CHECK_NUM_PALS * VDP_COLORS_PER_PAL)] =
+    (unsigned short) check_random(0x8000);
+
+  for (k = 0; k < 2; k++)
+  {
+    cell = CHECK_MIXED_CELLS +
+           check_random(CHECK_NUM_CELLS - CHECK_MIXED_CELLS);
+
+    check_fill_cell(cell);
+    vdp_invalidate_cells(cell * VDP_BYTES_PER_CELL, VDP_BYTES_PER_CELL);
+  }
+}
+
+/******************************************************************************/
+/* check_affine_matrix()                                                      */
+/******************************************************************************/
+static void check_affine_matrix(unsigned short* matrix, int a, int b, 
+                                int c, int d)
+{
+  matrix[VDP_MATRIX_A] = (unsigned short) (a & 0xFFFF);
+  matrix[VDP_MATRIX_B] = (unsigned short) (b & 0xFFFF);
+  matrix[VDP_MATRIX_C] = (unsigned short) (c & 0xFFFF);
+  matrix[VDP_MATRIX_D] = (unsigned short) (d & 0xFFFF);
+}
+
+/******************************************************************************/
+/* check_affine_setup()                                                       */
+/******************************************************************************/
+static void check_affine_setup()
+{
+  int k;
+
+  check_bg_setup();
+
+  /* the background rotated & scaled about the middle of the screen */
+  G_vdp_bg_mode = VDP_BG_MODE_AFFINE | VDP_BG_MODE_CLIP;
+
+  G_vdp_bg_center_x = VDP_SCREEN_W / 2;
+  G_vdp_bg_center_y = VDP_SCREEN_H / 2;
+
+  check_affine_matrix(G_vdp_bg_matrix, 0x100, 0, 0, 0x100);
+
+  for (k = 0; k < VDP_SCREEN_H; k++)
+  {
+    check_affine_matrix(&G_vdp_bg_line_matrix[VDP_MATRIX_SIZE * k], 
+                        0x100 + (k % 32) * 6, -(k % 16) * 8, 
+                        k * 2, 0x180 - k);
+  }
+}
+
+/******************************************************************************/
+/* check_affine_step()                                                        */
+/******************************************************************************/
+static void check_affine_step(int frame)
+{
+  /* change the matrix on most frames (shrinking, growing & shearing), */
+  /* switch between clipping & wrapping, and between the whole screen  */
+  /* & per line matrices, and sometimes only replace tiles & sprites   */
+  if (frame % 4 != 1)
+  {
+    check_affine_matrix(G_vdp_bg_matrix, 
+                        0x100 - frame * 20, frame * 13 - 96, 
+                        64 - frame * 11, 0xC0 + frame * 9);
+  }
+
+  if (frame % 6 == 5)
+    G_vdp_bg_mode ^= VDP_BG_MODE_CLIP;
+
+  if (frame % 8 == 7)
+    G_vdp_bg_mode ^= VDP_BG_MODE_PER_LINE;
+
+  G_vdp_bg_scroll_x += (unsigned short) (frame % 3);
+  G_vdp_bg_center_y -= (unsigned short) (frame % 2);
+
+  if (frame % 4 == 1)
+    check_bg_step(frame);
+  else
+    check_move_entry((int) check_random(16), 2, -1);
+}
+
+static check_scene S_check_scenes[] =
+{
+  { "sizes",      VDP_LINE_LIMIT_DEFAULT,
+    check_sizes_setup,    check_sizes_step,     0xFACD40BB142EE415UL,
+                                                0x09BE83482D266795UL },
+  { "overlap",    VDP_LINE_LIMIT_DEFAULT,
+    check_overlap_setup,  check_overlap_step,   0xE21156C3C8E46259UL,
+                                                0x82AF884C05C45BD9UL },
+  { "edges",      VDP_LINE_LIMIT_DEFAULT,
+    check_edges_setup,    check_edges_step,     0xD686EF5A62518CFEUL,
+                                                0x743188CE50D56D7EUL },
+  { "many",       16,
+    check_many_setup,     check_many_step,      0xCC17F4D21FB93D32UL,
+                                                0xE496786C43F90FB2UL },
+  { "animation",  VDP_LINE_LIMIT_DEFAULT,
+    check_anim_setup,     check_anim_step,      0x63F4EC9C683D83DDUL,
+                                                0x89732298669570DDUL },
+  { "background", VDP_LINE_LIMIT_DEFAULT,
+    check_bg_setup,       check_bg_step,        0xF1D3CE7B9C4C997EUL,
+                                                0x41DCD12FAD5D17FEUL },
+  { "affine",     VDP_LINE_LIMIT_DEFAULT,
+    check_affine_setup,   check_affine_step,    0x34D5506283A9B05FUL,
+                                                0x0A68CEBBAFD8695FUL }
+};
+
+#define CHECK_NUM_SCENES  (int) (sizeof(S_check_scenes) / sizeof(check_scene))
+
+/* the cell & sprite caches are also checked partly full, so that */
+/* some cells are drawn from the bank & some sprites are evicted, */
+/* the generic sprite line routine is checked on its own, and the */
+/* frames are also drawn in each of the other pixel formats       */
+#define CHECK_CACHE_DEFAULT   CELL_CACHE_LIMIT_DEFAULT
+#define CHECK_PCACHE_DEFAULT  PCACHE_LIMIT_DEFAULT
+
+static check_config S_check_configs[] =
+{
+  { BLIT_MODE_SCALAR, 0, CHECK_CACHE_DEFAULT, 0,                    0,
+    VDP_FORMAT_RGB555 },
+  { BLIT_MODE_SCALAR, 0, 0,                   CHECK_PCACHE_DEFAULT, 0,
+    VDP_FORMAT_RGB555 },
+  { BLIT_MODE_SCALAR, 3, 1 << 16,             1 << 16,              0,
+    VDP_FORMAT_RGB555 },
+  { BLIT_MODE_SCALAR, 0, CHECK_CACHE_DEFAULT, CHECK_PCACHE_DEFAULT, 1,
+    VDP_FORMAT_RGB555 },
+  { BLIT_MODE_SCALAR, 0, CHECK_CACHE_DEFAULT, CHECK_PCACHE_DEFAULT, 0,
+    VDP_FORMAT_RGB565 },
+  { BLIT_MODE_SCALAR, 3, CHECK_CACHE_DEFAULT, 0,                    0,
+    VDP_FORMAT_ABGR8888 },
+  { BLIT_MODE_SSSE3,  0, CHECK_CACHE_DEFAULT, 0,                    0,
+    VDP_FORMAT_RGB555 },
+  { BLIT_MODE_SSSE3,  2, 0,                   1 << 16,              0,
+    VDP_FORMAT_RGB555 },
+  { BLIT_MODE_SSSE3,  2, CHECK_CACHE_DEFAULT, CHECK_PCACHE_DEFAULT, 0,
+    VDP_FORMAT_BGR565 },
+  { BLIT_MODE_AVX2,   0, CHECK_CACHE_DEFAULT, 0,                    0,
+    VDP_FORMAT_RGB555 },
+  { BLIT_MODE_AVX2,   4, 1 << 16,             0,                    0,
+    VDP_FORMAT_RGB555 },
+  { BLIT_MODE_AVX2,   0, CHECK_CACHE_DEFAULT, 0,                    1,
+    VDP_FORMAT_RGB555 },
+  { BLIT_MODE_AVX2,   0, CHECK_CACHE_DEFAULT, CHECK_PCACHE_DEFAULT, 0,
+    VDP_FORMAT_ARGB8888 },
+  { BLIT_MODE_AVX2,   4, 1 << 16,             1 << 16,              0,
+    VDP_FORMAT_BGR555 }
+};
+
+#define CHECK_NUM_CONFIGS (int) (sizeof(S_check_configs) / sizeof(check_config))
+
+/******************************************************************************/
+/* check_draw_target()                                                        */
+/******************************************************************************/
+static void check_draw_target(int format)
+{
+  int k;
+  int first;
+  int last;
+
+  unsigned long p;
+
+  /* redraw the lines of the target that are out of date */
+  vdp_prepare_frame();
+  vdp_dirty_lines(S_check_target, &first, &last);
+
+  if (VDP_FORMAT_BYTES(format) == 4)
+  {
+    vdp_draw_lines( &S_check_target[VDP_SCREEN_W * first], 
+                    VDP_SCREEN_W, first, last);
+  }
+  else
+  {
+    vdp_draw_lines( (unsigned short*) S_check_target + VDP_SCREEN_W * first, 
+                    VDP_SCREEN_W, first, last);
+  }
+
+  /* convert the whole target back to rgb555 in the framebuffer */
+  for (k = 0; k < VDP_SCREEN_SIZE; k++)
+  {
+    if (VDP_FORMAT_BYTES(format) == 4)
+      p = S_check_target[k];
+    else
+      p = ((unsigned short*) S_check_target)[k];
+
+    if (format == VDP_FORMAT_RGB565)
+      p = ((p >> 1) & 0x7FE0) | (p & 0x001F);
+    else if (format == VDP_FORMAT_BGR555)
+      p = ((p << 10) & 0x7C00) | (p & 0x03E0) | ((p >> 10) & 0x001F);
+    else if (format == VDP_FORMAT_BGR565)
+      p = ((p << 10) & 0x7C00) | ((p >> 1) & 0x03E0) | ((p >> 11) & 0x001F);
+    else if (format == VDP_FORMAT_ARGB8888)
+      p = ((p >> 9) & 0x7C00) | ((p >> 6) & 0x03E0) | ((p >> 3) & 0x001F);
+    else if (format == VDP_FORMAT_ABGR8888)
+      p = ((p << 7) & 0x7C00) | ((p >> 6) & 0x03E0) | ((p >> 19) & 0x001F);
+
+    G_vdp_fb_rgb[k] = (unsigned short) p;
+  }
+}
+
+/******************************************************************************/
+/* check_hash_frame()                                                         */
+/******************************************************************************/
+static unsigned long check_hash_frame(unsigned long hash, int format)
+{
+  /* draw the frame, and fold its hash into the scene's */
+  if (format == VDP_FORMAT_RGB555)
+    vdp_draw_frame();
+  else
+    check_draw_target(format);
+
+  return (hash ^ bench_hash_frame()) * CHECK_HASH_PRIME;
+}
+
+/******************************************************************************/
+/* check_run_scene()                                                          */
+/******************************************************************************/
+static unsigned long check_run_scene(check_scene* scene, int index, 
+                                     int format)
+{
+  int k;
+
+  unsigned long hash;
+
+  /* build the scene (the same way each time) */
+  vdp_reset();
+  vdp_set_line_limit(scene->line_limit);
+
+  S_check_seed = 1 + index;
+
+  scene->setup();
+
+  /* draw the frames (only what changed is redrawn after the first) */
+  hash = CHECK_HASH_OFFSET;
+
+  for (k = 0; k < CHECK_NUM_FRAMES; k++)
+  {
+    if (k > 0)
+      scene->step(k);
+
+    hash = check_hash_frame(hash, format);
+  }
+
+  return hash;
+}
+
+/******************************************************************************/
+/* check_write_24()                                                           */
+/******************************************************************************/
+static void check_write_24(FILE* fp, unsigned long val)
+{
+  fputc((int) ((val >> 16) & 0xFF), fp);
+  fputc((int) ((val >> 8) & 0xFF), fp);
+  fputc((int) (val & 0xFF), fp);
+}
+
+/******************************************************************************/
+/* check_write_words()                                                        */
+/******************************************************************************/
+static void check_write_words(FILE* fp, unsigned short* buf, 
+                              unsigned long num_words)
+{
+  unsigned long k;
+
+  check_write_24(fp, num_words);
+
+  for (k = 0; k < num_words; k++)
+  {
+    fputc((buf[k] >> 8) & 0xFF, fp);
+    fputc(buf[k] & 0xFF, fp);
+  }
+}
+
+/******************************************************************************/
+/* check_write_cart()                                                         */
+/******************************************************************************/
+static int check_write_cart(char* filename)
+{
+  int result;
+
+  FILE* fp;
+
+  /* write the vdp buffers as a raw cart (big endian words) */
+  fp = fopen(filename, "wb");
+
+  if (fp == NULL)
+    return 1;
+
+  fwrite("KUNOICHICART", sizeof(char), 12, fp);
+
+  check_write_words(fp, G_vdp_nametable_buf, G_vdp_nametable_num_words);
+  check_write_words(fp, G_vdp_pals_buf, G_vdp_pals_num_words);
+
+  check_write_24(fp, G_vdp_bank_num_bytes);
+  fwrite(G_vdp_bank_buf, sizeof(unsigned char), G_vdp_bank_num_bytes, fp);
+
+  check_write_words(fp, G_vdp_tilemap_buf, G_vdp_tilemap_num_words);
+
+  result = ferror(fp) ? 1 : 0;
+
+  if (fclose(fp) != 0)
+    result = 1;
+
+  return result;
+}
+
+/******************************************************************************/
+/* check_cart_frames()                                                        */
+/******************************************************************************/
+static unsigned long check_cart_frames(unsigned long hash, int format)
+{
+  int k;
+
+  /* scroll the background from the top left corner */
+  G_vdp_bg_scroll_x = 0;
+  G_vdp_bg_scroll_y = 0;
+
+  for (k = 0; k < CHECK_CART_FRAMES; k++)
+  {
+    if (k > 0)
+    {
+      G_vdp_bg_scroll_x += 7;
+      G_vdp_bg_scroll_y += (unsigned short) (k % 3);
+    }
+
+    hash = check_hash_frame(hash, format);
+  }
+
+  return hash;
+}
+
+/******************************************************************************/
+/* check_cart_edit()                                                          */
+/******************************************************************************/
+static void check_cart_edit()
+{
+  int k;
+
+  unsigned long cell;
+
+  /* replace some tiles, change some colors, rewrite some cells, */
+  /* and move a sprite                                            */
+  for (k = 0; k < 40; k++)
+    check_fill_tile((int) check_random(VDP_MAX_TILES));
+
+  for (k = 0; k < 4; k++)
+  {
+    G_vdp_pals_buf[check_random(CHECK_NUM_PALS * VDP_COLORS_PER_PAL)] =
+      (unsigned short) check_random(0x8000);
+  }
+
+  for (k = 0; k < 8; k++)
+  {
+    cell = CHECK_MIXED_CELLS +
+           check_random(CHECK_NUM_CELLS - CHECK_MIXED_CELLS);
+
+    check_fill_cell(cell);
+    vdp_invalidate_cells(cell * VDP_BYTES_PER_CELL, VDP_BYTES_PER_CELL);
+  }
+
+  check_move_entry(3, 9, -4);
+}
+
+/******************************************************************************/
+/* check_cart_build()                                                         */
+/******************************************************************************/
+static int check_cart_build(char* filename, int format, unsigned long* hash)
+{
+  /* build the cart scene, and write it out before & after the edit */
+  rom_unload();
+  vdp_reset();
+  vdp_set_line_limit(VDP_LINE_LIMIT_DEFAULT);
+
+  S_check_seed = CHECK_CART_SEED;
+
+  check_bg_setup();
+
+  if (check_write_cart(filename))
+    return 1;
+
+  *hash = check_cart_frames(CHECK_HASH_OFFSET, format);
+
+  check_cart_edit();
+
+  if (check_write_cart(S_check_edit_filename))
+    return 1;
+
+  *hash = check_cart_frames(*hash, format);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* check_cart_load()                                                          */
+/******************************************************************************/
+static int check_cart_load(char* filename, int format, unsigned long* hash)
+{
+  int result;
+
+  /* load the cart, then reload it from the edited one */
+  /* (a mapped or paged cart is reloaded whole)         */
+  result = 1;
+
+  vdp_set_line_limit(VDP_LINE_LIMIT_DEFAULT);
+
+  if (rom_load(filename))
+    goto unload;
+
+  *hash = check_cart_frames(CHECK_HASH_OFFSET, format);
+
+  if (rom_reload(S_check_edit_filename))
+    goto unload;
+
+  *hash = check_cart_frames(*hash, format);
+
+  result = 0;
+
+unload:
+  rom_unload();
+
+  return result;
+}
+
+/******************************************************************************/
+/* check_report()                                                             */
+/******************************************************************************/
+static void check_report(char* name, check_config* config, 
+                         unsigned long hash, unsigned long golden)
+{
+  fprintf(stdout, "Check: %s failed (%s, %d workers, "
+                  "%lu KB cells, %lu KB sprites%s, %s): "
+                  "%016lx, expected %016lx\n",
+          name, blit_mode_name(config->blit_mode), config->num_threads,
+          config->cell_cache_limit / 1024, config->pcache_limit / 1024,
+          config->generic_sprites ? ", generic" : "",
+          S_check_format_names[config->format],
+          hash, golden);
+}
+
+/******************************************************************************/
+/* check_run_carts()                                                          */
+/******************************************************************************/
+static int check_run_carts( check_config* config, char* cart_filename, 
+                            char** filenames, int num_filenames)
+{
+  int k;
+  int num_failed;
+
+  char* filename;
+
+  unsigned long hash;
+  unsigned long golden;
+  unsigned long loaded;
+
+  if (check_cart_build(cart_filename, config->format, &hash))
+  {
+    fprintf(stdout, "Check: failed to write %s\n", cart_filename);
+    return 1;
+  }
+
+  num_failed = 0;
+
+  if (config->format == VDP_FORMAT_RGB555)
+    golden = CHECK_CART_GOLDEN;
+  else
+    golden = CHECK_CART_GOLDEN_15;
+
+  if (hash != golden)
+  {
+    check_report("cart", config, hash, golden);
+    num_failed += 1;
+  }
+
+  /* the cart just written (mapped, then read), and the others given, */
+  /* must all be drawn the same as the scene they were written from   */
+  for (k = 0; k < num_filenames + 2; k++)
+  {
+    filename = (k < 2) ? cart_filename : filenames[k - 2];
+
+    rom_allow_mapping(k != 1);
+
+    if (check_cart_load(filename, config->format, &loaded))
+    {
+      fprintf(stdout, "Check: failed to load %s\n", filename);
+      num_failed += 1;
+    }
+    else if (loaded != hash)
+    {
+      check_report(filename, config, loaded, hash);
+      num_failed += 1;
+    }
+  }
+
+  rom_allow_mapping(1);
+
+  return num_failed;
+}
+
+/******************************************************************************/
+/* check_run()                                                                */
+/******************************************************************************/
+int check_run(char* cart_filename, char** filenames, int num_filenames)
+{
+  int k;
+  int n;
+
+  int num_failed;
+  int num_configs;
+
+  Uint64 start;
+
+  unsigned long hash;
+  unsigned long golden;
+
+  check_config* config;
+
+  start = SDL_GetPerformanceCounter();
+
+  /* name the edited cart after the cart scene's */
+  S_check_edit_filename = malloc(strlen(cart_filename) + 
+                                 strlen(CHECK_EDIT_SUFFIX) + 1);
+
+  if (S_check_edit_filename == NULL)
+    return 1;
+
+  strcpy(S_check_edit_filename, cart_filename);
+  strcat(S_check_edit_filename, CHECK_EDIT_SUFFIX);
+
+  num_failed = 0;
+  num_configs = 0;
+
+  for (k = 0; k < CHECK_NUM_CONFIGS; k++)
+  {
+    config = &S_check_configs[k];
+
+    /* skip the blitters this cpu does not support */
+    if (blit_set_mode(config->blit_mode))
+    {
+      fprintf(stdout, "Check: %s blitter not supported, skipped\n",
+              blit_mode_name(config->blit_mode));
+      continue;
+    }
+
+    if (pool_init(config->num_threads))
+    {
+      num_failed += 1;
+      break;
+    }
+
+    cell_set_cache_limit(config->cell_cache_limit);
+    pcache_set_limit(config->pcache_limit);
+
+    vdp_set_generic_sprites(config->generic_sprites);
+    vdp_set_format(config->format);
+
+    for (n = 0; n < CHECK_NUM_SCENES; n++)
+    {
+      hash = check_run_scene(&S_check_scenes[n], n, config->format);
+
+      if (config->format == VDP_FORMAT_RGB555)
+        golden = S_check_scenes[n].golden;
+      else
+        golden = S_check_scenes[n].golden_15;
+
+      if (hash != golden)
+      {
+        check_report(S_check_scenes[n].name, config, hash, golden);
+        num_failed += 1;
+      }
+    }
+
+    num_failed += check_run_carts(config, cart_filename, 
+                                  filenames, num_filenames);
+
+    num_configs += 1;
+  }
+
+  /* leave the vdp empty (the cart scene is kept, but not the edit) */
+  vdp_reset();
+  vdp_set_line_limit(VDP_LINE_LIMIT_DEFAULT);
+  vdp_set_generic_sprites(0);
+  vdp_set_format(VDP_FORMAT_RGB555);
+
+  remove(S_check_edit_filename);
+
+  free(S_check_edit_filename);
+  S_check_edit_filename = NULL;
+
+  fprintf(stdout, "Check: %d scenes x %d frames, %d carts x %d frames, "
+                  "%d configurations, %d failed (%.3f ms)\n",
+          CHECK_NUM_SCENES, CHECK_NUM_FRAMES, 
+          num_filenames + 2, 2 * CHECK_CART_FRAMES, 
+          num_configs, num_failed,
+          (SDL_GetPerformanceCounter() - start) * 1000.0 /
+          SDL_GetPerformanceFrequency());
+
+  return (num_failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+/******************************************************************************/
+/* check.h (renderer self-check)                                              */
+/******************************************************************************/
+
+#ifndef CHECK_H
+#define CHECK_H
+
+/* each scene is a synthetic cart built directly into the vdp buffers, */
+/* drawn for a fixed number of frames (changing a little each frame,   */
+/* without forcing full redraws), and the frame hashes are combined &  */
+/* compared with a known good value. every scene is drawn with each of */
+/* the renderer configurations, which must all match.                  */
+#define CHECK_NUM_FRAMES  24
+
+/* the background scene is also written out as a raw cart, loaded back  */
+/* through the cart loader (mapped & read) and hot reloaded, and must   */
+/* be drawn the same as when it was built. other carts holding it (the  */
+/* same cart packed or paged with knpack) can be given to be checked as */
+/* well. the cart is left behind for that, under this name by default.  */
+#define CHECK_CART_FILENAME "check.kn1"
+#define CHECK_MAX_CARTS     8
+
+/* function declarations (the vdp is reset & the renderer settings are */
+/* changed, so a cart must be loaded again afterwards)                  */
+int check_run(char* cart_filename, char** filenames, int num_filenames);
+
+#endif
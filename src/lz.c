@@ -0,0 +1,272 @@
+/******************************************************************************/
+/* lz.c (lz77 block compression)                                              */
+/******************************************************************************/
+
+/* each block is a series of sequences, each one a token byte (literal    */
+/* count in the high nibble, match length - 4 in the low nibble), any     */
+/* extra literal count bytes, the literals, a 16 bit little endian match  */
+/* offset, and any extra match length bytes (a nibble of 15 is followed   */
+/* by bytes that are added to it, until one is less than 255). the last   */
+/* sequence of a block has literals only.                                 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+
+#define LZ_MIN_MATCH    4
+#define LZ_CHUNK        16
+#define LZ_MAX_OFFSET   0xFFFF
+
+#define LZ_HASH_BITS    12
+#define LZ_HASH_SIZE    (1 << LZ_HASH_BITS)
+
+#define LZ_HASH(buf)                                                           \
+  (((((unsigned long) buf[0])       |                                          \
+     ((unsigned long) buf[1] << 8)  |                                          \
+     ((unsigned long) buf[2] << 16) |                                          \
+     ((unsigned long) buf[3] << 24)) * 2654435761UL >> (32 - LZ_HASH_BITS))    \
+     & (LZ_HASH_SIZE - 1))
+
+/******************************************************************************/
+/* lz_write_count()                                                           */
+/******************************************************************************/
+static unsigned char* lz_write_count(unsigned char* dst, unsigned long count)
+{
+  /* write the part of a count that did not fit in its nibble */
+  while (count >= 255)
+  {
+    *dst++ = 255;
+    count -= 255;
+  }
+
+  *dst++ = (unsigned char) count;
+
+  return dst;
+}
+
+/******************************************************************************/
+/* lz_write_sequence()                                                        */
+/******************************************************************************/
+static unsigned char* lz_write_sequence(unsigned char* dst,
+                                        unsigned char* literals,
+                                        unsigned long num_literals,
+                                        unsigned long offset,
+                                        unsigned long match_len)
+{
+  unsigned char* token;
+
+  token = dst++;
+
+  /* literals */
+  if (num_literals >= 15)
+  {
+    *token = 15 << 4;
+    dst = lz_write_count(dst, num_literals - 15);
+  }
+  else
+    *token = (unsigned char) (num_literals << 4);
+
+  memcpy(dst, literals, num_literals);
+  dst += num_literals;
+
+  /* match (none for the last sequence) */
+  if (match_len == 0)
+    return dst;
+
+  *dst++ = offset & 0xFF;
+  *dst++ = (offset >> 8) & 0xFF;
+
+  match_len -= LZ_MIN_MATCH;
+
+  if (match_len >= 15)
+  {
+    *token |= 15;
+    dst = lz_write_count(dst, match_len - 15);
+  }
+  else
+    *token |= (unsigned char) match_len;
+
+  return dst;
+}
+
+/******************************************************************************/
+/* lz_encode_block()                                                          */
+/******************************************************************************/
+unsigned long lz_encode_block(unsigned char* dst,
+                              unsigned char* src, unsigned long src_size)
+{
+  unsigned long table[LZ_HASH_SIZE];
+
+  unsigned long pos;
+  unsigned long anchor;
+  unsigned long candidate;
+  unsigned long match_len;
+  unsigned long hash;
+
+  unsigned char* out;
+
+  /* dst must hold LZ_BLOCK_BOUND(src_size) bytes */
+  if (src_size > LZ_BLOCK_SIZE)
+    return 0;
+
+  /* the table holds the position + 1 of the last 4 bytes with each hash */
+  memset(table, 0, sizeof(table));
+
+  out = dst;
+
+  pos = 0;
+  anchor = 0;
+
+  /* greedy parse, taking the most recent match for each hash */
+  while (pos + LZ_MIN_MATCH <= src_size)
+  {
+    hash = LZ_HASH((src + pos));
+
+    candidate = table[hash];
+    table[hash] = pos + 1;
+
+    if ((candidate == 0) ||
+        (pos - (candidate - 1) > LZ_MAX_OFFSET) ||
+        memcmp(src + candidate - 1, src + pos, LZ_MIN_MATCH))
+    {
+      pos += 1;
+      continue;
+    }
+
+    candidate -= 1;
+
+    match_len = LZ_MIN_MATCH;
+
+    while ((pos + match_len < src_size) &&
+           (src[candidate + match_len] == src[pos + match_len]))
+    {
+      match_len += 1;
+    }
+
+    out = lz_write_sequence(out, src + anchor, pos - anchor,
+                            pos - candidate, match_len);
+
+    pos += match_len;
+    anchor = pos;
+  }
+
+  /* the remaining bytes are literals */
+  out = lz_write_sequence(out, src + anchor, src_size - anchor, 0, 0);
+
+  return out - dst;
+}
+
+/******************************************************************************/
+/* lz_decode_block()                                                          */
+/******************************************************************************/
+int lz_decode_block(unsigned char* dst, unsigned long dst_size,
+                    unsigned char* src, unsigned long src_size)
+{
+  unsigned long d;
+  unsigned long s;
+  unsigned long k;
+
+  unsigned long count;
+  unsigned long offset;
+
+  unsigned char token;
+  unsigned char extra;
+
+  d = 0;
+  s = 0;
+
+  /* every count & offset is checked, so corrupt data cannot overrun */
+  while (s < src_size)
+  {
+    token = src[s++];
+
+    /* literals */
+    count = (token >> 4) & 0x0F;
+
+    if (count == 15)
+    {
+      do
+      {
+        if (s >= src_size)
+          return 1;
+
+        extra = src[s++];
+        count += extra;
+      } while (extra == 255);
+    }
+
+    /* short runs are copied in one fixed size chunk when there is room */
+    if ((count < LZ_CHUNK) && 
+        (src_size - s >= LZ_CHUNK) && (dst_size - d >= LZ_CHUNK))
+    {
+      memcpy(dst + d, src + s, LZ_CHUNK);
+    }
+    else
+    {
+      if ((count > src_size - s) || (count > dst_size - d))
+        return 1;
+
+      memcpy(dst + d, src + s, count);
+    }
+
+    d += count;
+    s += count;
+
+    /* the last sequence ends after its literals */
+    if (s == src_size)
+      break;
+
+    /* match */
+    if (s + 2 > src_size)
+      return 1;
+
+    offset = src[s] | (src[s + 1] << 8);
+    s += 2;
+
+    count = (token & 0x0F) + LZ_MIN_MATCH;
+
+    if ((token & 0x0F) == 15)
+    {
+      do
+      {
+        if (s >= src_size)
+          return 1;
+
+        extra = src[s++];
+        count += extra;
+      } while (extra == 255);
+    }
+
+    if ((offset == 0) || (offset > d) || (count > dst_size - d))
+      return 1;
+
+    /* copy in 8 byte steps when they cannot overlap (and there is room */
+    /* for the last one to overrun), in one go if the match does not    */
+    /* overlap itself, and a byte at a time otherwise                   */
+    if ((offset >= 8) && (dst_size - d >= count + 8))
+    {
+      for (k = 0; k < count; k += 8)
+        memcpy(dst + d + k, dst + d - offset + k, 8);
+    }
+    else if (offset >= count)
+      memcpy(dst + d, dst + d - offset, count);
+    else
+    {
+      while (count > 0)
+      {
+        dst[d] = dst[d - offset];
+        d += 1;
+        count -= 1;
+      }
+    }
+
+    d += count;
+  }
+
+  if (d != dst_size)
+    return 1;
+
+  return 0;
+}
@@ -0,0 +1,21 @@
+/******************************************************************************/
+/* lz.h (lz77 block compression)                                              */
+/******************************************************************************/
+
+#ifndef LZ_H
+#define LZ_H
+
+/* data is compressed in independent blocks of at most this many bytes */
+#define LZ_BLOCK_SIZE   (1 << 16)
+
+/* largest compressed size of a block (incompressible data) */
+#define LZ_BLOCK_BOUND(n) ((n) + (n) / 255 + 16)
+
+/* function declarations */
+unsigned long lz_encode_block(unsigned char* dst,
+                              unsigned char* src, unsigned long src_size);
+
+int lz_decode_block(unsigned char* dst, unsigned long dst_size,
+                    unsigned char* src, unsigned long src_size);
+
+#endif
@@ -5,31 +5,210 @@
 #include <SDL2/SDL.h>
 
 #include <stdio.h>
-
+#include <stdlib.h>
+#include <string.h>
+
+#include "anim.h"
+#include "bank.h"
+#include "bench.h"
+#include "blit.h"
+#include "capture.h"
+#include "cell.h"
+#include "check.h"
+#include "pacer.h"
+#include "pcache.h"
+#include "pool.h"
+#include "prof.h"
+#include "render.h"
 #include "rom.h"
+#include "state.h"
 #include "vdp.h"
 #include "video.h"
+#include "watch.h"
 
 /*******************************************************************************
 ** main()
 *******************************************************************************/
 int main(int argc, char *argv[])
 {
+  int       k;
+
+  int       num_threads;
+  int       num_bench_frames;
+  int       num_bench_loads;
+  int       headless;
+  int       blit_mode;
+  int       frame_rate;
+  int       vsync;
+  int       pipelined;
+  int       num_steps;
+  int       run_check;
+  int       num_check_carts;
+  int       watch_cart;
+  int       result;
+
+  long      sprite_cache_kb;
+
+  int       toggle_overlay;
+  int       rewinding;
+
+  char*     rom_filename;
+  char*     capture_filename;
+  char*     check_cart_filename;
+  char*     check_carts[CHECK_MAX_CARTS];
+
+  Uint64    start_time;
+  Uint64    load_start;
+  Uint64    reload_start;
+
   SDL_Event event;
-  Uint32    ticks_last_update;
-  Uint32    ticks_current;
 
-  /* initialize sdl */
-  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0)
+  unsigned short* fb;
+
+  unsigned long num_drawn;
+  unsigned long num_visited;
+  unsigned long num_culled;
+  unsigned long num_dropped;
+  unsigned long num_unpaged;
+  unsigned long num_resident;
+
+  unsigned long last_culled;
+  unsigned long last_dropped;
+  unsigned long last_unpaged;
+
+  /* note the start time (for the time to first frame) */
+  start_time = SDL_GetPerformanceCounter();
+
+  /* parse command line */
+  num_threads = 0;
+  num_bench_frames = 0;
+  num_bench_loads = 0;
+  blit_mode = BLIT_MODE_AUTO;
+  frame_rate = PACER_RATE_DEFAULT;
+  vsync = 0;
+  pipelined = 0;
+  sprite_cache_kb = -1;
+  run_check = 0;
+  num_check_carts = 0;
+  watch_cart = 0;
+  result = 0;
+
+  rom_filename = "test.kn1";
+  capture_filename = NULL;
+  check_cart_filename = CHECK_CART_FILENAME;
+
+  for (k = 1; k < argc; k++)
+  {
+    /* number of render worker threads */
+    if ((!strcmp(argv[k], "-t")) && (k + 1 < argc))
+      num_threads = atoi(argv[++k]);
+
+    /* decoded cell cache limit (in KB, 0 to disable) */
+    else if ((!strcmp(argv[k], "-c")) && (k + 1 < argc))
+      cell_set_cache_limit(1024 * strtoul(argv[++k], NULL, 10));
+
+    /* palette-resolved sprite cache limit (in KB, 0 to disable) */
+    else if ((!strcmp(argv[k], "-s")) && (k + 1 < argc))
+      sprite_cache_kb = atol(argv[++k]);
+
+    /* rewind buffer limit (in KB, 0 to disable) */
+    else if ((!strcmp(argv[k], "-z")) && (k + 1 < argc))
+      state_set_rewind_limit(1024 * strtoul(argv[++k], NULL, 10));
+
+    /* page cache limit for paged carts (in KB) */
+    else if ((!strcmp(argv[k], "-g")) && (k + 1 < argc))
+      bank_set_cache_limit(1024 * strtoul(argv[++k], NULL, 10));
+
+    /* sprites drawn per line (the rest of a line's sprites are dropped) */
+    else if ((!strcmp(argv[k], "-n")) && (k + 1 < argc))
+    {
+      if (vdp_set_line_limit(atoi(argv[++k])))
+        fprintf(stdout, "Invalid sprite line limit, ignored.\n");
+    }
+
+    /* headless benchmark (number of frames to render) */
+    else if ((!strcmp(argv[k], "-b")) && (k + 1 < argc))
+      num_bench_frames = atoi(argv[++k]);
+
+    /* headless load benchmark (number of times to load the cart) */
+    else if ((!strcmp(argv[k], "-l")) && (k + 1 < argc))
+      num_bench_loads = atoi(argv[++k]);
+
+    /* headless renderer self-check (against known good frame hashes) */
+    else if (!strcmp(argv[k], "-k"))
+      run_check = 1;
+
+    /* where the self-check writes its cart (any cart files given are */
+    /* then checked against it)                                       */
+    else if ((!strcmp(argv[k], "-x")) && (k + 1 < argc))
+      check_cart_filename = argv[++k];
+
+    /* blitter mode (auto, scalar, ssse3, avx2) */
+    else if ((!strcmp(argv[k], "-m")) && (k + 1 < argc))
+    {
+      k += 1;
+
+      for (blit_mode = 0; blit_mode < BLIT_NUM_MODES; blit_mode++)
+      {
+        if (!strcmp(argv[k], blit_mode_name(blit_mode)))
+          break;
+      }
+    }
+
+    /* frame rate (frames per second) */
+    else if ((!strcmp(argv[k], "-r")) && (k + 1 < argc))
+      frame_rate = atoi(argv[++k]);
+
+    /* pace frames with vsync */
+    else if (!strcmp(argv[k], "-v"))
+      vsync = 1;
+
+    /* render on a separate thread from present */
+    else if (!strcmp(argv[k], "-p"))
+      pipelined = 1;
+
+    /* capture the displayed frames to a file (y4m or raw rgb24) */
+    else if ((!strcmp(argv[k], "-w")) && (k + 1 < argc))
+      capture_filename = argv[++k];
+
+    /* reload the cart whenever its file changes (patching only what */
+    /* changed, so the cells are read rather than mapped)            */
+    else if (!strcmp(argv[k], "-e"))
+    {
+      watch_cart = 1;
+      rom_allow_mapping(0);
+    }
+
+    /* show the frame timing overlay (if the timers are compiled in) */
+    else if (!strcmp(argv[k], "-o"))
+      G_prof_overlay = 1;
+
+    /* cart file */
+    else if (argv[k][0] != '-')
+    {
+      rom_filename = argv[k];
+
+      if (num_check_carts < CHECK_MAX_CARTS)
+        check_carts[num_check_carts++] = argv[k];
+    }
+  }
+
+  /* run headless when benchmarking or checking */
+  headless = ((num_bench_frames > 0) || (num_bench_loads > 0) || run_check);
+
+  /* initialize sdl (video is not needed when running headless) */
+  if (SDL_Init(headless ? 
+                SDL_INIT_TIMER : (SDL_INIT_VIDEO | SDL_INIT_TIMER)) != 0)
   {
     fprintf(stdout, "Failed to initialize SDL: %s\n", SDL_GetError());
-    return 0;
+    return 1;
   }
 
   /* initialize video */
-  if (video_init())
+  if ((headless == 0) && video_init(vsync))
   {
     fprintf(stdout, "Failed to initialize video. Exiting...\n");
+    result = 1;
     goto cleanup_sdl;
   }
 
@@ -45,24 +224,146 @@ int main(int argc, char *argv[])
   /* initialize graphics chip */
   vdp_reset();
 
+  /* select the blitters (the fastest for this cpu by default) */
+  if (blit_set_mode(blit_mode))
+  {
+    fprintf(stdout, "Blitter not supported. Exiting...\n");
+    result = 1;
+    goto cleanup_all;
+  }
+
+  fprintf(stdout, "Blitter: %s\n", blit_mode_name(G_blit_mode));
+
+  /* the simd blitters resolve palettes in registers, so by default the */
+  /* palette-resolved sprite cache is only used with the scalar ones    */
+  if (sprite_cache_kb < 0)
+  {
+    sprite_cache_kb = 
+      (G_blit_mode == BLIT_MODE_SCALAR) ? (PCACHE_LIMIT_DEFAULT / 1024) : 0;
+  }
+
+  pcache_set_limit(1024 * (unsigned long) sprite_cache_kb);
+
+  /* start the render workers */
+  if (pool_init(num_threads))
+  {
+    fprintf(stdout, "Failed to start render workers. Exiting...\n");
+    result = 1;
+    goto cleanup_all;
+  }
+
   /* increase window size to 720p as test */
-  video_increase_window_size();
-  video_increase_window_size();
+  if (headless == 0)
+  {
+    video_increase_window_size();
+    video_increase_window_size();
+  }
 
-  /* load test cart file */
-  if (rom_load("test.kn1"))
+  /* run the self-check instead of loading a cart (it builds its own) */
+  if (run_check)
   {
-    fprintf(stdout, "Failed to load test cart data. Exiting...\n");
+    result = check_run(check_cart_filename, check_carts, num_check_carts);
     goto cleanup_all;
   }
 
-  /* initialize ticks */
-  ticks_current = SDL_GetTicks();
-  ticks_last_update = ticks_current;
+  /* load cart file */
+  load_start = SDL_GetPerformanceCounter();
+
+  if (rom_load(rom_filename))
+  {
+    fprintf(stdout, "Failed to load cart data. Exiting...\n");
+    result = 1;
+    goto cleanup_all;
+  }
+
+  fprintf(stdout, "Cart loaded in %.3f ms (%s%s)\n", 
+          (SDL_GetPerformanceCounter() - load_start) * 1000.0 / 
+          SDL_GetPerformanceFrequency(), 
+          G_rom_mapped ? "mapped" : "read", 
+          G_rom_packed ? ", packed" : "");
+
+  /* (the rewind buffer is for the previous cart's states) */
+  state_reset();
+
+  fprintf(stdout, "Cell cache: %lu cells, %lu KB\n", 
+          G_cell_num_cached, cell_cache_bytes() / 1024);
+
+  if (G_bank_active)
+  {
+    fprintf(stdout, "Cell bank: %lu KB, paged in %d KB pages\n", 
+            G_vdp_bank_num_bytes / 1024, BANK_PAGE_SIZE / 1024);
+  }
+
+  fprintf(stdout, "Startup in %.3f ms\n", 
+          (SDL_GetPerformanceCounter() - start_time) * 1000.0 / 
+          SDL_GetPerformanceFrequency());
+
+  /* run the benchmarks instead of the main loop when headless */
+  if (headless)
+  {
+    /* (failures & mismatches exit with a nonzero status) */
+    if ((num_bench_loads > 0) && bench_load(rom_filename, num_bench_loads))
+    {
+      fprintf(stdout, "Failed to reload cart data.\n");
+      result = 1;
+    }
+
+    if ((num_bench_frames > 0) && bench_run(num_bench_frames))
+      result = 1;
+
+    goto cleanup_all;
+  }
+
+  /* initialize sprite statistics */
+  last_culled = 0;
+  last_dropped = 0;
+  last_unpaged = 0;
+
+  /* start the render thread */
+  if ((pipelined != 0) && render_start())
+  {
+    fprintf(stdout, "Failed to start render thread. Exiting...\n");
+    result = 1;
+    goto cleanup_all;
+  }
+
+  /* initialize frame pacing */
+  if (pacer_init(frame_rate, vsync))
+  {
+    fprintf(stdout, "Invalid frame rate. Exiting...\n");
+    result = 1;
+    goto cleanup_all;
+  }
+
+  /* start capturing */
+  if ((capture_filename != NULL) && 
+      capture_start(capture_filename, frame_rate))
+  {
+    fprintf(stdout, "Failed to start capture. Exiting...\n");
+    result = 1;
+    goto cleanup_all;
+  }
+
+  /* watch the cart file */
+  if ((watch_cart != 0) && watch_start(rom_filename))
+    fprintf(stdout, "Failed to watch cart file.\n");
+
+  /* initialize frame timing & rewind */
+  toggle_overlay = 0;
+  rewinding = 0;
+
+  prof_reset();
 
   /* main loop */
   while (1)
   {
+    /* wait for the next frame */
+    PROF_BEGIN(PROF_STAGE_WAIT);
+
+    num_steps = pacer_wait();
+
+    PROF_END(PROF_STAGE_WAIT);
+
     /* process sdl events */
     while (SDL_PollEvent(&event))
     {
@@ -96,11 +397,58 @@ int main(int argc, char *argv[])
         {
           G_program_flags &= ~PROGRAM_FLAG_WINDOW_MINIMIZED;
           audio_unpause();
-          ticks_last_update = SDL_GetTicks();
+          pacer_reset();
         }
 #endif
       }
 
+#ifdef PROF_ENABLE
+      /* toggle the timing overlay */
+      if ((event.type == SDL_KEYDOWN) && 
+          (event.key.keysym.scancode == SDL_SCANCODE_F3) && 
+          (event.key.repeat == 0))
+      {
+        toggle_overlay = 1;
+      }
+#endif
+
+      /* save / load the state (f5 / f8) */
+      if ((event.type == SDL_KEYDOWN) && (event.key.repeat == 0))
+      {
+        if (event.key.keysym.scancode == SDL_SCANCODE_F5)
+        {
+          render_wait();
+
+          if (state_save(STATE_FILENAME_DEFAULT))
+            fprintf(stdout, "Failed to save state.\n");
+          else
+          {
+            fprintf(stdout, "State saved in %.3f ms\n", 
+                    G_state_save_ns / 1000000.0);
+          }
+        }
+
+        if (event.key.keysym.scancode == SDL_SCANCODE_F8)
+        {
+          render_wait();
+
+          if (state_load(STATE_FILENAME_DEFAULT))
+            fprintf(stdout, "Failed to load state.\n");
+          else
+          {
+            fprintf(stdout, "State loaded in %.3f ms\n", 
+                    G_state_load_ns / 1000000.0);
+          }
+        }
+      }
+
+      /* rewind while backspace is held */
+      if ((event.type == SDL_KEYDOWN) || (event.type == SDL_KEYUP))
+      {
+        if (event.key.keysym.scancode == SDL_SCANCODE_BACKSPACE)
+          rewinding = (event.type == SDL_KEYDOWN) ? 1 : 0;
+      }
+
 #if 0
       /* keyboard (key down) */
       if (event.type == SDL_KEYDOWN)
@@ -152,52 +500,184 @@ int main(int argc, char *argv[])
       continue;
 #endif
 
-    /* update ticks */
-    ticks_current = SDL_GetTicks();
+    /* make sure the render thread is done reading vdp state */
+    render_wait();
 
-    /* check for tick wraparound (~49 days) */
-    if (ticks_current < ticks_last_update)
-      ticks_last_update = 0;
+    /* close out the timing of the previous frame */
+    PROF_END_FRAME();
 
-    /* check if a new frame has elapsed */
-    if ((ticks_current - ticks_last_update) >= (1000 / 60))
+    /* reload the cart if its file has changed */
+    if (watch_poll())
     {
+      reload_start = SDL_GetPerformanceCounter();
+
+      if (rom_reload(rom_filename))
+        fprintf(stdout, "Failed to reload cart data.\n");
+      else
+      {
+        fprintf(stdout, "Cart reloaded in %.3f ms "
+                        "(%lu words, %lu KB changed)\n", 
+                (SDL_GetPerformanceCounter() - reload_start) * 1000.0 / 
+                SDL_GetPerformanceFrequency(), 
+                G_rom_num_changed_words, 
+                (G_rom_num_changed_bytes + 1023) / 1024);
+      }
+
+      /* (the rewind buffer is for the previous cart's states) */
+      state_reset();
+    }
+
+    /* (the overlay is a texture of its own, so the frame is unchanged) */
+    if (toggle_overlay != 0)
+    {
+      G_prof_overlay ^= 1;
+
+      toggle_overlay = 0;
+    }
+
 #if 0
-      /* advance frame */
+    /* advance frames (more than one if we have fallen behind) */
+    for (k = 0; k < num_steps; k++)
+    {
       loop_advance_frame();
 
       /* generate samples for this frame */
-      frame_generate(ticks_current - ticks_last_update);
+      frame_generate(1000 / frame_rate);
 
       /* send samples to audio output */
       audio_queue_frame();
+    }
 
-      /* quit */
-      if (G_program_flags & PROGRAM_FLAG_QUIT)
+    /* quit */
+    if (G_program_flags & PROGRAM_FLAG_QUIT)
+    {
+      goto cleanup_all;
+    }
+#else
+    /* advance sprite animations (more than once if we have fallen */
+    /* behind), keeping each step's state, or step back through them */
+    for (k = 0; k < num_steps; k++)
+    {
+      if (rewinding)
+        state_pop();
+      else
       {
-        goto cleanup_all;
+        anim_tick();
+        state_push();
       }
+    }
 #endif
 
-      /* update window */
+    /* copy the sprite & page counts (the render thread updates */
+    /* them once it is started on the next frame)                */
+    num_drawn = G_vdp_num_sprites_drawn;
+    num_visited = G_vdp_num_sprites_visited;
+    num_culled = G_vdp_num_sprites_culled;
+    num_dropped = G_vdp_num_sprites_dropped;
+    num_unpaged = G_vdp_num_sprites_unpaged;
+    num_resident = G_bank_num_resident;
+
+    /* update window (when pipelined, the render thread draws the */
+    /* next frame while the latest completed one is presented)     */
+    if (G_render_active)
+    {
+      render_begin();
+      fb = render_acquire_frame();
+
+      video_display_buffer(fb);
+      capture_frame(fb);
+    }
+    else if (G_capture_active)
+    {
+      /* (frames are drawn to the framebuffer, so they can be copied) */
       vdp_draw_frame();
       video_display_frame();
 
-      /* store this update time */
-      ticks_last_update = ticks_current;
+      capture_frame(G_vdp_fb_rgb);
+    }
+    else
+      video_render_frame();
+
+    /* report the time to first frame */
+    if (start_time != 0)
+    {
+      fprintf(stdout, "First frame in %.3f ms\n", 
+              (SDL_GetPerformanceCounter() - start_time) * 1000.0 / 
+              SDL_GetPerformanceFrequency());
+
+      start_time = 0;
+    }
+
+    /* report culled / dropped sprites when the counts change */
+    if ((num_culled != last_culled) || (num_dropped != last_dropped))
+    {
+      fprintf(stdout, "Sprites: %lu drawn, %lu visited, %lu culled, "
+                      "%lu dropped\n", 
+              num_drawn, num_visited, num_culled, num_dropped);
+
+      last_culled = num_culled;
+      last_dropped = num_dropped;
+    }
+
+    /* report sprites skipped for want of pages (the page cache is */
+    /* too small for the frame) when the count changes             */
+    if (num_unpaged != last_unpaged)
+    {
+      fprintf(stdout, "Pages: %lu sprites unpaged (cache holds %lu pages)\n", 
+              num_unpaged, num_resident);
+
+      last_unpaged = num_unpaged;
     }
   }
 
   /* cleanup window and quit */
 cleanup_all:
+  render_stop();
+  capture_stop();
+  watch_stop();
+
+  if ((headless == 0) && (G_pacer_num_frames > 0))
+  {
+    fprintf(stdout, "Pacing: %lu frames, %lu skipped, jitter mean %lu us, max %lu us\n", 
+            G_pacer_num_frames, G_pacer_num_skipped, 
+            G_pacer_jitter_mean_us, G_pacer_jitter_max_us);
+  }
+
+  if ((headless == 0) && (G_state_num_pushed > 0))
+  {
+    fprintf(stdout, "Rewind: %lu snapshots in %lu KB, push mean %.1f us, "
+                    "max %.1f us, pop mean %.1f us, max %.1f us\n", 
+            G_state_num_snapshots, G_state_rewind_bytes / 1024, 
+            G_state_push_ns_total / 1000.0 / G_state_num_pushed, 
+            G_state_push_ns_max / 1000.0, 
+            (G_state_num_popped > 0) ? 
+              (G_state_pop_ns_total / 1000.0 / G_state_num_popped) : 0.0, 
+            G_state_pop_ns_max / 1000.0);
+  }
+
+#ifdef PROF_ENABLE
+  /* summarize & save the frame timing */
+  if (headless == 0)
+  {
+    prof_print_summary();
+
+    if (prof_dump_csv(PROF_CSV_FILENAME_DEFAULT))
+      fprintf(stdout, "Failed to write %s\n", PROF_CSV_FILENAME_DEFAULT);
+  }
+#endif
+
+  pool_deinit();
+  state_reset();
+  rom_unload();
 #if 0
   audio_deinit();
 #endif
 cleanup_video:
-  video_deinit();
+  if (headless == 0)
+    video_deinit();
 cleanup_sdl:
   SDL_Quit();
 
-  return 0;
+  return result;
 }
 
@@ -0,0 +1,142 @@
+/******************************************************************************/
+/* pacer.c (frame pacing)                                                     */
+/******************************************************************************/
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pacer.h"
+
+static int    S_pacer_rate = PACER_RATE_DEFAULT;
+static int    S_pacer_vsync = 0;
+
+/* frame deadlines are computed from the start time and the number */
+/* of frames advanced, so that rounding error never accumulates    */
+static Uint64 S_pacer_freq;
+static Uint64 S_pacer_start;
+static Uint64 S_pacer_spin;
+static Uint64 S_pacer_num_steps;
+
+static Uint64 S_pacer_last_time;
+static Uint64 S_pacer_jitter_total;
+
+/* statistics */
+unsigned long G_pacer_num_frames;
+unsigned long G_pacer_num_skipped;
+
+unsigned long G_pacer_jitter_mean_us;
+unsigned long G_pacer_jitter_max_us;
+
+/******************************************************************************/
+/* pacer_init()                                                               */
+/******************************************************************************/
+int pacer_init(int rate, int vsync)
+{
+  if (rate <= 0)
+    return 1;
+
+  S_pacer_rate = rate;
+  S_pacer_vsync = vsync;
+
+  S_pacer_freq = SDL_GetPerformanceFrequency();
+  S_pacer_spin = (S_pacer_freq * PACER_SPIN_US) / 1000000;
+
+  G_pacer_num_frames = 0;
+  G_pacer_num_skipped = 0;
+
+  G_pacer_jitter_mean_us = 0;
+  G_pacer_jitter_max_us = 0;
+
+  S_pacer_jitter_total = 0;
+
+  pacer_reset();
+
+  return 0;
+}
+
+/******************************************************************************/
+/* pacer_reset()                                                              */
+/******************************************************************************/
+int pacer_reset()
+{
+  /* restart the schedule from now (i.e., after a pause) */
+  S_pacer_start = SDL_GetPerformanceCounter();
+  S_pacer_num_steps = 0;
+
+  S_pacer_last_time = S_pacer_start;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* pacer_wait()                                                               */
+/******************************************************************************/
+int pacer_wait()
+{
+  int steps;
+
+  Uint64 now;
+  Uint64 deadline;
+  Uint64 interval;
+  Uint64 period;
+  Uint64 jitter;
+
+  now = SDL_GetPerformanceCounter();
+
+  /* sleep until just before the next deadline, then spin the rest */
+  /* of the way (with vsync, presenting the frame does the waiting) */
+  if (S_pacer_vsync == 0)
+  {
+    /* (rounded up, so the step is always due once we get there) */
+    deadline = S_pacer_start + 
+               ((S_pacer_num_steps + 1) * S_pacer_freq + S_pacer_rate - 1) / 
+               S_pacer_rate;
+
+    while (now < deadline)
+    {
+      if (deadline - now > S_pacer_spin)
+        SDL_Delay((Uint32) (((deadline - now - S_pacer_spin) * 1000) / S_pacer_freq));
+
+      now = SDL_GetPerformanceCounter();
+    }
+  }
+
+  /* determine how many fixed steps are due */
+  steps = (int) (((now - S_pacer_start) * S_pacer_rate) / S_pacer_freq - 
+                 S_pacer_num_steps);
+
+  if (steps > PACER_MAX_STEPS)
+  {
+    G_pacer_num_skipped += steps - 1;
+
+    S_pacer_num_steps += steps - 1;
+    steps = 1;
+  }
+
+  S_pacer_num_steps += steps;
+
+  /* update jitter statistics */
+  interval = now - S_pacer_last_time;
+  period = S_pacer_freq / S_pacer_rate;
+
+  jitter = (interval > period) ? interval - period : period - interval;
+  jitter = (jitter * 1000000) / S_pacer_freq;
+
+  S_pacer_last_time = now;
+
+  G_pacer_num_frames += 1;
+
+  if (G_pacer_num_frames > 1)
+  {
+    S_pacer_jitter_total += jitter;
+
+    G_pacer_jitter_mean_us = S_pacer_jitter_total / (G_pacer_num_frames - 1);
+
+    if (jitter > G_pacer_jitter_max_us)
+      G_pacer_jitter_max_us = jitter;
+  }
+
+  return steps;
+}
@@ -0,0 +1,30 @@
+/******************************************************************************/
+/* pacer.h (frame pacing)                                                     */
+/******************************************************************************/
+
+#ifndef PACER_H
+#define PACER_H
+
+#define PACER_RATE_DEFAULT  60
+
+/* time before each deadline spent spinning rather than sleeping */
+#define PACER_SPIN_US       1000
+
+/* most frames advanced in one step before the pacer resyncs */
+#define PACER_MAX_STEPS     4
+
+/* pacing statistics (jitter is the difference between each */
+/* frame interval and the ideal frame period)               */
+extern unsigned long G_pacer_num_frames;
+extern unsigned long G_pacer_num_skipped;
+
+extern unsigned long G_pacer_jitter_mean_us;
+extern unsigned long G_pacer_jitter_max_us;
+
+/* function declarations */
+int pacer_init(int rate, int vsync);
+int pacer_reset();
+
+int pacer_wait();
+
+#endif
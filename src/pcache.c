@@ -0,0 +1,389 @@
+/******************************************************************************/
+/* pcache.c (palette-resolved sprite cache)                                   */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pcache.h"
+
+#include "bank.h"
+#include "vdp.h"
+
+#define PCACHE_BYTES_PER_CELL                                                  \
+  (VDP_PIXELS_PER_CELL * sizeof(unsigned short) + VDP_CELL_W_H)
+
+#define PCACHE_HASH(cell_addr, num_columns, num_rows, pal_addr)                \
+  (((((cell_addr) / VDP_BYTES_PER_CELL) * 2654435761UL) ^                      \
+    ((pal_addr) * 40503UL) ^ ((num_columns) << 2) ^ (num_rows))                \
+    & (PCACHE_HASH_SIZE - 1))
+
+/* statistics */
+unsigned long G_pcache_num_hits;
+unsigned long G_pcache_num_misses;
+unsigned long G_pcache_num_entries;
+unsigned long G_pcache_num_bytes;
+
+static unsigned long S_pcache_limit = PCACHE_LIMIT_DEFAULT;
+
+/* entries (slots past num_slots have never been used) */
+static pcache_entry  S_pcache_entries[PCACHE_MAX_ENTRIES];
+static int           S_pcache_num_slots;
+
+static int           S_pcache_free[PCACHE_MAX_ENTRIES];
+static int           S_pcache_num_free;
+
+static int           S_pcache_hash[PCACHE_HASH_SIZE];
+
+static int           S_pcache_hand;
+
+/* palette versions (bumped whenever a palette changes) */
+static unsigned long S_pcache_pal_version[VDP_MAX_PALS];
+
+static unsigned long S_pcache_frame;
+
+/******************************************************************************/
+/* pcache_set_limit()                                                         */
+/******************************************************************************/
+int pcache_set_limit(unsigned long num_bytes)
+{
+  S_pcache_limit = num_bytes;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* pcache_remove()                                                            */
+/******************************************************************************/
+static void pcache_remove(int index)
+{
+  int* link;
+
+  pcache_entry* e;
+
+  e = &S_pcache_entries[index];
+
+  /* unlink it from its hash chain */
+  link = &S_pcache_hash[PCACHE_HASH( e->cell_addr, 
+                                      e->num_columns, e->num_rows, 
+                                      e->pal_addr)];
+
+  while (*link != index)
+    link = &S_pcache_entries[*link].next;
+
+  *link = e->next;
+
+  /* release its pixels (the masks share the allocation) */
+  free(e->pixels);
+
+  e->pixels = NULL;
+  e->masks = NULL;
+
+  G_pcache_num_bytes -= e->num_columns * e->num_rows * PCACHE_BYTES_PER_CELL;
+  G_pcache_num_entries -= 1;
+
+  S_pcache_free[S_pcache_num_free++] = index;
+}
+
+/******************************************************************************/
+/* pcache_clear()                                                             */
+/******************************************************************************/
+int pcache_clear()
+{
+  int k;
+
+  for (k = 0; k < S_pcache_num_slots; k++)
+  {
+    if (S_pcache_entries[k].pixels != NULL)
+    {
+      free(S_pcache_entries[k].pixels);
+
+      S_pcache_entries[k].pixels = NULL;
+      S_pcache_entries[k].masks = NULL;
+    }
+  }
+
+  for (k = 0; k < PCACHE_HASH_SIZE; k++)
+    S_pcache_hash[k] = -1;
+
+  S_pcache_num_slots = 0;
+  S_pcache_num_free = 0;
+  S_pcache_hand = 0;
+
+  G_pcache_num_hits = 0;
+  G_pcache_num_misses = 0;
+  G_pcache_num_entries = 0;
+  G_pcache_num_bytes = 0;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* pcache_begin_frame()                                                       */
+/******************************************************************************/
+int pcache_begin_frame()
+{
+  /* unpin the entries used by the previous frame */
+  S_pcache_frame += 1;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* pcache_evict()                                                             */
+/******************************************************************************/
+static int pcache_evict()
+{
+  int k;
+
+  pcache_entry* e;
+
+  /* skip entries pinned this frame, and give the ones used since */
+  /* the hand last passed another chance                          */
+  for (k = 0; k < 2 * S_pcache_num_slots; k++)
+  {
+    e = &S_pcache_entries[S_pcache_hand];
+
+    S_pcache_hand = (S_pcache_hand + 1) % S_pcache_num_slots;
+
+    if ((e->pixels == NULL) || (e->frame == S_pcache_frame))
+      continue;
+
+    if (e->referenced != 0)
+    {
+      e->referenced = 0;
+      continue;
+    }
+
+    pcache_remove(e - S_pcache_entries);
+
+    return 0;
+  }
+
+  return 1;
+}
+
+/******************************************************************************/
+/* pcache_resolve()                                                           */
+/******************************************************************************/
+static void pcache_resolve(pcache_entry* e)
+{
+  int m;
+  int n;
+  int row;
+  int width;
+
+  unsigned long cell_index;
+
+  unsigned short  pal_offset;
+
+  unsigned short* pal;
+  unsigned short* pixels;
+  unsigned char*  masks;
+  unsigned char*  src;
+
+  pal = &G_vdp_pals_native[e->pal_addr];
+
+  width = VDP_CELL_W_H * e->num_columns;
+
+  /* resolve each line of each cell */
+  for (m = 0; m < e->num_columns * e->num_rows; m++)
+  {
+    cell_index = e->cell_addr / VDP_BYTES_PER_CELL + m;
+
+    for (row = 0; row < VDP_CELL_W_H; row++)
+    {
+      pixels = &e->pixels[width * (VDP_CELL_W_H * (m / e->num_columns) + row) + 
+                          VDP_CELL_W_H * (m % e->num_columns)];
+      masks = &e->masks[e->num_columns * 
+                        (VDP_CELL_W_H * (m / e->num_columns) + row) + 
+                        (m % e->num_columns)];
+
+      src = G_bank_active ? 
+            BANK_PTR(VDP_BYTES_PER_CELL * cell_index) : 
+            &G_vdp_bank_buf[VDP_BYTES_PER_CELL * cell_index];
+      src += (VDP_CELL_W_H / 2) * row;
+
+      *masks = 0;
+
+      for (n = 0; n < VDP_CELL_W_H; n++)
+      {
+        if (n % 2 == 0)
+          pal_offset = (src[n / 2] >> 4) & 0x0F;
+        else
+          pal_offset = src[n / 2] & 0x0F;
+
+        if (pal_offset != 0)
+        {
+          pixels[n] = pal[pal_offset];
+          *masks |= 1 << n;
+        }
+        else
+          pixels[n] = 0;
+      }
+    }
+  }
+
+  e->pal_version = S_pcache_pal_version[e->pal_addr / VDP_COLORS_PER_PAL];
+}
+
+/******************************************************************************/
+/* pcache_find()                                                              */
+/******************************************************************************/
+pcache_entry* pcache_find(pcache_entry* hint, 
+                          unsigned long cell_addr, 
+                          int num_columns, int num_rows, 
+                          unsigned short pal_addr)
+{
+  int index;
+  int hash;
+
+  unsigned long num_bytes;
+
+  unsigned char* buf;
+
+  pcache_entry* e;
+
+  if (S_pcache_limit == 0)
+    return NULL;
+
+  /* try the entry this sprite used last frame, then the hash table */
+  hash = PCACHE_HASH(cell_addr, num_columns, num_rows, pal_addr);
+
+  e = hint;
+
+  if ((e == NULL)                       || 
+      (e->pixels == NULL)               || 
+      (e->cell_addr != cell_addr)       || 
+      (e->num_columns != num_columns)   || 
+      (e->num_rows != num_rows)         || 
+      (e->pal_addr != pal_addr))
+  {
+    for (index = S_pcache_hash[hash]; index >= 0; index = e->next)
+    {
+      e = &S_pcache_entries[index];
+
+      if ((e->cell_addr == cell_addr)       && 
+          (e->num_columns == num_columns)   && 
+          (e->num_rows == num_rows)         && 
+          (e->pal_addr == pal_addr))
+      {
+        break;
+      }
+    }
+
+    if (index < 0)
+      e = NULL;
+  }
+
+  /* hit (resolved again if its palette has changed since) */
+  if (e != NULL)
+  {
+    if (e->pal_version != 
+        S_pcache_pal_version[pal_addr / VDP_COLORS_PER_PAL])
+    {
+      pcache_resolve(e);
+      G_pcache_num_misses += 1;
+    }
+    else
+      G_pcache_num_hits += 1;
+
+    e->frame = S_pcache_frame;
+    e->referenced = 1;
+
+    return e;
+  }
+
+  /* miss: make room for a new entry */
+  G_pcache_num_misses += 1;
+
+  num_bytes = num_columns * num_rows * PCACHE_BYTES_PER_CELL;
+
+  if (num_bytes > S_pcache_limit)
+    return NULL;
+
+  while ((G_pcache_num_bytes + num_bytes > S_pcache_limit) || 
+         ((S_pcache_num_free == 0) && 
+          (S_pcache_num_slots == PCACHE_MAX_ENTRIES)))
+  {
+    if (pcache_evict())
+      return NULL;
+  }
+
+  buf = malloc(num_bytes);
+
+  if (buf == NULL)
+    return NULL;
+
+  if (S_pcache_num_free > 0)
+    index = S_pcache_free[--S_pcache_num_free];
+  else
+    index = S_pcache_num_slots++;
+
+  e = &S_pcache_entries[index];
+
+  e->cell_addr = cell_addr;
+  e->pal_addr = pal_addr;
+  e->num_columns = (short) num_columns;
+  e->num_rows = (short) num_rows;
+
+  e->pixels = (unsigned short*) buf;
+  e->masks = buf + num_columns * num_rows * 
+                   VDP_PIXELS_PER_CELL * sizeof(unsigned short);
+
+  e->frame = S_pcache_frame;
+  e->referenced = 1;
+
+  e->next = S_pcache_hash[hash];
+  S_pcache_hash[hash] = index;
+
+  G_pcache_num_bytes += num_bytes;
+  G_pcache_num_entries += 1;
+
+  pcache_resolve(e);
+
+  return e;
+}
+
+/******************************************************************************/
+/* pcache_invalidate_pal()                                                    */
+/******************************************************************************/
+int pcache_invalidate_pal(int pal)
+{
+  if ((pal < 0) || (pal >= VDP_MAX_PALS))
+    return 1;
+
+  /* entries using it are resolved again when next used */
+  S_pcache_pal_version[pal] += 1;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* pcache_invalidate_cells()                                                  */
+/******************************************************************************/
+int pcache_invalidate_cells(unsigned long addr, unsigned long num_bytes)
+{
+  int k;
+
+  pcache_entry* e;
+
+  /* drop the entries that use any of these cells */
+  for (k = 0; k < S_pcache_num_slots; k++)
+  {
+    e = &S_pcache_entries[k];
+
+    if (e->pixels == NULL)
+      continue;
+
+    if ((e->cell_addr < addr + num_bytes) && 
+        (e->cell_addr + e->num_columns * e->num_rows * VDP_BYTES_PER_CELL > 
+         addr))
+    {
+      pcache_remove(k);
+    }
+  }
+
+  return 0;
+}
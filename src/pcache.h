@@ -0,0 +1,57 @@
+/******************************************************************************/
+/* pcache.h (palette-resolved sprite cache)                                   */
+/******************************************************************************/
+
+#ifndef PCACHE_H
+#define PCACHE_H
+
+/* each entry holds a whole sprite (columns x rows cells) resolved through */
+/* its palette to rgb555, a line at a time, with one opacity mask byte per */
+/* cell per line (bit n is set if pixel n is not transparent). entries are */
+/* keyed on cell address, size & palette, and replaced approximately least */
+/* recently used first (by a clock hand) once the cache limit is reached.  */
+/* the entries used by a frame are pinned until the next one begins.       */
+#define PCACHE_MAX_ENTRIES        (1 << 13)
+#define PCACHE_HASH_SIZE          (1 << 12)
+
+#define PCACHE_LIMIT_DEFAULT      (1 << 23) /* 8 MB */
+
+typedef struct
+{
+  unsigned long   cell_addr;
+  unsigned short  pal_addr;
+  short           num_columns;
+  short           num_rows;
+
+  unsigned short* pixels;
+  unsigned char*  masks;
+
+  /* palette version it was resolved with, & when it was last used */
+  unsigned long   pal_version;
+  unsigned long   frame;
+  int             referenced;
+
+  int             next;
+} pcache_entry;
+
+/* statistics (hits & misses are counted since the cache was cleared) */
+extern unsigned long G_pcache_num_hits;
+extern unsigned long G_pcache_num_misses;
+extern unsigned long G_pcache_num_entries;
+extern unsigned long G_pcache_num_bytes;
+
+/* function declarations */
+int pcache_set_limit(unsigned long num_bytes);
+
+int pcache_clear();
+int pcache_begin_frame();
+
+pcache_entry* pcache_find(pcache_entry* hint, 
+                          unsigned long cell_addr, 
+                          int num_columns, int num_rows, 
+                          unsigned short pal_addr);
+
+int pcache_invalidate_pal(int pal);
+int pcache_invalidate_cells(unsigned long addr, unsigned long num_bytes);
+
+#endif
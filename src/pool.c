@@ -0,0 +1,169 @@
+/******************************************************************************/
+/* pool.c (worker thread pool)                                                */
+/******************************************************************************/
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+/* worker threads (these persist until the pool is shut down) */
+static SDL_Thread*    S_pool_threads[POOL_MAX_THREADS];
+
+int                   G_pool_num_threads = 0;
+
+/* current batch of jobs */
+static pool_job_func  S_pool_job;
+static int            S_pool_num_jobs;
+
+static SDL_atomic_t   S_pool_next_job;
+static SDL_atomic_t   S_pool_quit;
+
+/* signals to start a batch, and to report that a worker is done */
+static SDL_sem*       S_pool_start_sem = NULL;
+static SDL_sem*       S_pool_done_sem = NULL;
+
+/******************************************************************************/
+/* pool_run_jobs()                                                            */
+/******************************************************************************/
+static void pool_run_jobs()
+{
+  int index;
+
+  /* claim jobs until the batch is used up */
+  while ((index = SDL_AtomicAdd(&S_pool_next_job, 1)) < S_pool_num_jobs)
+    S_pool_job(index);
+}
+
+/******************************************************************************/
+/* pool_worker()                                                              */
+/******************************************************************************/
+static int pool_worker(void* data)
+{
+  (void) data;
+
+  while (1)
+  {
+    SDL_SemWait(S_pool_start_sem);
+
+    if (SDL_AtomicGet(&S_pool_quit))
+      break;
+
+    pool_run_jobs();
+
+    SDL_SemPost(S_pool_done_sem);
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* pool_init()                                                                */
+/******************************************************************************/
+int pool_init(int num_threads)
+{
+  int k;
+
+  pool_deinit();
+
+  if (num_threads <= 0)
+    return 0;
+
+  if (num_threads > POOL_MAX_THREADS)
+    num_threads = POOL_MAX_THREADS;
+
+  /* create semaphores */
+  S_pool_start_sem = SDL_CreateSemaphore(0);
+  S_pool_done_sem = SDL_CreateSemaphore(0);
+
+  if ((S_pool_start_sem == NULL) || (S_pool_done_sem == NULL))
+  {
+    pool_deinit();
+    return 1;
+  }
+
+  SDL_AtomicSet(&S_pool_quit, 0);
+
+  /* start the workers */
+  for (k = 0; k < num_threads; k++)
+  {
+    S_pool_threads[k] = SDL_CreateThread(pool_worker, "pool", NULL);
+
+    if (S_pool_threads[k] == NULL)
+    {
+      pool_deinit();
+      return 1;
+    }
+
+    G_pool_num_threads = k + 1;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* pool_deinit()                                                              */
+/******************************************************************************/
+int pool_deinit()
+{
+  int k;
+
+  /* stop the workers */
+  SDL_AtomicSet(&S_pool_quit, 1);
+
+  for (k = 0; k < G_pool_num_threads; k++)
+    SDL_SemPost(S_pool_start_sem);
+
+  for (k = 0; k < G_pool_num_threads; k++)
+  {
+    SDL_WaitThread(S_pool_threads[k], NULL);
+    S_pool_threads[k] = NULL;
+  }
+
+  G_pool_num_threads = 0;
+
+  /* destroy semaphores */
+  if (S_pool_start_sem != NULL)
+  {
+    SDL_DestroySemaphore(S_pool_start_sem);
+    S_pool_start_sem = NULL;
+  }
+
+  if (S_pool_done_sem != NULL)
+  {
+    SDL_DestroySemaphore(S_pool_done_sem);
+    S_pool_done_sem = NULL;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* pool_run()                                                                 */
+/******************************************************************************/
+int pool_run(pool_job_func job, int num_jobs)
+{
+  int k;
+
+  if (job == NULL)
+    return 1;
+
+  S_pool_job = job;
+  S_pool_num_jobs = num_jobs;
+
+  SDL_AtomicSet(&S_pool_next_job, 0);
+
+  /* wake the workers, and have this thread help out */
+  for (k = 0; k < G_pool_num_threads; k++)
+    SDL_SemPost(S_pool_start_sem);
+
+  pool_run_jobs();
+
+  /* wait for the batch to finish */
+  for (k = 0; k < G_pool_num_threads; k++)
+    SDL_SemWait(S_pool_done_sem);
+
+  return 0;
+}
@@ -0,0 +1,21 @@
+/******************************************************************************/
+/* pool.h (worker thread pool)                                                */
+/******************************************************************************/
+
+#ifndef POOL_H
+#define POOL_H
+
+#define POOL_MAX_THREADS 64
+
+/* a job is called once per index, from any thread */
+typedef void (*pool_job_func)(int index);
+
+extern int G_pool_num_threads;
+
+/* function declarations */
+int pool_init(int num_threads);
+int pool_deinit();
+
+int pool_run(pool_job_func job, int num_jobs);
+
+#endif
@@ -0,0 +1,342 @@
+/******************************************************************************/
+/* prof.c (frame timing)                                                      */
+/******************************************************************************/
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prof.h"
+
+#include "vdp.h"
+
+#define PROF_BAR_X        34
+#define PROF_BAR_US       100 /* microseconds per pixel */
+
+int           G_prof_overlay = 0;
+
+/* ring of per frame stage totals (in performance counter ticks) */
+static Uint64 S_prof_ring[PROF_RING_SIZE][PROF_NUM_STAGES];
+static int    S_prof_ring_head;
+static int    S_prof_ring_count;
+
+/* the frame in progress */
+static Uint64 S_prof_start[PROF_NUM_STAGES];
+static Uint64 S_prof_pending[PROF_NUM_STAGES];
+static Uint64 S_prof_frame_start;
+
+static char*  S_prof_stage_names[PROF_NUM_STAGES] = 
+  { "prepare", "draw", "upload", "clear", "copy", "present", "wait", "frame" };
+
+static unsigned short S_prof_stage_colors[PROF_NUM_STAGES] = 
+  { 0x7FE0, 0x03E0, 0x03FF, 0x001F, 0x7C1F, 0x7C00, 0x2108, 0x5294 };
+
+/* 3x5 digits (3 bits per row, top row in the high bits) */
+static unsigned short S_prof_digits[10] = 
+  { 0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9, 
+    0x79CF, 0x79EF, 0x7249, 0x7BEF, 0x7BCF };
+
+/******************************************************************************/
+/* prof_reset()                                                               */
+/******************************************************************************/
+int prof_reset()
+{
+  memset(S_prof_pending, 0, sizeof(S_prof_pending));
+
+  S_prof_ring_head = 0;
+  S_prof_ring_count = 0;
+
+  S_prof_frame_start = SDL_GetPerformanceCounter();
+
+  return 0;
+}
+
+/******************************************************************************/
+/* prof_begin()                                                               */
+/******************************************************************************/
+int prof_begin(int stage)
+{
+  S_prof_start[stage] = SDL_GetPerformanceCounter();
+
+  return 0;
+}
+
+/******************************************************************************/
+/* prof_end()                                                                 */
+/******************************************************************************/
+int prof_end(int stage)
+{
+  S_prof_pending[stage] += SDL_GetPerformanceCounter() - S_prof_start[stage];
+
+  return 0;
+}
+
+/******************************************************************************/
+/* prof_end_frame()                                                           */
+/******************************************************************************/
+int prof_end_frame()
+{
+  Uint64 now;
+
+  /* the frame stage is the whole interval since the last frame ended */
+  now = SDL_GetPerformanceCounter();
+
+  if (S_prof_frame_start == 0)
+    S_prof_frame_start = now;
+
+  S_prof_pending[PROF_STAGE_FRAME] = now - S_prof_frame_start;
+  S_prof_frame_start = now;
+
+  /* move the totals into the ring */
+  memcpy(S_prof_ring[S_prof_ring_head], S_prof_pending, sizeof(S_prof_pending));
+  memset(S_prof_pending, 0, sizeof(S_prof_pending));
+
+  S_prof_ring_head = (S_prof_ring_head + 1) % PROF_RING_SIZE;
+
+  if (S_prof_ring_count < PROF_RING_SIZE)
+    S_prof_ring_count += 1;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* prof_compare_times()                                                       */
+/******************************************************************************/
+static int prof_compare_times(const void* a, const void* b)
+{
+  if (*((Uint64*) a) < *((Uint64*) b))
+    return -1;
+  else if (*((Uint64*) a) > *((Uint64*) b))
+    return 1;
+  else
+    return 0;
+}
+
+/******************************************************************************/
+/* prof_summarize()                                                           */
+/******************************************************************************/
+int prof_summarize(int stage, double* min_us, double* mean_us, double* p99_us)
+{
+  int k;
+
+  double  scale;
+  Uint64  total;
+
+  Uint64  times[PROF_RING_SIZE];
+
+  if ((stage < 0) || (stage >= PROF_NUM_STAGES) || (S_prof_ring_count == 0))
+    return 1;
+
+  /* summarize the frames in the ring (the order does not matter) */
+  total = 0;
+
+  for (k = 0; k < S_prof_ring_count; k++)
+  {
+    times[k] = S_prof_ring[k][stage];
+    total += times[k];
+  }
+
+  qsort(times, S_prof_ring_count, sizeof(Uint64), prof_compare_times);
+
+  scale = 1000000.0 / SDL_GetPerformanceFrequency();
+
+  *min_us = times[0] * scale;
+  *mean_us = (total * scale) / S_prof_ring_count;
+  *p99_us = times[(S_prof_ring_count * 99) / 100] * scale;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* prof_print_summary()                                                       */
+/******************************************************************************/
+int prof_print_summary()
+{
+  int k;
+
+  double min_us;
+  double mean_us;
+  double p99_us;
+
+  if (S_prof_ring_count == 0)
+    return 1;
+
+  fprintf(stdout, "Timing over the last %d frames (us):\n", S_prof_ring_count);
+
+  for (k = 0; k < PROF_NUM_STAGES; k++)
+  {
+    prof_summarize(k, &min_us, &mean_us, &p99_us);
+
+    fprintf(stdout, "  %-8s min %8.1f  mean %8.1f  p99 %8.1f\n", 
+            S_prof_stage_names[k], min_us, mean_us, p99_us);
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* prof_dump_csv()                                                            */
+/******************************************************************************/
+int prof_dump_csv(char* filename)
+{
+  FILE* fp;
+
+  int k;
+  int m;
+  int index;
+
+  double scale;
+
+  if (filename == NULL)
+    return 1;
+
+  fp = fopen(filename, "w");
+
+  if (fp == NULL)
+    return 1;
+
+  scale = 1000000.0 / SDL_GetPerformanceFrequency();
+
+  /* header, then one line per frame (oldest first) in microseconds */
+  fprintf(fp, "frame");
+
+  for (m = 0; m < PROF_NUM_STAGES; m++)
+    fprintf(fp, ",%s_us", S_prof_stage_names[m]);
+
+  fprintf(fp, "\n");
+
+  for (k = 0; k < S_prof_ring_count; k++)
+  {
+    index = S_prof_ring_head - S_prof_ring_count + k;
+
+    if (index < 0)
+      index += PROF_RING_SIZE;
+
+    fprintf(fp, "%d", k);
+
+    for (m = 0; m < PROF_NUM_STAGES; m++)
+      fprintf(fp, ",%.1f", S_prof_ring[index][m] * scale);
+
+    fprintf(fp, "\n");
+  }
+
+  fclose(fp);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* prof_draw_number()                                                         */
+/******************************************************************************/
+static void prof_draw_number(unsigned short* buf, int pitch, 
+                             int x, int y, unsigned long val)
+{
+  int k;
+  int row;
+  int col;
+  int digit;
+
+  /* 5 digits, right aligned */
+  for (k = 4; k >= 0; k--)
+  {
+    digit = val % 10;
+    val /= 10;
+
+    for (row = 0; row < 5; row++)
+    {
+      for (col = 0; col < 3; col++)
+      {
+        if (S_prof_digits[digit] & (1 << (14 - 3 * row - col)))
+          buf[pitch * (y + row) + x + 4 * k + col] = 0x7FFF;
+      }
+    }
+
+    if (val == 0)
+      break;
+  }
+}
+
+/******************************************************************************/
+/* prof_draw_overlay()                                                        */
+/******************************************************************************/
+int prof_draw_overlay(unsigned short* buf, int pitch)
+{
+  int k;
+  int m;
+  int n;
+  int y;
+  int index;
+  int num_frames;
+
+  int mean_w;
+  int max_w;
+
+  double scale;
+
+  Uint64 total;
+  Uint64 max;
+
+  /* darken the area behind the overlay */
+  for (n = 0; n < PROF_OVERLAY_H; n++)
+  {
+    for (m = 0; m < VDP_SCREEN_W; m++)
+      buf[pitch * n + m] = (buf[pitch * n + m] >> 2) & 0x1CE7;
+  }
+
+  num_frames = S_prof_ring_count;
+
+  if (num_frames > PROF_OVERLAY_FRAMES)
+    num_frames = PROF_OVERLAY_FRAMES;
+
+  if (num_frames == 0)
+    return 0;
+
+  scale = 1000000.0 / SDL_GetPerformanceFrequency();
+
+  /* one row per stage: its color, mean (us), and a bar from 0 to the */
+  /* mean with a tick at the max                                      */
+  for (k = 0; k < PROF_NUM_STAGES; k++)
+  {
+    total = 0;
+    max = 0;
+
+    for (m = 0; m < num_frames; m++)
+    {
+      index = (S_prof_ring_head - 1 - m + PROF_RING_SIZE) % PROF_RING_SIZE;
+
+      total += S_prof_ring[index][k];
+
+      if (S_prof_ring[index][k] > max)
+        max = S_prof_ring[index][k];
+    }
+
+    y = 1 + PROF_OVERLAY_ROW_H * k;
+
+    mean_w = (int) ((total * scale) / num_frames / PROF_BAR_US);
+    max_w = (int) ((max * scale) / PROF_BAR_US);
+
+    if (mean_w > VDP_SCREEN_W - PROF_BAR_X - 1)
+      mean_w = VDP_SCREEN_W - PROF_BAR_X - 1;
+
+    if (max_w > VDP_SCREEN_W - PROF_BAR_X - 1)
+      max_w = VDP_SCREEN_W - PROF_BAR_X - 1;
+
+    for (n = 0; n < 5; n++)
+    {
+      for (m = 0; m < 5; m++)
+        buf[pitch * (y + n) + 2 + m] = S_prof_stage_colors[k];
+
+      for (m = 0; m < mean_w; m++)
+        buf[pitch * (y + n) + PROF_BAR_X + m] = S_prof_stage_colors[k];
+
+      buf[pitch * (y + n) + PROF_BAR_X + max_w] = 0x7FFF;
+    }
+
+    prof_draw_number(buf, pitch, 10, y, 
+                     (unsigned long) ((total * scale) / num_frames));
+  }
+
+  return 0;
+}
@@ -0,0 +1,61 @@
+/******************************************************************************/
+/* prof.h (frame timing)                                                      */
+/******************************************************************************/
+
+#ifndef PROF_H
+#define PROF_H
+
+/* uncomment (or build with -DPROF_ENABLE) to compile in the frame  */
+/* timers. otherwise the timing macros expand to nothing.           */
+/* #define PROF_ENABLE */
+
+enum
+{
+  PROF_STAGE_PREPARE = 0, 
+  PROF_STAGE_DRAW, 
+  PROF_STAGE_UPLOAD, 
+  PROF_STAGE_CLEAR, 
+  PROF_STAGE_COPY, 
+  PROF_STAGE_PRESENT, 
+  PROF_STAGE_WAIT, 
+  PROF_STAGE_FRAME, 
+  PROF_NUM_STAGES 
+};
+
+/* the time spent in each stage is added up over a frame, and each */
+/* frame's totals are kept in a ring of the most recent frames     */
+#define PROF_RING_SIZE      1024
+
+/* the overlay shows the mean & max of each stage over recent frames */
+#define PROF_OVERLAY_FRAMES 60
+#define PROF_OVERLAY_ROW_H  7
+#define PROF_OVERLAY_H      (PROF_OVERLAY_ROW_H * PROF_NUM_STAGES + 2)
+
+#define PROF_CSV_FILENAME_DEFAULT "timing.csv"
+
+#ifdef PROF_ENABLE
+#define PROF_BEGIN(stage)   prof_begin(stage)
+#define PROF_END(stage)     prof_end(stage)
+#define PROF_END_FRAME()    prof_end_frame()
+#else
+#define PROF_BEGIN(stage)
+#define PROF_END(stage)
+#define PROF_END_FRAME()
+#endif
+
+extern int G_prof_overlay;
+
+/* function declarations */
+int prof_reset();
+
+int prof_begin(int stage);
+int prof_end(int stage);
+int prof_end_frame();
+
+int prof_summarize(int stage, double* min_us, double* mean_us, double* p99_us);
+int prof_print_summary();
+int prof_dump_csv(char* filename);
+
+int prof_draw_overlay(unsigned short* buf, int pitch);
+
+#endif
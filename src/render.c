@@ -0,0 +1,190 @@
+/******************************************************************************/
+/* render.c (render thread)                                                   */
+/******************************************************************************/
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "render.h"
+
+#include "vdp.h"
+
+/* the vdp draws frames on the render thread while the main thread  */
+/* presents the most recently completed one. the three framebuffers */
+/* are handed off by swapping indices through one atomic "ready"    */
+/* slot, so neither thread ever waits on the other for a buffer.    */
+#define RENDER_READY_NEW    0x04
+#define RENDER_READY_INDEX  0x03
+
+static unsigned short S_render_buffers[RENDER_NUM_BUFFERS][VDP_SCREEN_SIZE];
+
+static int            S_render_back;    /* owned by the render thread */
+static int            S_render_front;   /* owned by the main thread   */
+static SDL_atomic_t   S_render_ready;   /* shared                     */
+
+static SDL_Thread*    S_render_thread = NULL;
+
+static SDL_sem*       S_render_request_sem = NULL;
+static SDL_sem*       S_render_done_sem = NULL;
+
+static SDL_atomic_t   S_render_quit;
+
+static int            S_render_pending;
+
+int                   G_render_active = 0;
+
+/******************************************************************************/
+/* render_thread()                                                            */
+/******************************************************************************/
+static int render_thread(void* data)
+{
+  (void) data;
+
+  while (1)
+  {
+    SDL_SemWait(S_render_request_sem);
+
+    if (SDL_AtomicGet(&S_render_quit))
+      break;
+
+    /* draw into the back buffer */
+    G_vdp_fb_rgb = S_render_buffers[S_render_back];
+
+    vdp_draw_frame();
+
+    /* publish it, taking whatever was in the ready slot as the new back */
+    S_render_back = SDL_AtomicSet(&S_render_ready, 
+                                  S_render_back | RENDER_READY_NEW);
+    S_render_back &= RENDER_READY_INDEX;
+
+    SDL_SemPost(S_render_done_sem);
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* render_start()                                                             */
+/******************************************************************************/
+int render_start()
+{
+  render_stop();
+
+  memset(S_render_buffers, 0, sizeof(S_render_buffers));
+
+  S_render_back = 0;
+  S_render_front = 2;
+
+  SDL_AtomicSet(&S_render_ready, 1);
+  SDL_AtomicSet(&S_render_quit, 0);
+
+  S_render_pending = 0;
+
+  /* create semaphores */
+  S_render_request_sem = SDL_CreateSemaphore(0);
+  S_render_done_sem = SDL_CreateSemaphore(0);
+
+  if ((S_render_request_sem == NULL) || (S_render_done_sem == NULL))
+  {
+    render_stop();
+    return 1;
+  }
+
+  /* start the thread */
+  S_render_thread = SDL_CreateThread(render_thread, "render", NULL);
+
+  if (S_render_thread == NULL)
+  {
+    render_stop();
+    return 1;
+  }
+
+  G_render_active = 1;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* render_stop()                                                              */
+/******************************************************************************/
+int render_stop()
+{
+  /* stop the thread */
+  if (S_render_thread != NULL)
+  {
+    render_wait();
+
+    SDL_AtomicSet(&S_render_quit, 1);
+    SDL_SemPost(S_render_request_sem);
+
+    SDL_WaitThread(S_render_thread, NULL);
+    S_render_thread = NULL;
+  }
+
+  /* destroy semaphores */
+  if (S_render_request_sem != NULL)
+  {
+    SDL_DestroySemaphore(S_render_request_sem);
+    S_render_request_sem = NULL;
+  }
+
+  if (S_render_done_sem != NULL)
+  {
+    SDL_DestroySemaphore(S_render_done_sem);
+    S_render_done_sem = NULL;
+  }
+
+  /* leave the vdp drawing into the last presented frame */
+  if (G_render_active)
+    G_vdp_fb_rgb = S_render_buffers[S_render_front];
+
+  G_render_active = 0;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* render_wait()                                                              */
+/******************************************************************************/
+int render_wait()
+{
+  /* wait until the frame in progress is done reading vdp state */
+  if (S_render_pending)
+  {
+    SDL_SemWait(S_render_done_sem);
+    S_render_pending = 0;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* render_begin()                                                             */
+/******************************************************************************/
+int render_begin()
+{
+  render_wait();
+
+  S_render_pending = 1;
+  SDL_SemPost(S_render_request_sem);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* render_acquire_frame()                                                     */
+/******************************************************************************/
+unsigned short* render_acquire_frame()
+{
+  /* swap in the newest completed frame (if there is one) */
+  if (SDL_AtomicGet(&S_render_ready) & RENDER_READY_NEW)
+  {
+    S_render_front = SDL_AtomicSet(&S_render_ready, S_render_front);
+    S_render_front &= RENDER_READY_INDEX;
+  }
+
+  return S_render_buffers[S_render_front];
+}
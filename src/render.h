@@ -0,0 +1,21 @@
+/******************************************************************************/
+/* render.h (render thread)                                                   */
+/******************************************************************************/
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#define RENDER_NUM_BUFFERS 3
+
+extern int G_render_active;
+
+/* function declarations */
+int render_start();
+int render_stop();
+
+int render_wait();
+int render_begin();
+
+unsigned short* render_acquire_frame();
+
+#endif
@@ -2,12 +2,27 @@
 /* rom.c (faux game cartridge)                                                */
 /******************************************************************************/
 
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#define ROM_MMAP
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef ROM_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "rom.h"
 
+#include "bank.h"
+#include "cell.h"
+#include "lz.h"
 #include "vdp.h"
 
 /* big endian read / write macros */
@@ -38,103 +53,1076 @@
 #define ROM_MAGIC_IS_NOT(c_1, c_2, c_3, c_4)                                   \
   (!(ROM_MAGIC_IS(c_1, c_2, c_3, c_4)))
 
+/* header size (KUNO / ICHI / CART, or KUNO / ICHI / PACK + version) */
+#define ROM_HEADER_SIZE 12
+
+#define ROM_PACK_VERSION 2 /* version 2 adds paged cells */
+
+/* section storage methods (packed carts only) */
+enum
+{
+  ROM_METHOD_RAW = 0, 
+  ROM_METHOD_LZ, 
+  ROM_METHOD_PAGED, 
+  ROM_NUM_METHODS 
+};
+
+/* paged cells: the section count is the number of pages, and the method */
+/* is followed by the bank size (32 bit) and a directory entry per page  */
+/* (32 bit file offset, 24 bit stored size, 8 bit method, raw or lz)     */
+#define ROM_DIR_HEADER_SIZE 4
+#define ROM_DIR_ENTRY_SIZE  8
+
+/* bytes at the start of the file that are hashed to identify the cart */
+/* (the header & the start of the nametable), with 64 bit fnv-1a       */
+#define ROM_ID_SIZE         1024
+
+#define ROM_FNV_OFFSET      0xCBF29CE484222325UL
+#define ROM_FNV_PRIME       0x00000100000001B3UL
+
+/* when reloading, runs of changed cells closer than this are patched */
+/* (and invalidated) as one                                            */
+#define ROM_RELOAD_GAP      4096
+
+static unsigned long  S_rom_page_offset[BANK_MAX_PAGES];
+static unsigned long  S_rom_page_size[BANK_MAX_PAGES];
+static unsigned char  S_rom_page_method[BANK_MAX_PAGES];
+
+/* cart file (kept open while its pages are read on demand) */
+static FILE*          S_rom_fp = NULL;
+
+/* compressed block buffer (when reading the file) */
+static unsigned char S_rom_block_buf[LZ_BLOCK_BOUND(LZ_BLOCK_SIZE)];
+
+/* destination of each section when reading a cart file (the vdp */
+/* buffers when loading, or scratch buffers when reloading)       */
+typedef struct
+{
+  unsigned short* nametable_buf;
+  unsigned long   nametable_num_words;
+
+  unsigned short* pals_buf;
+  unsigned long   pals_num_words;
+
+  unsigned char*  bank_buf;
+  unsigned long   bank_num_bytes;
+
+  unsigned short* tilemap_buf;
+  unsigned long   tilemap_num_words;
+} rom_sections;
+
+/* scratch buffers for a reload (the bank is allocated on first use) */
+static unsigned short S_rom_next_nametable[VDP_NAMETABLE_SIZE];
+static unsigned short S_rom_next_pals[VDP_PALS_SIZE];
+static unsigned short S_rom_next_tilemap[VDP_TILEMAP_SIZE];
+
+static unsigned char* S_rom_next_bank = NULL;
+
+static int            S_rom_allow_mapping = 1;
+
+/* mapped cart file (the cell bank points into this mapping) */
+#ifdef ROM_MMAP
+static unsigned char* S_rom_map = NULL;
+static unsigned long  S_rom_map_size = 0;
+#endif
+
+int G_rom_mapped = 0;
+int G_rom_packed = 0;
+
+unsigned long G_rom_file_size = 0;
+unsigned long G_rom_file_hash = 0;
+
+unsigned long G_rom_num_changed_words = 0;
+unsigned long G_rom_num_changed_bytes = 0;
+
 /******************************************************************************/
-/* rom_load()                                                                 */
+/* rom_swap_words()                                                           */
 /******************************************************************************/
-int rom_load(char* filename)
+static int rom_swap_words(unsigned short* dst,
+                          unsigned char* src,
+                          unsigned long num_words)
 {
   unsigned long k;
 
-  FILE* fp;
+  unsigned short val;
+
+  /* convert a block of big endian words (src may equal dst) */
+  for (k = 0; k < num_words; k++)
+  {
+    ROM_READ_16BE(val, (src + 2 * k))
 
-  char magic[4];
+    dst[k] = val;
+  }
 
-  unsigned char buf[4];
+  return 0;
+}
 
-  /* make sure filename is valid */
-  if (filename == NULL)
+/******************************************************************************/
+/* rom_check_header()                                                         */
+/******************************************************************************/
+static int rom_check_header(char* magic)
+{
+  if (ROM_MAGIC_IS_NOT('K', 'U', 'N', 'O'))
     return 1;
 
-  /* open the rom file */
-  fp = fopen(filename, "rb");
+  magic += 4;
 
-  if (fp == NULL)
+  if (ROM_MAGIC_IS_NOT('I', 'C', 'H', 'I'))
     return 1;
 
-  /* read cart header */
-  if (fread(magic, sizeof(char), 4, fp) < 4)
+  magic += 4;
+
+  /* packed carts are followed by a version byte */
+  G_rom_packed = 0;
+
+  if (ROM_MAGIC_IS('P', 'A', 'C', 'K'))
+    G_rom_packed = 1;
+  else if (ROM_MAGIC_IS_NOT('C', 'A', 'R', 'T'))
     return 1;
 
-  if (ROM_MAGIC_IS_NOT('K', 'U', 'N', 'O'))
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_read_page()                                                            */
+/******************************************************************************/
+static int rom_read_page( unsigned long page,
+                          unsigned char* dst, unsigned long num_bytes)
+{
+  unsigned char* src;
+
+  /* find the stored page (in the mapping, or read from the file) */
+  src = NULL;
+
+#ifdef ROM_MMAP
+  if (S_rom_map != NULL)
+    src = S_rom_map + S_rom_page_offset[page];
+#endif
+
+  if (src == NULL)
+  {
+    if ((S_rom_fp == NULL) ||
+        (fseek(S_rom_fp, S_rom_page_offset[page], SEEK_SET) != 0))
+    {
+      return 1;
+    }
+
+    if (fread(S_rom_block_buf, sizeof(unsigned char), 
+              S_rom_page_size[page], S_rom_fp) < S_rom_page_size[page])
+    {
+      return 1;
+    }
+
+    src = S_rom_block_buf;
+  }
+
+  /* copy or decompress it */
+  if (S_rom_page_method[page] == ROM_METHOD_LZ)
+    return lz_decode_block(dst, num_bytes, src, S_rom_page_size[page]);
+
+  if (S_rom_page_size[page] != num_bytes)
     return 1;
 
-  if (fread(magic, sizeof(char), 4, fp) < 4)
+  memcpy(dst, src, num_bytes);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_open_pages()                                                           */
+/******************************************************************************/
+static int rom_open_pages(unsigned char* dir,
+                          unsigned long num_pages,
+                          unsigned long file_size,
+                          unsigned long* end)
+{
+  unsigned long k;
+  unsigned long num_bytes;
+
+  /* read the bank size & check that it matches the number of pages */
+  ROM_READ_32BE(num_bytes, dir)
+
+  dir += ROM_DIR_HEADER_SIZE;
+
+  if ((num_bytes > BANK_MAX_SIZE) || 
+      (num_bytes % VDP_BYTES_PER_CELL != 0) || 
+      (num_pages != (num_bytes + BANK_PAGE_SIZE - 1) / BANK_PAGE_SIZE))
+  {
     return 1;
+  }
 
-  if (ROM_MAGIC_IS_NOT('I', 'C', 'H', 'I'))
+  /* read the directory (the pages themselves are read on first use) */
+  *end = 0;
+
+  for (k = 0; k < num_pages; k++, dir += ROM_DIR_ENTRY_SIZE)
+  {
+    ROM_READ_32BE(S_rom_page_offset[k], dir)
+    ROM_READ_24BE(S_rom_page_size[k], (dir + 4))
+
+    S_rom_page_method[k] = dir[7];
+
+    if ((S_rom_page_method[k] > ROM_METHOD_LZ) || 
+        (S_rom_page_size[k] > LZ_BLOCK_BOUND(BANK_PAGE_SIZE)) || 
+        (S_rom_page_offset[k] + S_rom_page_size[k] > file_size))
+    {
+      return 1;
+    }
+
+    if (*end < S_rom_page_offset[k] + S_rom_page_size[k])
+      *end = S_rom_page_offset[k] + S_rom_page_size[k];
+  }
+
+  if (bank_open(num_bytes, rom_read_page))
     return 1;
 
-  if (fread(magic, sizeof(char), 4, fp) < 4)
+  G_vdp_bank_num_bytes = num_bytes;
+
+  return 0;
+}
+
+#ifdef ROM_MMAP
+
+/******************************************************************************/
+/* rom_map_count()                                                            */
+/******************************************************************************/
+static int rom_map_count( unsigned long* pos,
+                          unsigned long* count,
+                          unsigned long max_count,
+                          int* method)
+{
+  /* read the section's word / byte count (& storage method if packed) */
+  if (*pos + 3 + G_rom_packed > S_rom_map_size)
     return 1;
 
-  if (ROM_MAGIC_IS_NOT('C', 'A', 'R', 'T'))
+  ROM_READ_24BE(*count, (S_rom_map + *pos))
+
+  *pos += 3;
+
+  if (*count > max_count)
     return 1;
 
-  /* reset vdp buffers */
-  vdp_reset();
+  *method = ROM_METHOD_RAW;
+
+  if (G_rom_packed)
+  {
+    *method = S_rom_map[*pos];
+    *pos += 1;
+
+    if (*method >= ROM_NUM_METHODS)
+      return 1;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_map_unpack()                                                           */
+/******************************************************************************/
+static int rom_map_unpack(unsigned long* pos,
+                          unsigned char* dst,
+                          unsigned long num_bytes)
+{
+  unsigned long block_size;
+  unsigned long packed_size;
+
+  /* decode each block straight from the mapping */
+  while (num_bytes > 0)
+  {
+    block_size = (num_bytes < LZ_BLOCK_SIZE) ? num_bytes : LZ_BLOCK_SIZE;
+
+    if (*pos + 3 > S_rom_map_size)
+      return 1;
+
+    ROM_READ_24BE(packed_size, (S_rom_map + *pos))
+
+    *pos += 3;
 
-  /* read vdp nametable */
-  if (fread(buf, sizeof(unsigned char), 3, fp) < 3)
+    if (*pos + packed_size > S_rom_map_size)
+      return 1;
+
+    if (lz_decode_block(dst, block_size, S_rom_map + *pos, packed_size))
+      return 1;
+
+    *pos += packed_size;
+
+    dst += block_size;
+    num_bytes -= block_size;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_map_words()                                                            */
+/******************************************************************************/
+static int rom_map_words( unsigned long* pos,
+                          unsigned short* dst,
+                          unsigned long* num_words,
+                          unsigned long max_words)
+{
+  int method;
+
+  if (rom_map_count(pos, num_words, max_words, &method) || 
+      (method == ROM_METHOD_PAGED))
+  {
+    return 1;
+  }
+
+  /* decompress the section, then convert it in place */
+  if (method == ROM_METHOD_LZ)
+  {
+    if (rom_map_unpack(pos, (unsigned char*) dst, 2 * (*num_words)))
+      return 1;
+
+    rom_swap_words(dst, (unsigned char*) dst, *num_words);
+
+    return 0;
+  }
+
+  /* convert the section in one pass */
+  if (*pos + 2 * (*num_words) > S_rom_map_size)
+    return 1;
+
+  rom_swap_words(dst, S_rom_map + *pos, *num_words);
+
+  *pos += 2 * (*num_words);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_load_mapped()                                                          */
+/******************************************************************************/
+static int rom_load_mapped(char* filename)
+{
+  int fd;
+  int method;
+
+  unsigned long count;
+
+  struct stat st;
+
+  void* map;
+
+  unsigned long pos;
+
+  /* map the rom file (returns 2 if mapping is not possible, */
+  /* so that the caller can fall back to reading the file)   */
+  fd = open(filename, O_RDONLY);
+
+  if (fd < 0)
     return 1;
 
-  ROM_READ_24BE(G_vdp_nametable_num_words, buf)
+  if ((fstat(fd, &st) != 0) || (st.st_size < ROM_HEADER_SIZE))
+  {
+    close(fd);
+    return 1;
+  }
+
+  /* the mapping is shared & read only, so the file's pages are shared */
+  /* with any other instances running the same cart, and a stray write */
+  /* to the bank faults rather than quietly copying a page             */
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
 
-  if (G_vdp_nametable_num_words > VDP_NAMETABLE_SIZE)
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return 2;
+
+  S_rom_map = map;
+  S_rom_map_size = st.st_size;
+
+  /* read cart header */
+  if (rom_check_header((char*) S_rom_map))
     return 1;
 
-  for (k = 0; k < G_vdp_nametable_num_words; k++)
+  pos = ROM_HEADER_SIZE;
+
+  if (G_rom_packed)
   {
-    if (fread(buf, sizeof(unsigned char), 2, fp) < 2)
+    if ((pos + 1 > S_rom_map_size) || 
+        (S_rom_map[pos] < 1) || (S_rom_map[pos] > ROM_PACK_VERSION))
+    {
       return 1;
+    }
+
+    pos += 1;
+  }
 
-    ROM_READ_16BE(G_vdp_nametable_buf[k], buf)
+  /* read vdp nametable & palettes */
+  if (rom_map_words(&pos, G_vdp_nametable_buf,
+                    &G_vdp_nametable_num_words, VDP_NAMETABLE_SIZE))
+  {
+    return 1;
   }
 
-  /* read vdp palettes */
-  if (fread(buf, sizeof(unsigned char), 3, fp) < 3)
+  if (rom_map_words(&pos, G_vdp_pals_buf,
+                    &G_vdp_pals_num_words, VDP_PALS_SIZE))
+  {
     return 1;
+  }
+
+  /* read vdp cells (decompressed into the bank, used in place, */
+  /* or paged in on demand)                                     */
+  if (rom_map_count(&pos, &count, VDP_BANK_SIZE, &method))
+    return 1;
+
+  if (method == ROM_METHOD_PAGED)
+  {
+    if (pos + ROM_DIR_HEADER_SIZE + 
+        ROM_DIR_ENTRY_SIZE * count > S_rom_map_size)
+    {
+      return 1;
+    }
+
+    if (rom_open_pages(S_rom_map + pos, count, S_rom_map_size, &pos))
+      return 1;
+  }
+  else if (method == ROM_METHOD_LZ)
+  {
+    G_vdp_bank_num_bytes = count;
+
+    if (rom_map_unpack(&pos, G_vdp_bank_buf, G_vdp_bank_num_bytes))
+      return 1;
+  }
+  else
+  {
+    G_vdp_bank_num_bytes = count;
+
+    if (pos + G_vdp_bank_num_bytes > S_rom_map_size)
+      return 1;
+
+    G_vdp_bank_buf = S_rom_map + pos;
+
+    pos += G_vdp_bank_num_bytes;
+  }
+
+  /* read vdp tilemap (optional, older carts end after the cells) */
+  if (pos < S_rom_map_size)
+  {
+    if (rom_map_words(&pos, G_vdp_tilemap_buf,
+                      &G_vdp_tilemap_num_words, VDP_TILEMAP_SIZE))
+    {
+      return 1;
+    }
+  }
+
+  G_rom_mapped = 1;
+
+  return 0;
+}
+
+#endif
+
+/******************************************************************************/
+/* rom_read_count()                                                           */
+/******************************************************************************/
+static int rom_read_count(FILE* fp,
+                          unsigned long* count,
+                          unsigned long max_count,
+                          int* method)
+{
+  unsigned char buf[4];
+
+  /* read the section's word / byte count (& storage method if packed) */
+  if (fread(buf, sizeof(unsigned char), 3 + G_rom_packed, fp) < 
+      (size_t) (3 + G_rom_packed))
+  {
+    return 1;
+  }
+
+  ROM_READ_24BE(*count, buf)
+
+  if (*count > max_count)
+    return 1;
+
+  *method = ROM_METHOD_RAW;
+
+  if (G_rom_packed)
+  {
+    *method = buf[3];
+
+    if (*method >= ROM_NUM_METHODS)
+      return 1;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_read_unpack()                                                          */
+/******************************************************************************/
+static int rom_read_unpack( FILE* fp,
+                            unsigned char* dst,
+                            unsigned long num_bytes)
+{
+  unsigned char buf[4];
+
+  unsigned long block_size;
+  unsigned long packed_size;
+
+  /* read each block into the block buffer & decode it from there */
+  while (num_bytes > 0)
+  {
+    block_size = (num_bytes < LZ_BLOCK_SIZE) ? num_bytes : LZ_BLOCK_SIZE;
+
+    if (fread(buf, sizeof(unsigned char), 3, fp) < 3)
+      return 1;
+
+    ROM_READ_24BE(packed_size, buf)
+
+    if (packed_size > LZ_BLOCK_BOUND(LZ_BLOCK_SIZE))
+      return 1;
+
+    if (fread(S_rom_block_buf, sizeof(unsigned char), 
+              packed_size, fp) < packed_size)
+    {
+      return 1;
+    }
+
+    if (lz_decode_block(dst, block_size, S_rom_block_buf, packed_size))
+      return 1;
 
-  ROM_READ_24BE(G_vdp_pals_num_words, buf)
+    dst += block_size;
+    num_bytes -= block_size;
+  }
 
-  if (G_vdp_pals_num_words > VDP_PALS_SIZE)
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_read_words()                                                           */
+/******************************************************************************/
+static int rom_read_words(FILE* fp,
+                          unsigned short* dst,
+                          unsigned long* num_words,
+                          unsigned long max_words)
+{
+  int method;
+
+  if (rom_read_count(fp, num_words, max_words, &method) || 
+      (method == ROM_METHOD_PAGED))
+  {
     return 1;
+  }
 
-  for (k = 0; k < G_vdp_pals_num_words; k++)
+  /* decompress the section, then convert it in place */
+  if (method == ROM_METHOD_LZ)
   {
-    if (fread(buf, sizeof(unsigned char), 2, fp) < 2)
+    if (rom_read_unpack(fp, (unsigned char*) dst, 2 * (*num_words)))
       return 1;
 
-    ROM_READ_16BE(G_vdp_pals_buf[k], buf)
+    rom_swap_words(dst, (unsigned char*) dst, *num_words);
+
+    return 0;
   }
 
-  /* read vdp cells */
-  if (fread(buf, sizeof(unsigned char), 3, fp) < 3)
+  /* read the section in one call, then convert it in place */
+  if (fread(dst, sizeof(unsigned char),
+            2 * (*num_words), fp) < 2 * (*num_words))
+  {
     return 1;
+  }
+
+  rom_swap_words(dst, (unsigned char*) dst, *num_words);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_load_file()                                                            */
+/******************************************************************************/
+static int rom_load_file(char* filename, rom_sections* dst)
+{
+  int c;
+  int method;
+  int result;
+
+  long file_size;
+
+  unsigned long count;
+  unsigned long dir_size;
+  unsigned long end;
+
+  FILE* fp;
+
+  char magic[ROM_HEADER_SIZE];
 
-  ROM_READ_24BE(G_vdp_bank_num_bytes, buf)
+  /* open the rom file */
+  fp = fopen(filename, "rb");
 
-  if (G_vdp_bank_num_bytes > VDP_BANK_SIZE)
+  if (fp == NULL)
     return 1;
 
-  if (fread(G_vdp_bank_buf, sizeof(unsigned char), 
-            G_vdp_bank_num_bytes, fp) < G_vdp_bank_num_bytes)
+  result = 1;
+
+  /* read cart header */
+  if (fread(magic, sizeof(char), ROM_HEADER_SIZE, fp) < ROM_HEADER_SIZE)
+    goto close_file;
+
+  if (rom_check_header(magic))
+    goto close_file;
+
+  if (G_rom_packed)
+  {
+    c = fgetc(fp);
+
+    if ((c < 1) || (c > ROM_PACK_VERSION))
+      goto close_file;
+  }
+
+  /* read vdp nametable & palettes */
+  if (rom_read_words( fp, dst->nametable_buf,
+                      &dst->nametable_num_words, VDP_NAMETABLE_SIZE))
+  {
+    goto close_file;
+  }
+
+  if (rom_read_words( fp, dst->pals_buf,
+                      &dst->pals_num_words, VDP_PALS_SIZE))
+  {
+    goto close_file;
+  }
+
+  /* read vdp cells (or just the page directory, if they are paged) */
+  if (rom_read_count(fp, &count, VDP_BANK_SIZE, &method))
+    goto close_file;
+
+  if (method == ROM_METHOD_PAGED)
+  {
+    /* (pages can only be opened for the cart in use) */
+    if (dst->bank_buf != G_vdp_bank_buf)
+    {
+      result = 2;
+      goto close_file;
+    }
+
+    dir_size = ROM_DIR_HEADER_SIZE + ROM_DIR_ENTRY_SIZE * count;
+
+    if ((count > BANK_MAX_PAGES) || 
+        (fread(S_rom_block_buf, sizeof(unsigned char), 
+               dir_size, fp) < dir_size))
+    {
+      goto close_file;
+    }
+
+    if ((fseek(fp, 0, SEEK_END) != 0) || ((file_size = ftell(fp)) < 0))
+      goto close_file;
+
+    if (rom_open_pages(S_rom_block_buf, count, file_size, &end))
+      goto close_file;
+
+    dst->bank_num_bytes = G_vdp_bank_num_bytes;
+
+    if (fseek(fp, end, SEEK_SET) != 0)
+      goto close_file;
+
+    S_rom_fp = fp;
+  }
+  else if (method == ROM_METHOD_LZ)
+  {
+    dst->bank_num_bytes = count;
+
+    if (rom_read_unpack(fp, dst->bank_buf, dst->bank_num_bytes))
+      goto close_file;
+  }
+  else
+  {
+    dst->bank_num_bytes = count;
+
+    if (fread(dst->bank_buf, sizeof(unsigned char),
+              dst->bank_num_bytes, fp) < dst->bank_num_bytes)
+    {
+      goto close_file;
+    }
+  }
+
+  /* read vdp tilemap (optional, older carts end after the cells) */
+  c = fgetc(fp);
+
+  if (c != EOF)
+  {
+    ungetc(c, fp);
+
+    if (rom_read_words( fp, dst->tilemap_buf,
+                        &dst->tilemap_num_words, VDP_TILEMAP_SIZE))
+    {
+      goto close_file;
+    }
+  }
+
+  result = 0;
+
+  /* close the file (unless its pages are still to be read) */
+close_file:
+  if (S_rom_fp != fp)
+    fclose(fp);
+
+  return result;
+}
+
+/******************************************************************************/
+/* rom_patch_words()                                                          */
+/******************************************************************************/
+static unsigned long rom_patch_words( unsigned short* dst,
+                                      unsigned long* dst_num_words,
+                                      unsigned short* src,
+                                      unsigned long src_num_words)
+{
+  unsigned long k;
+  unsigned long end;
+  unsigned long num_changed;
+
+  unsigned short val;
+
+  /* words past the end of either section count as zero */
+  end = (*dst_num_words > src_num_words) ? *dst_num_words : src_num_words;
+
+  num_changed = 0;
+
+  for (k = 0; k < end; k++)
+  {
+    val = (k < src_num_words) ? src[k] : 0;
+
+    if (dst[k] != val)
+    {
+      dst[k] = val;
+      num_changed += 1;
+    }
+  }
+
+  *dst_num_words = src_num_words;
+
+  return num_changed;
+}
+
+/******************************************************************************/
+/* rom_patch_bank()                                                           */
+/******************************************************************************/
+static unsigned long rom_patch_bank(unsigned char* src,
+                                    unsigned long src_num_bytes)
+{
+  unsigned long addr;
+  unsigned long start;
+  unsigned long last;
+  unsigned long end;
+  unsigned long num_changed;
+
+  /* bytes past the end of either bank count as zero */
+  end = G_vdp_bank_num_bytes;
+
+  if (end < src_num_bytes)
+    end = src_num_bytes;
+  else
+    memset(src + src_num_bytes, 0, end - src_num_bytes);
+
+  /* the cell cache is sized to the bank, so it is rebuilt if the size */
+  /* changes (the changed cells are copied over first)                 */
+  if (src_num_bytes != G_vdp_bank_num_bytes)
+  {
+    memcpy(G_vdp_bank_buf, src, end);
+    G_vdp_bank_num_bytes = src_num_bytes;
+
+    cell_build_cache();
+    vdp_invalidate_cells(0, end);
+
+    return end;
+  }
+
+  /* compare cell by cell, and copy over each run of changed cells */
+  /* (runs closer than the gap are merged, since each invalidation */
+  /* checks the whole tilemap)                                     */
+  num_changed = 0;
+
+  addr = 0;
+
+  while (addr < end)
   {
+    last = (addr + VDP_BYTES_PER_CELL < end) ? 
+      addr + VDP_BYTES_PER_CELL : end;
+
+    if (!memcmp(&G_vdp_bank_buf[addr], &src[addr], last - addr))
+    {
+      addr = last;
+      continue;
+    }
+
+    start = addr;
+
+    for (addr = last; (addr < end) && (addr < last + ROM_RELOAD_GAP); 
+         addr += VDP_BYTES_PER_CELL)
+    {
+      if (memcmp( &G_vdp_bank_buf[addr], &src[addr], 
+                  (addr + VDP_BYTES_PER_CELL < end) ? 
+                    VDP_BYTES_PER_CELL : end - addr))
+      {
+        last = (addr + VDP_BYTES_PER_CELL < end) ? 
+          addr + VDP_BYTES_PER_CELL : end;
+      }
+    }
+
+    memcpy(&G_vdp_bank_buf[start], &src[start], last - start);
+    vdp_invalidate_cells(start, last - start);
+
+    num_changed += last - start;
+
+    addr = last;
+  }
+
+  return num_changed;
+}
+
+/******************************************************************************/
+/* rom_identify()                                                             */
+/******************************************************************************/
+static int rom_identify(char* filename)
+{
+  FILE* fp;
+
+  unsigned long k;
+  unsigned long num_bytes;
+
+  long file_size;
+
+  unsigned char buf[ROM_ID_SIZE];
+
+  G_rom_file_size = 0;
+  G_rom_file_hash = 0;
+
+  fp = fopen(filename, "rb");
+
+  if (fp == NULL)
+    return 1;
+
+  num_bytes = fread(buf, sizeof(unsigned char), ROM_ID_SIZE, fp);
+
+  if ((fseek(fp, 0, SEEK_END) != 0) || ((file_size = ftell(fp)) < 0))
+  {
+    fclose(fp);
     return 1;
   }
 
-  /* close the file */
   fclose(fp);
 
+  G_rom_file_size = (unsigned long) file_size;
+  G_rom_file_hash = ROM_FNV_OFFSET;
+
+  for (k = 0; k < num_bytes; k++)
+    G_rom_file_hash = (G_rom_file_hash ^ buf[k]) * ROM_FNV_PRIME;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_unload()                                                               */
+/******************************************************************************/
+int rom_unload()
+{
+  /* stop paging (the bank must not point into the pages afterwards) */
+  if (G_bank_active)
+  {
+    vdp_reset();
+    bank_close();
+  }
+
+#ifdef ROM_MMAP
+  /* release the mapping (the bank must not point into it afterwards) */
+  if (S_rom_map != NULL)
+  {
+    if ((G_vdp_bank_buf >= S_rom_map) &&
+        (G_vdp_bank_buf < S_rom_map + S_rom_map_size))
+    {
+      vdp_reset();
+    }
+
+    munmap(S_rom_map, S_rom_map_size);
+
+    S_rom_map = NULL;
+    S_rom_map_size = 0;
+  }
+#endif
+
+  if (S_rom_fp != NULL)
+  {
+    fclose(S_rom_fp);
+    S_rom_fp = NULL;
+  }
+
+  if (S_rom_next_bank != NULL)
+  {
+    free(S_rom_next_bank);
+    S_rom_next_bank = NULL;
+  }
+
+  G_rom_mapped = 0;
+  G_rom_packed = 0;
+
+  G_rom_file_size = 0;
+  G_rom_file_hash = 0;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_allow_mapping()                                                        */
+/******************************************************************************/
+int rom_allow_mapping(int allow)
+{
+  S_rom_allow_mapping = (allow != 0) ? 1 : 0;
+
   return 0;
 }
 
+/******************************************************************************/
+/* rom_load()                                                                 */
+/******************************************************************************/
+int rom_load(char* filename)
+{
+  int result;
+
+  rom_sections sections;
+
+  /* make sure filename is valid */
+  if (filename == NULL)
+    return 1;
+
+  /* release the previous cart & reset vdp buffers */
+  rom_unload();
+  vdp_reset();
+
+  /* map the file if possible, otherwise read it */
+  result = 2;
+
+#ifdef ROM_MMAP
+  if (S_rom_allow_mapping)
+    result = rom_load_mapped(filename);
+#endif
+
+  if (result == 2)
+  {
+    sections.nametable_buf = G_vdp_nametable_buf;
+    sections.nametable_num_words = 0;
+    sections.pals_buf = G_vdp_pals_buf;
+    sections.pals_num_words = 0;
+    sections.bank_buf = G_vdp_bank_buf;
+    sections.bank_num_bytes = 0;
+    sections.tilemap_buf = G_vdp_tilemap_buf;
+    sections.tilemap_num_words = 0;
+
+    result = rom_load_file(filename, &sections);
+
+    /* (set even if the load failed, so that the reset clears them) */
+    G_vdp_nametable_num_words = sections.nametable_num_words;
+    G_vdp_pals_num_words = sections.pals_num_words;
+    G_vdp_bank_num_bytes = sections.bank_num_bytes;
+    G_vdp_tilemap_num_words = sections.tilemap_num_words;
+  }
+
+  if (result != 0)
+  {
+    rom_unload();
+    return 1;
+  }
+
+  /* decode the cells */
+  if (cell_build_cache())
+    return 1;
+
+  rom_identify(filename);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_reload_all()                                                           */
+/******************************************************************************/
+static int rom_reload_all(char* filename)
+{
+  if (rom_load(filename))
+    return 1;
+
+  /* (everything counts as changed) */
+  G_rom_num_changed_words = G_vdp_nametable_num_words + 
+                            G_vdp_pals_num_words + 
+                            G_vdp_tilemap_num_words;
+
+  G_rom_num_changed_bytes = G_vdp_bank_num_bytes;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* rom_reload()                                                               */
+/******************************************************************************/
+int rom_reload(char* filename)
+{
+  int result;
+  int packed;
+
+  rom_sections next;
+
+  /* make sure filename is valid */
+  if (filename == NULL)
+    return 1;
+
+  G_rom_num_changed_words = 0;
+  G_rom_num_changed_bytes = 0;
+
+  /* a mapped or paged bank is not ours to patch, so it is reloaded */
+  if (G_rom_mapped || G_bank_active)
+    return rom_reload_all(filename);
+
+  /* read the cart into the scratch buffers */
+  if (S_rom_next_bank == NULL)
+  {
+    S_rom_next_bank = malloc(VDP_BANK_SIZE);
+
+    if (S_rom_next_bank == NULL)
+      return 1;
+  }
+
+  next.nametable_buf = S_rom_next_nametable;
+  next.nametable_num_words = 0;
+  next.pals_buf = S_rom_next_pals;
+  next.pals_num_words = 0;
+  next.bank_buf = S_rom_next_bank;
+  next.bank_num_bytes = 0;
+  next.tilemap_buf = S_rom_next_tilemap;
+  next.tilemap_num_words = 0;
+
+  packed = G_rom_packed;
+
+  result = rom_load_file(filename, &next);
+
+  /* the cart now has paged cells, so it is reloaded */
+  if (result == 2)
+    return rom_reload_all(filename);
+
+  /* keep the current cart if the file is not valid */
+  /* (an editor may be partway through writing it)  */
+  if (result != 0)
+  {
+    G_rom_packed = packed;
+    return 1;
+  }
+
+  /* patch the sections in place (the vdp notices the changes to */
+  /* the nametable, palettes & tilemap on its own)               */
+  G_rom_num_changed_words += 
+    rom_patch_words(G_vdp_nametable_buf, &G_vdp_nametable_num_words, 
+                    next.nametable_buf, next.nametable_num_words);
+
+  G_rom_num_changed_words += 
+    rom_patch_words(G_vdp_pals_buf, &G_vdp_pals_num_words, 
+                    next.pals_buf, next.pals_num_words);
+
+  G_rom_num_changed_words += 
+    rom_patch_words(G_vdp_tilemap_buf, &G_vdp_tilemap_num_words, 
+                    next.tilemap_buf, next.tilemap_num_words);
+
+  G_rom_num_changed_bytes = rom_patch_bank(next.bank_buf, next.bank_num_bytes);
+
+  rom_identify(filename);
+
+  return 0;
+}
@@ -5,8 +5,30 @@
 #ifndef ROM_H
 #define ROM_H
 
-/* function declarations */
+/* set if the cell bank is mapped directly from the cart file */
+extern int G_rom_mapped;
+
+/* set if the cart file is in the packed (compressed) format */
+extern int G_rom_packed;
+
+/* the loaded cart file's size, and a hash of its first bytes */
+/* (so that save states can be matched to the cart)           */
+extern unsigned long G_rom_file_size;
+extern unsigned long G_rom_file_hash;
+
+/* sections changed by the last reload (words in the nametable, */
+/* palettes & tilemap, and bytes of cells)                       */
+extern unsigned long G_rom_num_changed_words;
+extern unsigned long G_rom_num_changed_bytes;
+
+/* function declarations (a reload patches only what changed in */
+/* place, unless the bank is mapped or paged, and keeps the      */
+/* current cart if the file cannot be read)                      */
+int rom_allow_mapping(int allow);
+
 int rom_load(char* filename);
+int rom_reload(char* filename);
+int rom_unload();
 
 #endif
 
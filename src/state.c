@@ -0,0 +1,828 @@
+/******************************************************************************/
+/* state.c (save states & rewind)                                             */
+/******************************************************************************/
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "state.h"
+
+#include "anim.h"
+#include "bank.h"
+#include "rom.h"
+#include "vdp.h"
+
+#define STATE_MAGIC       "KNS3"
+#define STATE_MAGIC_SIZE  4
+
+/* a state image is the parts below, one after another, each padded */
+/* to a whole number of blocks (so a block never spans two parts)   */
+enum
+{
+  STATE_PART_REGS = 0,
+  STATE_PART_NAMETABLE,
+  STATE_PART_PALS,
+  STATE_PART_TILEMAP,
+  STATE_PART_LINE_MATRIX,
+  STATE_PART_ANIM,
+  STATE_PART_BANK,
+  STATE_NUM_PARTS
+};
+
+enum
+{
+  STATE_REG_NAMETABLE_NUM_WORDS = 0,
+  STATE_REG_PALS_NUM_WORDS,
+  STATE_REG_TILEMAP_NUM_WORDS,
+  STATE_REG_BANK_NUM_BYTES,
+  STATE_REG_BG_SCROLL_X,
+  STATE_REG_BG_SCROLL_Y,
+  STATE_REG_BG_MODE,
+  STATE_REG_BG_MATRIX_A,
+  STATE_REG_BG_MATRIX_B,
+  STATE_REG_BG_MATRIX_C,
+  STATE_REG_BG_MATRIX_D,
+  STATE_REG_BG_CENTER_X,
+  STATE_REG_BG_CENTER_Y,
+  STATE_REG_CART_SIZE,
+  STATE_REG_CART_HASH,
+  STATE_NUM_REGS
+};
+
+#define STATE_PAD(num_bytes)                                                   \
+  ((((num_bytes) + STATE_BLOCK_SIZE - 1) / STATE_BLOCK_SIZE) * STATE_BLOCK_SIZE)
+
+/* a delta is a series of runs, each a count of unchanged blocks to  */
+/* skip, a count of changed blocks, and the changed blocks (xored).  */
+/* the counts are 7 bits per byte, low bits first, with the high bit */
+/* set on every byte but the last.                                   */
+#define STATE_COUNT_BOUND 10
+
+static unsigned long  S_state_regs[STATE_NUM_REGS];
+
+static unsigned char* S_state_part_ptr[STATE_NUM_PARTS];
+static unsigned long  S_state_part_size[STATE_NUM_PARTS];
+static unsigned long  S_state_part_offset[STATE_NUM_PARTS];
+
+static unsigned char* S_state_anim_buf = NULL;
+
+/* the most recent state, and the delta being encoded against it */
+static unsigned char* S_state_cur = NULL;
+static unsigned char* S_state_delta = NULL;
+
+static unsigned long  S_state_image_size;
+
+/* rewind buffer (deltas are stored whole, in the order they were made, */
+/* wrapping to the start of the buffer when one does not fit at the end */
+/* and evicting the oldest ones as they are overwritten)                 */
+static unsigned long  S_state_rewind_limit = STATE_REWIND_LIMIT_DEFAULT;
+
+static unsigned char* S_state_ring = NULL;
+static unsigned long  S_state_ring_end;
+
+static unsigned long  S_state_record_pos[STATE_MAX_SNAPSHOTS];
+static unsigned long  S_state_record_size[STATE_MAX_SNAPSHOTS];
+
+static unsigned long  S_state_first_record;
+
+/* statistics */
+unsigned long G_state_num_snapshots = 0;
+unsigned long G_state_rewind_bytes = 0;
+
+unsigned long G_state_num_pushed = 0;
+unsigned long G_state_num_popped = 0;
+
+unsigned long G_state_push_ns_total = 0;
+unsigned long G_state_push_ns_max = 0;
+unsigned long G_state_pop_ns_total = 0;
+unsigned long G_state_pop_ns_max = 0;
+
+unsigned long G_state_save_ns = 0;
+unsigned long G_state_load_ns = 0;
+
+/******************************************************************************/
+/* state_elapsed_ns()                                                         */
+/******************************************************************************/
+static unsigned long state_elapsed_ns(Uint64 start)
+{
+  return (unsigned long) ((SDL_GetPerformanceCounter() - start) *
+                          (1000000000.0 / SDL_GetPerformanceFrequency()));
+}
+
+/******************************************************************************/
+/* state_set_rewind_limit()                                                   */
+/******************************************************************************/
+int state_set_rewind_limit(unsigned long num_bytes)
+{
+  state_reset();
+
+  S_state_rewind_limit = num_bytes;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* state_reset()                                                              */
+/******************************************************************************/
+int state_reset()
+{
+  if (S_state_anim_buf != NULL)
+  {
+    free(S_state_anim_buf);
+    S_state_anim_buf = NULL;
+  }
+
+  if (S_state_cur != NULL)
+  {
+    free(S_state_cur);
+    S_state_cur = NULL;
+  }
+
+  if (S_state_delta != NULL)
+  {
+    free(S_state_delta);
+    S_state_delta = NULL;
+  }
+
+  if (S_state_ring != NULL)
+  {
+    free(S_state_ring);
+    S_state_ring = NULL;
+  }
+
+  S_state_image_size = 0;
+  S_state_ring_end = 0;
+  S_state_first_record = 0;
+
+  G_state_num_snapshots = 0;
+  G_state_rewind_bytes = 0;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* state_layout()                                                             */
+/******************************************************************************/
+static unsigned long state_layout()
+{
+  int k;
+
+  unsigned long offset;
+
+  /* gather the registers & the animation state */
+  S_state_regs[STATE_REG_NAMETABLE_NUM_WORDS] = G_vdp_nametable_num_words;
+  S_state_regs[STATE_REG_PALS_NUM_WORDS] = G_vdp_pals_num_words;
+  S_state_regs[STATE_REG_TILEMAP_NUM_WORDS] = G_vdp_tilemap_num_words;
+  S_state_regs[STATE_REG_BANK_NUM_BYTES] = G_vdp_bank_num_bytes;
+  S_state_regs[STATE_REG_BG_SCROLL_X] = G_vdp_bg_scroll_x;
+  S_state_regs[STATE_REG_BG_SCROLL_Y] = G_vdp_bg_scroll_y;
+  S_state_regs[STATE_REG_BG_MODE] = G_vdp_bg_mode;
+  S_state_regs[STATE_REG_BG_MATRIX_A] = G_vdp_bg_matrix[VDP_MATRIX_A];
+  S_state_regs[STATE_REG_BG_MATRIX_B] = G_vdp_bg_matrix[VDP_MATRIX_B];
+  S_state_regs[STATE_REG_BG_MATRIX_C] = G_vdp_bg_matrix[VDP_MATRIX_C];
+  S_state_regs[STATE_REG_BG_MATRIX_D] = G_vdp_bg_matrix[VDP_MATRIX_D];
+  S_state_regs[STATE_REG_BG_CENTER_X] = G_vdp_bg_center_x;
+  S_state_regs[STATE_REG_BG_CENTER_Y] = G_vdp_bg_center_y;
+  S_state_regs[STATE_REG_CART_SIZE] = G_rom_file_size;
+  S_state_regs[STATE_REG_CART_HASH] = G_rom_file_hash;
+
+  if (S_state_anim_buf == NULL)
+    S_state_anim_buf = malloc(anim_state_size());
+
+  if (S_state_anim_buf == NULL)
+    return 0;
+
+  anim_save(S_state_anim_buf);
+
+  /* the parts */
+  S_state_part_ptr[STATE_PART_REGS] = (unsigned char*) S_state_regs;
+  S_state_part_size[STATE_PART_REGS] = sizeof(S_state_regs);
+
+  S_state_part_ptr[STATE_PART_NAMETABLE] = (unsigned char*) G_vdp_nametable_buf;
+  S_state_part_size[STATE_PART_NAMETABLE] = sizeof(G_vdp_nametable_buf);
+
+  S_state_part_ptr[STATE_PART_PALS] = (unsigned char*) G_vdp_pals_buf;
+  S_state_part_size[STATE_PART_PALS] = sizeof(G_vdp_pals_buf);
+
+  S_state_part_ptr[STATE_PART_TILEMAP] = (unsigned char*) G_vdp_tilemap_buf;
+  S_state_part_size[STATE_PART_TILEMAP] = sizeof(G_vdp_tilemap_buf);
+
+  S_state_part_ptr[STATE_PART_LINE_MATRIX] = 
+    (unsigned char*) G_vdp_bg_line_matrix;
+  S_state_part_size[STATE_PART_LINE_MATRIX] = sizeof(G_vdp_bg_line_matrix);
+
+  S_state_part_ptr[STATE_PART_ANIM] = S_state_anim_buf;
+  S_state_part_size[STATE_PART_ANIM] = anim_state_size();
+
+  /* (a mapped or paged bank is the cart's, so it cannot change) */
+  S_state_part_ptr[STATE_PART_BANK] = G_vdp_bank_buf;
+
+  if ((G_bank_active == 0) && (G_rom_mapped == 0))
+    S_state_part_size[STATE_PART_BANK] = G_vdp_bank_num_bytes;
+  else
+    S_state_part_size[STATE_PART_BANK] = 0;
+
+  offset = 0;
+
+  for (k = 0; k < STATE_NUM_PARTS; k++)
+  {
+    S_state_part_offset[k] = offset;
+    offset += STATE_PAD(S_state_part_size[k]);
+  }
+
+  return offset;
+}
+
+/******************************************************************************/
+/* state_check()                                                              */
+/******************************************************************************/
+static int state_check(unsigned char* image)
+{
+  unsigned long* regs;
+
+  /* the state must be for this cart (so it has the same layout), */
+  /* and every count must fit its buffer, before any of it is used */
+  regs = (unsigned long*) &image[S_state_part_offset[STATE_PART_REGS]];
+
+  if ((regs[STATE_REG_CART_SIZE] != G_rom_file_size) ||
+      (regs[STATE_REG_CART_HASH] != G_rom_file_hash) ||
+      (regs[STATE_REG_BANK_NUM_BYTES] != G_vdp_bank_num_bytes))
+  {
+    return 1;
+  }
+
+  if ((regs[STATE_REG_NAMETABLE_NUM_WORDS] > VDP_NAMETABLE_SIZE) ||
+      (regs[STATE_REG_PALS_NUM_WORDS] > VDP_PALS_SIZE) ||
+      (regs[STATE_REG_TILEMAP_NUM_WORDS] > VDP_TILEMAP_SIZE))
+  {
+    return 1;
+  }
+
+  return anim_check(&image[S_state_part_offset[STATE_PART_ANIM]]);
+}
+
+/******************************************************************************/
+/* state_apply()                                                              */
+/******************************************************************************/
+static int state_apply(unsigned char* image,
+                       unsigned long bank_first, unsigned long bank_last)
+{
+  int k;
+
+  unsigned long* regs;
+
+  /* registers (the bank size was checked to match) */
+  regs = (unsigned long*) &image[S_state_part_offset[STATE_PART_REGS]];
+
+  G_vdp_nametable_num_words = regs[STATE_REG_NAMETABLE_NUM_WORDS];
+  G_vdp_pals_num_words = regs[STATE_REG_PALS_NUM_WORDS];
+  G_vdp_tilemap_num_words = regs[STATE_REG_TILEMAP_NUM_WORDS];
+
+  G_vdp_bg_scroll_x = (unsigned short) regs[STATE_REG_BG_SCROLL_X];
+  G_vdp_bg_scroll_y = (unsigned short) regs[STATE_REG_BG_SCROLL_Y];
+
+  G_vdp_bg_mode = (unsigned short) regs[STATE_REG_BG_MODE];
+  G_vdp_bg_matrix[VDP_MATRIX_A] = (unsigned short) regs[STATE_REG_BG_MATRIX_A];
+  G_vdp_bg_matrix[VDP_MATRIX_B] = (unsigned short) regs[STATE_REG_BG_MATRIX_B];
+  G_vdp_bg_matrix[VDP_MATRIX_C] = (unsigned short) regs[STATE_REG_BG_MATRIX_C];
+  G_vdp_bg_matrix[VDP_MATRIX_D] = (unsigned short) regs[STATE_REG_BG_MATRIX_D];
+  G_vdp_bg_center_x = (unsigned short) regs[STATE_REG_BG_CENTER_X];
+  G_vdp_bg_center_y = (unsigned short) regs[STATE_REG_BG_CENTER_Y];
+
+  /* buffers (the vdp finds what changed against its shadow copies) */
+  for (k = STATE_PART_NAMETABLE; k <= STATE_PART_LINE_MATRIX; k++)
+  {
+    memcpy( S_state_part_ptr[k],
+            &image[S_state_part_offset[k]], S_state_part_size[k]);
+  }
+
+  anim_load(&image[S_state_part_offset[STATE_PART_ANIM]]);
+
+  /* the part of the bank that changed */
+  if (bank_last > S_state_part_size[STATE_PART_BANK])
+    bank_last = S_state_part_size[STATE_PART_BANK];
+
+  if (bank_first < bank_last)
+  {
+    memcpy( &G_vdp_bank_buf[bank_first],
+            &image[S_state_part_offset[STATE_PART_BANK] + bank_first],
+            bank_last - bank_first);
+
+    vdp_invalidate_cells(bank_first, bank_last - bank_first);
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* state_write_count()                                                        */
+/******************************************************************************/
+static unsigned char* state_write_count(unsigned char* dst, unsigned long count)
+{
+  while (count >= 0x80)
+  {
+    *dst++ = (unsigned char) ((count & 0x7F) | 0x80);
+    count >>= 7;
+  }
+
+  *dst++ = (unsigned char) count;
+
+  return dst;
+}
+
+/******************************************************************************/
+/* state_read_count()                                                         */
+/******************************************************************************/
+static unsigned char* state_read_count( unsigned char* src,
+                                        unsigned long* count)
+{
+  int shift;
+
+  *count = 0;
+
+  for (shift = 0; *src & 0x80; shift += 7)
+    *count |= (unsigned long) (*src++ & 0x7F) << shift;
+
+  *count |= (unsigned long) *src++ << shift;
+
+  return src;
+}
+
+/******************************************************************************/
+/* state_block_changed()                                                      */
+/******************************************************************************/
+static int state_block_changed( unsigned char* src, unsigned char* cur,
+                                unsigned long num_bytes)
+{
+  /* (whole blocks are compared with a fixed size, which is inlined) */
+  if (num_bytes >= STATE_BLOCK_SIZE)
+    return memcmp(src, cur, STATE_BLOCK_SIZE);
+
+  return memcmp(src, cur, num_bytes);
+}
+
+/******************************************************************************/
+/* state_encode()                                                             */
+/******************************************************************************/
+static unsigned long state_encode()
+{
+  int k;
+
+  unsigned long n;
+  unsigned long m;
+  unsigned long b;
+  unsigned long num_blocks;
+  unsigned long num_skipped;
+  unsigned long num_bytes;
+
+  unsigned char* src;
+  unsigned char* cur;
+  unsigned char* dst;
+
+  dst = S_state_delta;
+
+  num_skipped = 0;
+
+  for (k = 0; k < STATE_NUM_PARTS; k++)
+  {
+    src = S_state_part_ptr[k];
+    cur = &S_state_cur[S_state_part_offset[k]];
+
+    num_blocks = STATE_PAD(S_state_part_size[k]) / STATE_BLOCK_SIZE;
+
+    n = 0;
+
+    while (n < num_blocks)
+    {
+      /* skip the unchanged blocks */
+      if (!state_block_changed( &src[STATE_BLOCK_SIZE * n],
+                                &cur[STATE_BLOCK_SIZE * n],
+                                S_state_part_size[k] - STATE_BLOCK_SIZE * n))
+      {
+        num_skipped += 1;
+        n += 1;
+        continue;
+      }
+
+      /* find the end of this run of changed blocks */
+      for (m = n + 1; m < num_blocks; m++)
+      {
+        if (!state_block_changed( &src[STATE_BLOCK_SIZE * m],
+                                  &cur[STATE_BLOCK_SIZE * m],
+                                  S_state_part_size[k] - STATE_BLOCK_SIZE * m))
+        {
+          break;
+        }
+      }
+
+      dst = state_write_count(dst, num_skipped);
+      dst = state_write_count(dst, m - n);
+
+      /* xor the new contents with the old, and keep the new ones */
+      num_bytes = S_state_part_size[k] - STATE_BLOCK_SIZE * n;
+
+      if (num_bytes > STATE_BLOCK_SIZE * (m - n))
+        num_bytes = STATE_BLOCK_SIZE * (m - n);
+
+      for (b = 0; b < num_bytes; b++)
+      {
+        dst[b] = src[STATE_BLOCK_SIZE * n + b] ^ cur[STATE_BLOCK_SIZE * n + b];
+        cur[STATE_BLOCK_SIZE * n + b] = src[STATE_BLOCK_SIZE * n + b];
+      }
+
+      /* (the padding is always zero in both) */
+      for (; b < STATE_BLOCK_SIZE * (m - n); b++)
+        dst[b] = 0;
+
+      dst += STATE_BLOCK_SIZE * (m - n);
+
+      num_skipped = 0;
+      n = m;
+    }
+  }
+
+  return dst - S_state_delta;
+}
+
+/******************************************************************************/
+/* state_ring_overlaps()                                                      */
+/******************************************************************************/
+static int state_ring_overlaps(unsigned long pos, unsigned long num_bytes)
+{
+  unsigned long k;
+  unsigned long index;
+  unsigned long first;
+
+  /* find where the oldest stored delta begins */
+  for (k = 0; k < G_state_num_snapshots; k++)
+  {
+    index = (S_state_first_record + k) % STATE_MAX_SNAPSHOTS;
+
+    if (S_state_record_size[index] > 0)
+      break;
+  }
+
+  if ((k == G_state_num_snapshots) || (num_bytes == 0))
+    return 0;
+
+  first = S_state_record_pos[index];
+
+  /* the deltas in use run from there to the end of the newest one, */
+  /* wrapping around the end of the buffer if need be               */
+  if (first < S_state_ring_end)
+    return (pos < S_state_ring_end) && (pos + num_bytes > first);
+
+  return (pos + num_bytes > first) || (pos < S_state_ring_end);
+}
+
+/******************************************************************************/
+/* state_store()                                                              */
+/******************************************************************************/
+static int state_store(unsigned long num_bytes)
+{
+  unsigned long pos;
+  unsigned long index;
+
+  /* a delta too big for the buffer breaks the chain */
+  if (num_bytes > S_state_rewind_limit)
+  {
+    G_state_num_snapshots = 0;
+    G_state_rewind_bytes = 0;
+
+    S_state_ring_end = 0;
+
+    return 1;
+  }
+
+  pos = S_state_ring_end;
+
+  if (pos + num_bytes > S_state_rewind_limit)
+    pos = 0;
+
+  /* evict the oldest deltas until this one fits */
+  while ( (G_state_num_snapshots > 0) &&
+          ((G_state_num_snapshots == STATE_MAX_SNAPSHOTS) ||
+           state_ring_overlaps(pos, num_bytes)))
+  {
+    G_state_rewind_bytes -= S_state_record_size[S_state_first_record];
+
+    S_state_first_record = (S_state_first_record + 1) % STATE_MAX_SNAPSHOTS;
+    G_state_num_snapshots -= 1;
+  }
+
+  memcpy(&S_state_ring[pos], S_state_delta, num_bytes);
+
+  index = (S_state_first_record + G_state_num_snapshots) % STATE_MAX_SNAPSHOTS;
+
+  S_state_record_pos[index] = pos;
+  S_state_record_size[index] = num_bytes;
+
+  G_state_num_snapshots += 1;
+  G_state_rewind_bytes += num_bytes;
+
+  S_state_ring_end = pos + num_bytes;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* state_push()                                                               */
+/******************************************************************************/
+int state_push()
+{
+  int k;
+
+  Uint64 start;
+
+  unsigned long image_size;
+  unsigned long delta_size;
+  unsigned long ns;
+
+  if (S_state_rewind_limit == 0)
+    return 1;
+
+  start = SDL_GetPerformanceCounter();
+
+  image_size = state_layout();
+
+  if (image_size == 0)
+    return 1;
+
+  /* the first state (or one of a new size) is kept whole */
+  if ((S_state_cur == NULL) || (image_size != S_state_image_size))
+  {
+    state_reset();
+
+    if (state_layout() == 0)
+      return 1;
+
+    S_state_cur = calloc(image_size, 1);
+    S_state_delta = malloc( image_size +
+                            STATE_COUNT_BOUND *
+                            (image_size / STATE_BLOCK_SIZE + 1));
+    S_state_ring = malloc(S_state_rewind_limit);
+
+    if ((S_state_cur == NULL) ||
+        (S_state_delta == NULL) ||
+        (S_state_ring == NULL))
+    {
+      state_reset();
+      return 1;
+    }
+
+    S_state_image_size = image_size;
+
+    for (k = 0; k < STATE_NUM_PARTS; k++)
+    {
+      memcpy( &S_state_cur[S_state_part_offset[k]],
+              S_state_part_ptr[k], S_state_part_size[k]);
+    }
+  }
+  else
+  {
+    delta_size = state_encode();
+    state_store(delta_size);
+  }
+
+  ns = state_elapsed_ns(start);
+
+  G_state_num_pushed += 1;
+  G_state_push_ns_total += ns;
+
+  if (ns > G_state_push_ns_max)
+    G_state_push_ns_max = ns;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* state_pop()                                                                */
+/******************************************************************************/
+int state_pop()
+{
+  Uint64 start;
+
+  unsigned long index;
+  unsigned long offset;
+  unsigned long count;
+  unsigned long bank_offset;
+  unsigned long first;
+  unsigned long last;
+  unsigned long b;
+  unsigned long ns;
+
+  unsigned char* src;
+  unsigned char* end;
+
+  if ((S_state_cur == NULL) || (G_state_num_snapshots == 0))
+    return 1;
+
+  start = SDL_GetPerformanceCounter();
+
+  /* take the newest delta */
+  G_state_num_snapshots -= 1;
+
+  index = (S_state_first_record + G_state_num_snapshots) % STATE_MAX_SNAPSHOTS;
+
+  src = &S_state_ring[S_state_record_pos[index]];
+  end = src + S_state_record_size[index];
+
+  G_state_rewind_bytes -= S_state_record_size[index];
+
+  /* xor it into the most recent state, to get the one before */
+  first = S_state_image_size;
+  last = 0;
+
+  offset = 0;
+
+  while (src < end)
+  {
+    src = state_read_count(src, &count);
+    offset += STATE_BLOCK_SIZE * count;
+
+    src = state_read_count(src, &count);
+    count *= STATE_BLOCK_SIZE;
+
+    if (offset < first)
+      first = offset;
+
+    for (b = 0; b < count; b++)
+      S_state_cur[offset + b] ^= src[b];
+
+    src += count;
+    offset += count;
+
+    last = offset;
+  }
+
+  /* its space is now free */
+  if (G_state_num_snapshots > 0)
+  {
+    index = (S_state_first_record + G_state_num_snapshots - 1) %
+            STATE_MAX_SNAPSHOTS;
+
+    S_state_ring_end = S_state_record_pos[index] + S_state_record_size[index];
+  }
+  else
+    S_state_ring_end = 0;
+
+  /* restore it (the whole thing, apart from the unchanged bank) */
+  bank_offset = S_state_part_offset[STATE_PART_BANK];
+
+  first = (first > bank_offset) ? (first - bank_offset) : 0;
+  last = (last > bank_offset) ? (last - bank_offset) : 0;
+
+  state_apply(S_state_cur, first, last);
+
+  ns = state_elapsed_ns(start);
+
+  G_state_num_popped += 1;
+  G_state_pop_ns_total += ns;
+
+  if (ns > G_state_pop_ns_max)
+    G_state_pop_ns_max = ns;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* state_save()                                                               */
+/******************************************************************************/
+int state_save(char* filename)
+{
+  int k;
+
+  FILE* fp;
+
+  Uint64 start;
+
+  unsigned long image_size;
+  unsigned long padding;
+
+  unsigned char zeros[STATE_BLOCK_SIZE];
+
+  if (filename == NULL)
+    return 1;
+
+  start = SDL_GetPerformanceCounter();
+
+  image_size = state_layout();
+
+  if (image_size == 0)
+    return 1;
+
+  fp = fopen(filename, "wb");
+
+  if (fp == NULL)
+    return 1;
+
+  /* the magic, the image size, and the image (the file is meant to be */
+  /* loaded on the same machine, so it is in the host's byte order)    */
+  memset(zeros, 0, sizeof(zeros));
+
+  if ((fwrite(STATE_MAGIC, 1, STATE_MAGIC_SIZE, fp) != STATE_MAGIC_SIZE) ||
+      (fwrite(&image_size, sizeof(image_size), 1, fp) != 1))
+  {
+    fclose(fp);
+    return 1;
+  }
+
+  for (k = 0; k < STATE_NUM_PARTS; k++)
+  {
+    padding = STATE_PAD(S_state_part_size[k]) - S_state_part_size[k];
+
+    if ((fwrite(S_state_part_ptr[k], 1,
+                S_state_part_size[k], fp) != S_state_part_size[k]) ||
+        (fwrite(zeros, 1, padding, fp) != padding))
+    {
+      fclose(fp);
+      return 1;
+    }
+  }
+
+  if (fclose(fp) != 0)
+    return 1;
+
+  G_state_save_ns = state_elapsed_ns(start);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* state_load()                                                               */
+/******************************************************************************/
+int state_load(char* filename)
+{
+  FILE* fp;
+
+  Uint64 start;
+
+  unsigned long image_size;
+  unsigned long file_image_size;
+
+  unsigned char* image;
+
+  char magic[STATE_MAGIC_SIZE];
+
+  if (filename == NULL)
+    return 1;
+
+  start = SDL_GetPerformanceCounter();
+
+  image_size = state_layout();
+
+  if (image_size == 0)
+    return 1;
+
+  fp = fopen(filename, "rb");
+
+  if (fp == NULL)
+    return 1;
+
+  /* (the rest of the checks are made once the image is read) */
+  if ((fread(magic, 1, STATE_MAGIC_SIZE, fp) != STATE_MAGIC_SIZE) ||
+      (fread(&file_image_size, sizeof(file_image_size), 1, fp) != 1) ||
+      (memcmp(magic, STATE_MAGIC, STATE_MAGIC_SIZE)) ||
+      (file_image_size != image_size))
+  {
+    fclose(fp);
+    return 1;
+  }
+
+  image = malloc(image_size);
+
+  if (image == NULL)
+  {
+    fclose(fp);
+    return 1;
+  }
+
+  if (fread(image, 1, image_size, fp) != image_size)
+  {
+    free(image);
+    fclose(fp);
+    return 1;
+  }
+
+  fclose(fp);
+
+  if (state_check(image))
+  {
+    free(image);
+    return 1;
+  }
+
+  /* restore it all, and start the rewind buffer over from here */
+  state_apply(image, 0, S_state_part_size[STATE_PART_BANK]);
+
+  free(image);
+
+  state_reset();
+
+  G_state_load_ns = state_elapsed_ns(start);
+
+  return 0;
+}
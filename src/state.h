@@ -0,0 +1,48 @@
+/******************************************************************************/
+/* state.h (save states & rewind)                                             */
+/******************************************************************************/
+
+#ifndef STATE_H
+#define STATE_H
+
+/* a state is the vdp registers & buffers, the animation state, and the */
+/* bank (unless it is the cart's own read only memory). the framebuffer */
+/* is not included, since it is redrawn from the rest.                  */
+#define STATE_FILENAME_DEFAULT      "state.kns"
+
+/* the rewind buffer keeps the most recent state, and a delta back to  */
+/* each one before it: the blocks that changed, xored with their older */
+/* contents, with runs of unchanged blocks skipped.                    */
+#define STATE_BLOCK_SIZE            8
+
+#define STATE_MAX_SNAPSHOTS         1024
+#define STATE_REWIND_LIMIT_DEFAULT  (1 << 23) /* 8 MB */
+
+/* statistics (times are in nanoseconds) */
+extern unsigned long G_state_num_snapshots;
+extern unsigned long G_state_rewind_bytes;
+
+extern unsigned long G_state_num_pushed;
+extern unsigned long G_state_num_popped;
+
+extern unsigned long G_state_push_ns_total;
+extern unsigned long G_state_push_ns_max;
+extern unsigned long G_state_pop_ns_total;
+extern unsigned long G_state_pop_ns_max;
+
+extern unsigned long G_state_save_ns;
+extern unsigned long G_state_load_ns;
+
+/* function declarations (state_reset() forgets the rewind buffer, */
+/* which must be done whenever a cart is loaded)                   */
+int state_set_rewind_limit(unsigned long num_bytes);
+
+int state_reset();
+
+int state_push();
+int state_pop();
+
+int state_save(char* filename);
+int state_load(char* filename);
+
+#endif
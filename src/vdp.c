@@ -8,8 +8,18 @@
 
 #include "vdp.h"
 
+#include "anim.h"
+#include "bank.h"
+#include "blit.h"
+#include "cell.h"
+#include "pcache.h"
+#include "pool.h"
+#include "prof.h"
+
 /* framebuffer */
-unsigned short G_vdp_fb_rgb[VDP_SCREEN_SIZE];
+static unsigned short S_vdp_fb_storage[VDP_SCREEN_SIZE];
+
+unsigned short* G_vdp_fb_rgb = S_vdp_fb_storage;
 
 /* nametable */
 unsigned short G_vdp_nametable_buf[VDP_NAMETABLE_SIZE];
@@ -19,19 +29,211 @@ unsigned long  G_vdp_nametable_num_words;
 unsigned short G_vdp_pals_buf[VDP_PALS_SIZE];
 unsigned long  G_vdp_pals_num_words;
 
+/* palettes converted to the format (rgb555 ones are drawn as they are) */
+static unsigned short S_vdp_pals_converted[VDP_PALS_SIZE];
+
+unsigned short* G_vdp_pals_native = G_vdp_pals_buf;
+
+/* pixel format, and the 16 bit format the palettes are converted to */
+static int            S_vdp_format = VDP_FORMAT_RGB555;
+static int            S_vdp_pals_format = VDP_FORMAT_RGB555;
+static int            S_vdp_pals_reconvert;
+
+/* rgb555 to a 16 bit format, for converting framebuffers */
+/* (built for one format at a time, when it is first needed) */
+#define VDP_NUM_COLORS (1 << 15)
+
+static unsigned short S_vdp_format_lut[VDP_NUM_COLORS];
+static int            S_vdp_lut_format = -1;
+
 /* cells */
-unsigned char  G_vdp_bank_buf[VDP_BANK_SIZE];
+static unsigned char S_vdp_bank_storage[VDP_BANK_SIZE];
+
+unsigned char* G_vdp_bank_buf = S_vdp_bank_storage;
 unsigned long  G_vdp_bank_num_bytes;
 
-/* registers (add in later!) */
+/* address of a byte of cell data (paged banks go through the page table) */
+#define VDP_BANK_PTR(addr)                                                     \
+  (G_bank_active ? BANK_PTR(addr) : &G_vdp_bank_buf[addr])
+
+/* tilemap */
+unsigned short G_vdp_tilemap_buf[VDP_TILEMAP_SIZE];
+unsigned long  G_vdp_tilemap_num_words;
+
+/* registers (add more in later!) */
+unsigned short G_vdp_bg_scroll_x;
+unsigned short G_vdp_bg_scroll_y;
+
+unsigned short G_vdp_bg_mode;
+
+unsigned short G_vdp_bg_matrix[VDP_MATRIX_SIZE];
+unsigned short G_vdp_bg_center_x;
+unsigned short G_vdp_bg_center_y;
+
+unsigned short G_vdp_bg_line_matrix[VDP_LINE_MATRIX_SIZE];
+
+/* signed value of a 16 bit register */
+#define VDP_SIGNED(val)                                                        \
+  ((long) (val) - (((val) & 0x8000) ? 0x10000L : 0L))
+
+/* layers (padded for the affine blitters) */
+static unsigned short S_vdp_bg_layer[VDP_LAYER_SIZE + BLIT_AFFINE_PAD];
+
+/* background tile tracking (each tile is redrawn into the layer only */
+/* when its tilemap entry, palette, or cell has changed)              */
+static unsigned short S_vdp_tilemap_shadow[VDP_TILEMAP_SIZE];
+static unsigned short S_vdp_pals_shadow[VDP_PALS_SIZE];
+
+static unsigned char  S_vdp_tile_dirty[VDP_MAX_TILES];
+static unsigned char  S_vdp_pal_dirty[VDP_MAX_PALS];
+
+static unsigned char  S_vdp_tile_row_changed[VDP_TILEMAP_H];
+
+/* scroll registers (latched at the start of each frame) */
+static int            S_vdp_bg_latch_x;
+static int            S_vdp_bg_latch_y;
+static int            S_vdp_bg_enabled;
+
+/* affine background (where each line starts in the layer, its step */
+/* per pixel, & the span of it that is drawn, all in 8.8 fixed point */
+/* and kept from frame to frame to find the lines that changed)      */
+static int            S_vdp_bg_affine;
+
+static unsigned long  S_vdp_affine_u[VDP_SCREEN_H];
+static unsigned long  S_vdp_affine_v[VDP_SCREEN_H];
+static unsigned long  S_vdp_affine_du[VDP_SCREEN_H];
+static unsigned long  S_vdp_affine_dv[VDP_SCREEN_H];
+static short          S_vdp_affine_first[VDP_SCREEN_H];
+static short          S_vdp_affine_last[VDP_SCREEN_H];
+
+static unsigned char  S_vdp_affine_changed[VDP_SCREEN_H];
+
+/* sprites (decoded from the nametable when their entry changes, */
+/* including the routine that draws each of their lines, and the */
+/* lines that are not entirely transparent, bit n for line n)    */
+typedef struct vdp_sprite
+{
+  short           pos_x;
+  short           pos_y;
+
+  short           num_columns;
+  short           num_rows;
+
+  unsigned short  pal_addr;
+  unsigned long   cell_addr;
+
+  unsigned long   lines_used;
+
+  pcache_entry*   cached;
+
+  int             (*draw_line)( unsigned short* line_buf, 
+                                struct vdp_sprite* spr, int row);
+} vdp_sprite;
+
+static vdp_sprite     S_vdp_sprites[VDP_MAX_ENTRIES];
+static unsigned char  S_vdp_sprite_changed[VDP_MAX_ENTRIES];
+static int            S_vdp_num_entries;
+
+/* bank size the sprites were decoded against (sprites that point */
+/* past the end are left out, so a new size means decoding again, */
+/* as does a change to the cells, which may empty their lines)    */
+static unsigned long  S_vdp_sprite_bank_size;
+static int            S_vdp_sprite_cells_changed;
+
+/* set to draw every sprite line with the generic routine */
+static int            S_vdp_generic_sprites = 0;
 
-/* layers */
-#define VDP_LAYER_W 512
-#define VDP_LAYER_H 512
+/* scanline sprite lists (the previous frame's lists are kept */
+/* so that lines whose sprites have not changed can be found) */
+#define VDP_LINE_LIST_SIZE (VDP_MAX_ENTRIES * VDP_SPRITE_MAX_W_H)
 
-#define VDP_LAYER_SIZE (VDP_LAYER_W * VDP_LAYER_H)
+static unsigned short S_vdp_line_list_buf[2][VDP_LINE_LIST_SIZE];
+static unsigned long  S_vdp_line_start_buf[2][VDP_SCREEN_H];
+static unsigned long  S_vdp_line_count_buf[2][VDP_SCREEN_H];
 
-static unsigned short S_vdp_bg_layer[VDP_LAYER_SIZE];
+static unsigned short* S_vdp_line_list = S_vdp_line_list_buf[0];
+static unsigned long*  S_vdp_line_start = S_vdp_line_start_buf[0];
+static unsigned long*  S_vdp_line_count = S_vdp_line_count_buf[0];
+
+static unsigned short* S_vdp_prev_line_list = S_vdp_line_list_buf[1];
+static unsigned long*  S_vdp_prev_line_start = S_vdp_line_start_buf[1];
+static unsigned long*  S_vdp_prev_line_count = S_vdp_line_count_buf[1];
+
+static int            S_vdp_line_limit = VDP_LINE_LIMIT_DEFAULT;
+
+/* bands (groups of lines drawn as one job) */
+#define VDP_BAND_H      8
+#define VDP_NUM_BANDS   (VDP_SCREEN_H / VDP_BAND_H)
+
+/* sprite bins (a bit per entry in each band it overlaps, kept up to date  */
+/* as entries change, so the lists are built from the onscreen sprites in  */
+/* each band, in nametable order, without visiting the rest)              */
+#define VDP_BIN_WORDS   (VDP_MAX_ENTRIES / 32)
+
+static unsigned long  S_vdp_bins[VDP_NUM_BANDS][VDP_BIN_WORDS];
+
+static short          S_vdp_sprite_bin_first[VDP_MAX_ENTRIES];
+static short          S_vdp_sprite_bin_last[VDP_MAX_ENTRIES];
+static int            S_vdp_num_binned;
+
+/* entries are decoded & rebinned only when they differ from the shadow */
+/* (or their animation frame has changed)                               */
+static unsigned short S_vdp_nametable_shadow[VDP_NAMETABLE_SIZE];
+static unsigned long  S_vdp_sprite_anim[VDP_MAX_ENTRIES];
+
+/* the build in which each sprite was last skipped, had lines dropped, */
+/* or had lines listed (so it was counted as drawn)                     */
+static unsigned long  S_vdp_sprite_skipped[VDP_MAX_ENTRIES];
+static unsigned long  S_vdp_sprite_dropped[VDP_MAX_ENTRIES];
+static unsigned long  S_vdp_sprite_listed[VDP_MAX_ENTRIES];
+static unsigned long  S_vdp_build_count;
+
+static unsigned short S_vdp_band_list[VDP_MAX_ENTRIES];
+
+/* bit index of a power of 2 (de bruijn sequence) */
+static const unsigned char S_vdp_bit_index[32] = 
+  { 0,  1, 28,  2, 29, 14, 24,  3, 30, 22, 20, 15, 25, 17,  4,  8, 
+   31, 27, 13, 23, 21, 19, 16,  7, 26, 12, 18,  6, 11,  5, 10,  9 };
+
+#define VDP_BIT_INDEX(bit)                                                     \
+  S_vdp_bit_index[(((bit) * 0x077CB531UL) & 0xFFFFFFFFUL) >> 27]
+
+static void*          S_vdp_draw_buf;
+static int            S_vdp_draw_pitch;
+static int            S_vdp_draw_wide;
+static int            S_vdp_draw_first;
+static int            S_vdp_draw_last;
+static int            S_vdp_draw_band_first;
+
+/* a line per band, for lines that are widened into the target */
+static unsigned short S_vdp_wide_buf[VDP_NUM_BANDS][VDP_SCREEN_W];
+
+/* change tracking (the frame in which each line last changed, and */
+/* the frame each render target was last brought up to date with)  */
+#define VDP_MAX_TARGETS 4
+
+static unsigned long  S_vdp_frame_count;
+static unsigned long  S_vdp_line_frame[VDP_SCREEN_H];
+
+static void*          S_vdp_target_id[VDP_MAX_TARGETS];
+static unsigned long  S_vdp_target_frame[VDP_MAX_TARGETS];
+static int            S_vdp_target_next;
+
+static int            S_vdp_redraw_all;
+
+int            G_vdp_dirty_first;
+int            G_vdp_dirty_last;
+
+/* statistics */
+unsigned long  G_vdp_num_sprites_drawn;
+unsigned long  G_vdp_num_sprites_visited;
+unsigned long  G_vdp_num_sprites_culled;
+unsigned long  G_vdp_num_sprites_dropped;
+unsigned long  G_vdp_num_sprites_unpaged;
+
+unsigned long  G_vdp_num_sprite_lines;
+
+unsigned long  G_vdp_num_tiles_drawn;
 
 /******************************************************************************/
 /* vdp_reset()                                                                */
@@ -40,127 +242,1749 @@ int vdp_reset()
 {
   unsigned long k;
 
-  /* framebuffer */
-  for (k = 0; k < VDP_SCREEN_SIZE; k++)
-    G_vdp_fb_rgb[k] = 0x0000;
+  /* only the parts of each buffer used since the last reset can be */
+  /* nonzero, so only those are cleared (a second reset is free)    */
+
+  /* framebuffer (untouched unless a frame was drawn) */
+  if (S_vdp_frame_count > 0)
+    memset(G_vdp_fb_rgb, 0, VDP_SCREEN_SIZE * sizeof(unsigned short));
 
   /* nametable */
-  for (k = 0; k < VDP_NAMETABLE_SIZE; k++)
-    G_vdp_nametable_buf[k] = 0;
+  if (G_vdp_nametable_num_words > VDP_NAMETABLE_SIZE)
+    G_vdp_nametable_num_words = VDP_NAMETABLE_SIZE;
+
+  memset( G_vdp_nametable_buf, 0, 
+          G_vdp_nametable_num_words * sizeof(unsigned short));
 
   G_vdp_nametable_num_words = 0;
 
-  /* palettes */
-  for (k = 0; k < VDP_PALS_SIZE; k++)
-    G_vdp_pals_buf[k] = 0;
+  /* animation (every entry back to its first frame) */
+  anim_reset();
+
+  /* palettes (the shadow copy matches them after each frame) */
+  if (G_vdp_pals_num_words > VDP_PALS_SIZE)
+    G_vdp_pals_num_words = VDP_PALS_SIZE;
+
+  memset(G_vdp_pals_buf, 0, G_vdp_pals_num_words * sizeof(unsigned short));
+  memset(S_vdp_pals_shadow, 0, G_vdp_pals_num_words * sizeof(unsigned short));
+  memset( S_vdp_pals_converted, 0, 
+          G_vdp_pals_num_words * sizeof(unsigned short));
 
   G_vdp_pals_num_words = 0;
 
-  /* cells */
-  for (k = 0; k < VDP_BANK_SIZE; k++)
-    G_vdp_bank_buf[k] = 0;
+  /* cells (a mapped or paged cart's bank is not ours to clear) */
+  if ((G_bank_active == 0) && (G_vdp_bank_buf == S_vdp_bank_storage))
+  {
+    if (G_vdp_bank_num_bytes > VDP_BANK_SIZE)
+      G_vdp_bank_num_bytes = VDP_BANK_SIZE;
+
+    memset(S_vdp_bank_storage, 0, G_vdp_bank_num_bytes);
+  }
 
+  G_vdp_bank_buf = S_vdp_bank_storage;
   G_vdp_bank_num_bytes = 0;
 
-  /* layers */
-  for (k = 0; k < VDP_LAYER_SIZE; k++)
-    S_vdp_bg_layer[k] = 0x0000;
+  cell_clear_cache();
+  pcache_clear();
+
+  /* tilemap (the layer itself is not cleared, since every */
+  /* tile is redrawn into it before it is next read)       */
+  if (G_vdp_tilemap_num_words > VDP_TILEMAP_SIZE)
+    G_vdp_tilemap_num_words = VDP_TILEMAP_SIZE;
+
+  memset( G_vdp_tilemap_buf, 0, 
+          G_vdp_tilemap_num_words * sizeof(unsigned short));
+  memset( S_vdp_tilemap_shadow, 0, 
+          G_vdp_tilemap_num_words * sizeof(unsigned short));
+
+  G_vdp_tilemap_num_words = 0;
+
+  /* registers */
+  G_vdp_bg_scroll_x = 0;
+  G_vdp_bg_scroll_y = 0;
+
+  G_vdp_bg_mode = 0;
+
+  memset(G_vdp_bg_matrix, 0, sizeof(G_vdp_bg_matrix));
+  G_vdp_bg_center_x = 0;
+  G_vdp_bg_center_y = 0;
+
+  memset(G_vdp_bg_line_matrix, 0, sizeof(G_vdp_bg_line_matrix));
+
+  /* background tile tracking (force a full redraw) */
+  memset(S_vdp_tile_dirty, 1, sizeof(S_vdp_tile_dirty));
+  memset(S_vdp_pal_dirty, 0, sizeof(S_vdp_pal_dirty));
+
+  S_vdp_bg_enabled = 0;
+  S_vdp_bg_affine = 0;
+
+  /* sprites (every entry is decoded again, so only the bins need clearing) */
+  if (S_vdp_num_binned > 0)
+    memset(S_vdp_bins, 0, sizeof(S_vdp_bins));
+
+  memset(S_vdp_sprite_bin_first, 0, S_vdp_num_entries * sizeof(short));
+  memset(S_vdp_sprite_bin_last, 0, S_vdp_num_entries * sizeof(short));
+
+  S_vdp_num_binned = 0;
+  S_vdp_num_entries = 0;
+
+  memset(S_vdp_line_count, 0, VDP_SCREEN_H * sizeof(unsigned long));
+  memset(S_vdp_prev_line_count, 0, VDP_SCREEN_H * sizeof(unsigned long));
+
+  /* change tracking (force a full redraw) */
+  S_vdp_frame_count = 0;
+
+  memset(S_vdp_line_frame, 0, sizeof(S_vdp_line_frame));
+
+  for (k = 0; k < VDP_MAX_TARGETS; k++)
+  {
+    S_vdp_target_id[k] = NULL;
+    S_vdp_target_frame[k] = 0;
+  }
+
+  S_vdp_target_next = 0;
+
+  S_vdp_redraw_all = 1;
+
+  G_vdp_dirty_first = 0;
+  G_vdp_dirty_last = 0;
+
+  /* statistics */
+  G_vdp_num_sprites_drawn = 0;
+  G_vdp_num_sprites_visited = 0;
+  G_vdp_num_sprites_culled = 0;
+  G_vdp_num_sprites_dropped = 0;
+  G_vdp_num_sprites_unpaged = 0;
+
+  G_vdp_num_sprite_lines = 0;
+
+  G_vdp_num_tiles_drawn = 0;
 
   return 0;
 }
 
 /******************************************************************************/
-/* vdp_draw_frame()                                                           */
+/* vdp_set_line_limit()                                                       */
 /******************************************************************************/
-int vdp_draw_frame()
+int vdp_set_line_limit(int limit)
+{
+  if ((limit < 1) || (limit > VDP_MAX_ENTRIES))
+    return 1;
+
+  /* (a different limit may draw different sprites on any line) */
+  if (limit != S_vdp_line_limit)
+    S_vdp_redraw_all = 1;
+
+  S_vdp_line_limit = limit;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_set_generic_sprites()                                                  */
+/******************************************************************************/
+int vdp_set_generic_sprites(int generic)
+{
+  /* (both routines draw the same pixels, so nothing is redrawn) */
+  S_vdp_generic_sprites = (generic != 0) ? 1 : 0;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_set_format()                                                           */
+/******************************************************************************/
+int vdp_set_format(int format)
+{
+  int pals_format;
+
+  if ((format < 0) || (format >= VDP_NUM_FORMATS))
+    return 1;
+
+  S_vdp_format = format;
+
+  /* the palettes are converted again if their format has changed */
+  if (VDP_FORMAT_BYTES(format) == 2)
+    pals_format = format;
+  else
+    pals_format = VDP_FORMAT_RGB555;
+
+  if (pals_format != S_vdp_pals_format)
+  {
+    S_vdp_pals_format = pals_format;
+
+    if (pals_format == VDP_FORMAT_RGB555)
+      G_vdp_pals_native = G_vdp_pals_buf;
+    else
+      G_vdp_pals_native = S_vdp_pals_converted;
+
+    S_vdp_pals_reconvert = 1;
+    S_vdp_redraw_all = 1;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_convert_color()                                                        */
+/******************************************************************************/
+unsigned long vdp_convert_color(int format, unsigned short color)
+{
+  unsigned long r;
+  unsigned long g;
+  unsigned long b;
+
+  r = (color >> 10) & 0x1F;
+  g = (color >> 5) & 0x1F;
+  b = color & 0x1F;
+
+  /* (5 bit channels are widened by repeating their top bits) */
+  if (format == VDP_FORMAT_RGB565)
+    return (r << 11) | (((g << 1) | (g >> 4)) << 5) | b;
+  else if (format == VDP_FORMAT_BGR555)
+    return (b << 10) | (g << 5) | r;
+  else if (format == VDP_FORMAT_BGR565)
+    return (b << 11) | (((g << 1) | (g >> 4)) << 5) | r;
+  else if (format == VDP_FORMAT_ARGB8888)
+  {
+    return 0xFF000000UL | 
+           (((r << 3) | (r >> 2)) << 16) | 
+           (((g << 3) | (g >> 2)) << 8) | 
+           ((b << 3) | (b >> 2));
+  }
+  else if (format == VDP_FORMAT_ABGR8888)
+  {
+    return 0xFF000000UL | 
+           (((b << 3) | (b >> 2)) << 16) | 
+           (((g << 3) | (g >> 2)) << 8) | 
+           ((r << 3) | (r >> 2));
+  }
+
+  return color & 0x7FFF;
+}
+
+/******************************************************************************/
+/* vdp_build_format_lut()                                                     */
+/******************************************************************************/
+static void vdp_build_format_lut(int format)
+{
+  unsigned long k;
+
+  if (format == S_vdp_lut_format)
+    return;
+
+  for (k = 0; k < VDP_NUM_COLORS; k++)
+  {
+    S_vdp_format_lut[k] = 
+      (unsigned short) vdp_convert_color(format, (unsigned short) k);
+  }
+
+  S_vdp_lut_format = format;
+}
+
+/******************************************************************************/
+/* vdp_widen_line()                                                           */
+/******************************************************************************/
+static void vdp_widen_line(unsigned int* dst, unsigned short* src, int format)
+{
+  int m;
+
+  unsigned int p;
+  unsigned int w;
+
+  /* widen a line to a 32 bit format, as vdp_convert_color() does */
+  /* (shifting rather than looking up each pixel vectorizes well)  */
+  if (format == VDP_FORMAT_ABGR8888)
+  {
+    for (m = 0; m < VDP_SCREEN_W; m++)
+    {
+      p = src[m];
+      w = ((p & 0x7C00) >> 7) | ((p & 0x03E0) << 6) | ((p & 0x001F) << 19);
+
+      dst[m] = 0xFF000000 | w | ((w >> 5) & 0x070707);
+    }
+  }
+  else
+  {
+    for (m = 0; m < VDP_SCREEN_W; m++)
+    {
+      p = src[m];
+      w = ((p & 0x7C00) << 9) | ((p & 0x03E0) << 6) | ((p & 0x001F) << 3);
+
+      dst[m] = 0xFF000000 | w | ((w >> 5) & 0x070707);
+    }
+  }
+}
+
+/******************************************************************************/
+/* vdp_convert_lines()                                                        */
+/******************************************************************************/
+int vdp_convert_lines(void* dst, int dst_pitch, int format, 
+                      unsigned short* src, int src_pitch, int num_lines)
 {
   int m;
   int n;
 
-  unsigned short val;
+  unsigned short* dst_16;
+
+  if ((format < 0) || (format >= VDP_NUM_FORMATS))
+    return 1;
 
-  unsigned short nametable_index;
+  /* convert rgb555 lines to the format (pitches are in pixels) */
+  if (VDP_FORMAT_BYTES(format) == 4)
+  {
+    for (n = 0; n < num_lines; n++, src += src_pitch)
+      vdp_widen_line((unsigned int*) dst + dst_pitch * n, src, format);
 
-  unsigned short num_rows;
-  unsigned short num_columns;
-  unsigned short num_frames;
-  unsigned short delay_time;
+    return 0;
+  }
 
-  unsigned short thing_pos_x;
-  unsigned short thing_pos_y;
+  vdp_build_format_lut(format);
 
-  unsigned short pal_addr;
-  unsigned short pal_offset;
+  for (n = 0; n < num_lines; n++, src += src_pitch)
+  {
+    dst_16 = (unsigned short*) dst + dst_pitch * n;
+
+    for (m = 0; m < VDP_SCREEN_W; m++)
+      dst_16[m] = S_vdp_format_lut[src[m] & 0x7FFF];
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_invalidate_cells()                                                     */
+/******************************************************************************/
+int vdp_invalidate_cells(unsigned long addr, unsigned long num_bytes)
+{
+  int k;
+
+  unsigned long cell_addr;
+
+  /* refresh the decoded copies of these cells */
+  cell_update_cache(addr, num_bytes);
+  pcache_invalidate_cells(addr, num_bytes);
+
+  /* redraw any background tiles that use them */
+  for (k = 0; k < VDP_MAX_TILES; k++)
+  {
+    cell_addr = (G_vdp_tilemap_buf[VDP_TILE_SIZE * k + 0] << 8) & 0x3F0000;
+    cell_addr |= G_vdp_tilemap_buf[VDP_TILE_SIZE * k + 1] & 0x00FFFF;
+    cell_addr *= VDP_BYTES_PER_CELL;
+
+    if ((cell_addr + VDP_BYTES_PER_CELL > addr) && 
+        (cell_addr < addr + num_bytes))
+    {
+      S_vdp_tile_dirty[k] = 1;
+    }
+  }
+
+  /* sprites may use them anywhere on screen */
+  S_vdp_sprite_cells_changed = 1;
+  S_vdp_redraw_all = 1;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_invalidate_frame()                                                     */
+/******************************************************************************/
+int vdp_invalidate_frame()
+{
+  S_vdp_redraw_all = 1;
+
+  return 0;
+}
 
-  unsigned long  cell_addr;
-  unsigned long  cell_offset;
+/******************************************************************************/
+/* vdp_draw_tile()                                                            */
+/******************************************************************************/
+static int vdp_draw_tile(int tile)
+{
+  int n;
+
+  int result;
+
+  unsigned char  rows_used;
+  unsigned char  rows_opaque;
+
+  unsigned short val;
 
-  unsigned long  pixel_addr;
-  unsigned long  pixel_offset;
+  unsigned long  cell_index;
 
-  /* clear framebuffer */
-  for (m = 0; m < VDP_SCREEN_SIZE; m++)
-    G_vdp_fb_rgb[m] = 0x0000;
+  unsigned short* pal;
+  unsigned short* layer_buf;
 
-  /* test: draw the test sprite */
-  nametable_index = 0;
+  /* decode the tilemap entry */
+  val = G_vdp_tilemap_buf[VDP_TILE_SIZE * tile + 0];
 
-  val = G_vdp_nametable_buf[VDP_ENTRY_SIZE * nametable_index + 0];
+  pal = &G_vdp_pals_native[(val & 0x00FF) * VDP_COLORS_PER_PAL];
 
-  pal_addr = (val & 0x00FF) * VDP_COLORS_PER_PAL;
+  cell_index = (val << 8) & 0x3F0000;
 
-  val = G_vdp_nametable_buf[VDP_ENTRY_SIZE * nametable_index + 1];
+  val = G_vdp_tilemap_buf[VDP_TILE_SIZE * tile + 1];
+
+  cell_index |= val & 0x00FFFF;
+
+  /* make sure the cell exists (& is resident, if the bank is paged) */
+  if (VDP_BYTES_PER_CELL * (cell_index + 1) > G_vdp_bank_num_bytes)
+    result = 0;
+  else if (G_bank_active)
+    result = bank_touch(VDP_BYTES_PER_CELL * cell_index, VDP_BYTES_PER_CELL);
+  else
+    result = 0;
+
+  /* note the rows to clear & to draw (all of them, if the cell is */
+  /* unclassified, and none, if it is missing or not resident)     */
+  if ((VDP_BYTES_PER_CELL * (cell_index + 1) > G_vdp_bank_num_bytes) || 
+      (result != 0))
+  {
+    rows_used = 0;
+    rows_opaque = 0;
+  }
+  else if (cell_index < G_cell_num_classified)
+  {
+    rows_used = G_cell_rows_used[cell_index];
+    rows_opaque = G_cell_rows_opaque[cell_index];
+  }
+  else
+  {
+    rows_used = CELL_ALL_ROWS;
+    rows_opaque = 0;
+  }
 
-  num_columns = ((val >> 13) & 0x0003) + 1;
-  num_rows = ((val >> 11) & 0x0003) + 1;
-  num_frames = ((val >> 8) & 0x0007) + 1;
+  /* clear the tile in the layer (apart from its opaque rows), then */
+  /* draw its cell on top (apart from its empty rows)               */
+  layer_buf = &S_vdp_bg_layer[VDP_LAYER_W * VDP_CELL_W_H * 
+                              (tile / VDP_TILEMAP_W)];
+  layer_buf += VDP_CELL_W_H * (tile % VDP_TILEMAP_W);
 
-  val = G_vdp_nametable_buf[VDP_ENTRY_SIZE * nametable_index + 2];
+  for (n = 0; n < VDP_CELL_W_H; n++, layer_buf += VDP_LAYER_W)
+  {
+    if ((rows_opaque & (1 << n)) == 0)
+      memset(layer_buf, 0, VDP_CELL_W_H * sizeof(unsigned short));
 
-  cell_addr = (val << 16) & 0x3F0000;
+    if ((rows_used & (1 << n)) == 0)
+      continue;
 
-  val = G_vdp_nametable_buf[VDP_ENTRY_SIZE * nametable_index + 3];
+    if (cell_index < G_cell_num_cached)
+    {
+      G_blit_cells_8bpp(layer_buf, 
+                        &G_cell_pixels[CELL_PIXEL_BYTES * cell_index + 
+                                       VDP_CELL_W_H * n], 
+                        &G_cell_masks[CELL_MASK_BYTES * cell_index + n], 
+                        1, pal);
+    }
+    else
+    {
+      G_blit_cells_4bpp(layer_buf, 
+                        VDP_BANK_PTR(VDP_BYTES_PER_CELL * cell_index + 
+                                     (VDP_CELL_W_H / 2) * n), 
+                        1, pal);
+    }
+  }
 
-  cell_addr |= val & 0x00FFFF;
+  return result;
+}
 
-  cell_addr *= VDP_BYTES_PER_CELL;
+/******************************************************************************/
+/* vdp_check_pals()                                                           */
+/******************************************************************************/
+static int vdp_check_pals()
+{
+  int k;
+  int n;
 
-  val = G_vdp_nametable_buf[VDP_ENTRY_SIZE * nametable_index + 4];
+  int changed;
 
-  thing_pos_x = 128;
-  thing_pos_y = 64;
+  /* find palettes that have changed since the last frame (or all */
+  /* of them, if the format has changed), and convert them         */
+  changed = 0;
 
-  for (m = 0; m < num_rows * num_columns; m++)
+  for (k = 0; k < VDP_MAX_PALS; k++)
   {
-    /* determine pixel address */
-    pixel_addr = VDP_SCREEN_W * thing_pos_y + thing_pos_x;
-    pixel_addr += VDP_SCREEN_W * VDP_CELL_W_H * (m / num_columns);
-    pixel_addr += VDP_CELL_W_H * (m % num_columns);
+    S_vdp_pal_dirty[k] = 0;
 
-    for (n = 0; n < VDP_PIXELS_PER_CELL; n++)
+    if ((S_vdp_pals_reconvert != 0) || 
+        memcmp( &S_vdp_pals_shadow[VDP_COLORS_PER_PAL * k], 
+                &G_vdp_pals_buf[VDP_COLORS_PER_PAL * k], 
+                VDP_COLORS_PER_PAL * sizeof(unsigned short)))
     {
-      /* determine cell & pixel offsets */
-      cell_offset = (VDP_BYTES_PER_CELL * m) + (n / 2);
+      memcpy( &S_vdp_pals_shadow[VDP_COLORS_PER_PAL * k], 
+              &G_vdp_pals_buf[VDP_COLORS_PER_PAL * k], 
+              VDP_COLORS_PER_PAL * sizeof(unsigned short));
 
-      pixel_offset = VDP_SCREEN_W * (n / VDP_CELL_W_H);
-      pixel_offset += n % VDP_CELL_W_H;
+      if (S_vdp_pals_format != VDP_FORMAT_RGB555)
+      {
+        for (n = VDP_COLORS_PER_PAL * k; n < VDP_COLORS_PER_PAL * (k + 1); n++)
+        {
+          S_vdp_pals_converted[n] = (unsigned short) 
+            vdp_convert_color(S_vdp_pals_format, G_vdp_pals_buf[n]);
+        }
+      }
 
-      /* read palette offset from cell */
-      if (n % 2 == 0)
-        pal_offset = (G_vdp_bank_buf[cell_addr + cell_offset] >> 4) & 0x0F;
-      else
-        pal_offset = G_vdp_bank_buf[cell_addr + cell_offset] & 0x0F;
+      S_vdp_pal_dirty[k] = 1;
+      changed = 1;
 
-      /* write pixel to the frame buffer */
-      if (pal_offset == 0)
-        continue;
+      pcache_invalidate_pal(k);
+    }
+  }
 
-      val = G_vdp_pals_buf[pal_addr + pal_offset];
+  S_vdp_pals_reconvert = 0;
 
-      G_vdp_fb_rgb[pixel_addr + pixel_offset] = val;
+  return changed;
+}
+
+/******************************************************************************/
+/* vdp_update_bg_layer()                                                      */
+/******************************************************************************/
+static int vdp_update_bg_layer()
+{
+  int k;
+
+  unsigned short pal;
+
+  for (k = 0; k < VDP_TILEMAP_H; k++)
+    S_vdp_tile_row_changed[k] = 0;
+
+  /* redraw tiles whose entry, palette, or cell has changed */
+  for (k = 0; k < VDP_MAX_TILES; k++)
+  {
+    pal = G_vdp_tilemap_buf[VDP_TILE_SIZE * k + 0] & 0x00FF;
+
+    if ((S_vdp_tile_dirty[k] == 0)                                    && 
+        (S_vdp_pal_dirty[pal] == 0)                                   && 
+        (S_vdp_tilemap_shadow[VDP_TILE_SIZE * k + 0] == 
+         G_vdp_tilemap_buf[VDP_TILE_SIZE * k + 0])                    && 
+        (S_vdp_tilemap_shadow[VDP_TILE_SIZE * k + 1] == 
+         G_vdp_tilemap_buf[VDP_TILE_SIZE * k + 1]))
+    {
+      continue;
     }
+
+    /* a tile whose page could not be loaded is retried next frame */
+    S_vdp_tile_dirty[k] = vdp_draw_tile(k) ? 1 : 0;
+
+    S_vdp_tilemap_shadow[VDP_TILE_SIZE * k + 0] = 
+      G_vdp_tilemap_buf[VDP_TILE_SIZE * k + 0];
+    S_vdp_tilemap_shadow[VDP_TILE_SIZE * k + 1] = 
+      G_vdp_tilemap_buf[VDP_TILE_SIZE * k + 1];
+
+    S_vdp_tile_row_changed[k / VDP_TILEMAP_W] = 1;
+
+    G_vdp_num_tiles_drawn += 1;
   }
 
   return 0;
 }
 
+/******************************************************************************/
+/* vdp_clip_affine()                                                          */
+/******************************************************************************/
+static void vdp_clip_affine(double pos, double step, double limit, 
+                            int* first, int* last)
+{
+  double lo;
+  double hi;
+
+  /* narrow [first, last) to the pixels x where 0 <= pos + x * step < limit */
+  /* (estimated a pixel wide on either side, then checked exactly, since   */
+  /* the positions are whole numbers well within a double's precision)     */
+  if (step > 0)
+  {
+    lo = -pos / step - 1;
+    hi = (limit - pos) / step + 1;
+  }
+  else if (step < 0)
+  {
+    lo = (limit - pos) / step - 1;
+    hi = -pos / step + 1;
+  }
+  else
+  {
+    lo = *first;
+    hi = *last;
+  }
+
+  if (lo > *first)
+    *first = (lo < *last) ? (int) lo : *last;
+
+  if (hi < *last)
+    *last = (hi > *first) ? (int) hi + 1 : *first;
+
+  while ((*first < *last) && 
+         ((pos + *first * step < 0) || (pos + *first * step >= limit)))
+  {
+    *first += 1;
+  }
+
+  while ((*last > *first) && 
+         ((pos + (*last - 1) * step < 0) || 
+          (pos + (*last - 1) * step >= limit)))
+  {
+    *last -= 1;
+  }
+}
+
+/******************************************************************************/
+/* vdp_setup_affine()                                                         */
+/******************************************************************************/
+static int vdp_setup_affine()
+{
+  int n;
+
+  int first;
+  int last;
+
+  long a;
+  long b;
+  long c;
+  long d;
+
+  long pos_x;
+  long pos_y;
+  long center_x;
+  long center_y;
+
+  unsigned long u;
+  unsigned long v;
+
+  unsigned short* matrix;
+
+  center_x = VDP_SIGNED(G_vdp_bg_center_x);
+  center_y = VDP_SIGNED(G_vdp_bg_center_y);
+
+  pos_x = VDP_SIGNED(G_vdp_bg_scroll_x) - center_x;
+
+  for (n = 0; n < VDP_SCREEN_H; n++)
+  {
+    if (G_vdp_bg_mode & VDP_BG_MODE_PER_LINE)
+      matrix = &G_vdp_bg_line_matrix[VDP_MATRIX_SIZE * n];
+    else
+      matrix = G_vdp_bg_matrix;
+
+    a = VDP_SIGNED(matrix[VDP_MATRIX_A]);
+    b = VDP_SIGNED(matrix[VDP_MATRIX_B]);
+    c = VDP_SIGNED(matrix[VDP_MATRIX_C]);
+    d = VDP_SIGNED(matrix[VDP_MATRIX_D]);
+
+    pos_y = n + VDP_SIGNED(G_vdp_bg_scroll_y) - center_y;
+
+    /* the start of the line (unsigned, so that it wraps around) */
+    u = (unsigned long) a * (unsigned long) pos_x + 
+        (unsigned long) b * (unsigned long) pos_y + 
+        (unsigned long) center_x * 256;
+    v = (unsigned long) c * (unsigned long) pos_x + 
+        (unsigned long) d * (unsigned long) pos_y + 
+        (unsigned long) center_y * 256;
+
+    /* the part of the line that is over the layer, if it is clipped */
+    first = 0;
+    last = VDP_SCREEN_W;
+
+    if (G_vdp_bg_mode & VDP_BG_MODE_CLIP)
+    {
+      vdp_clip_affine((double) a * pos_x + (double) b * pos_y + 
+                        center_x * 256.0, 
+                      (double) a, VDP_LAYER_W * 256.0, &first, &last);
+      vdp_clip_affine((double) c * pos_x + (double) d * pos_y + 
+                        center_y * 256.0, 
+                      (double) c, VDP_LAYER_H * 256.0, &first, &last);
+    }
+
+    /* note whether the line has changed since the last frame */
+    S_vdp_affine_changed[n] = 0;
+
+    if ((S_vdp_affine_u[n] != u)                                        || 
+        (S_vdp_affine_v[n] != v)                                        || 
+        (S_vdp_affine_du[n] != (unsigned long) a)                       || 
+        (S_vdp_affine_dv[n] != (unsigned long) c)                       || 
+        (S_vdp_affine_first[n] != first)                                || 
+        (S_vdp_affine_last[n] != last))
+    {
+      S_vdp_affine_u[n] = u;
+      S_vdp_affine_v[n] = v;
+      S_vdp_affine_du[n] = (unsigned long) a;
+      S_vdp_affine_dv[n] = (unsigned long) c;
+      S_vdp_affine_first[n] = (short) first;
+      S_vdp_affine_last[n] = (short) last;
+
+      S_vdp_affine_changed[n] = 1;
+    }
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_bin_sprite()                                                           */
+/******************************************************************************/
+static void vdp_bin_sprite(int m, int bin_first, int bin_last)
+{
+  int b;
+
+  unsigned long bit;
+
+  if ((bin_first == S_vdp_sprite_bin_first[m]) && 
+      (bin_last == S_vdp_sprite_bin_last[m]))
+  {
+    return;
+  }
+
+  bit = 1UL << (m % 32);
+
+  /* move the sprite from the bands it was in to the ones it is in now */
+  if (S_vdp_sprite_bin_first[m] < S_vdp_sprite_bin_last[m])
+  {
+    for (b = S_vdp_sprite_bin_first[m]; b < S_vdp_sprite_bin_last[m]; b++)
+      S_vdp_bins[b][m / 32] &= ~bit;
+
+    S_vdp_num_binned -= 1;
+  }
+
+  if (bin_first < bin_last)
+  {
+    for (b = bin_first; b < bin_last; b++)
+      S_vdp_bins[b][m / 32] |= bit;
+
+    S_vdp_num_binned += 1;
+  }
+
+  S_vdp_sprite_bin_first[m] = (short) bin_first;
+  S_vdp_sprite_bin_last[m] = (short) bin_last;
+}
+
+/* sprite line routines (defined with the rest of the drawing code) */
+static int vdp_draw_sprite_line(unsigned short* line_buf, 
+                                vdp_sprite* spr, int row);
+
+static int vdp_draw_sprite_line_1(unsigned short* line_buf, 
+                                  vdp_sprite* spr, int row);
+static int vdp_draw_sprite_line_2(unsigned short* line_buf, 
+                                  vdp_sprite* spr, int row);
+static int vdp_draw_sprite_line_3(unsigned short* line_buf, 
+                                  vdp_sprite* spr, int row);
+static int vdp_draw_sprite_line_4(unsigned short* line_buf, 
+                                  vdp_sprite* spr, int row);
+
+/******************************************************************************/
+/* vdp_decode_sprite()                                                        */
+/******************************************************************************/
+static void vdp_decode_sprite(int m)
+{
+  unsigned short val;
+
+  unsigned long  cell_bytes;
+  unsigned long  cell_index;
+
+  int line_last;
+
+  int c;
+  int r;
+
+  vdp_sprite* spr;
+
+  spr = &S_vdp_sprites[m];
+
+  val = G_vdp_nametable_buf[VDP_ENTRY_SIZE * m + 0];
+
+  spr->pal_addr = (val & 0x00FF) * VDP_COLORS_PER_PAL;
+  spr->pos_x = val & 0x0100;
+  spr->pos_y = (val >> 1) & 0x0100;
+
+  val = G_vdp_nametable_buf[VDP_ENTRY_SIZE * m + 1];
+
+  spr->num_columns = ((val >> 13) & 0x0003) + 1;
+  spr->num_rows = ((val >> 11) & 0x0003) + 1;
+
+  /* reschedule the animation if its frames or delay have changed */
+  if (val != G_anim_control[m])
+    anim_update_entry(m);
+
+  val = G_vdp_nametable_buf[VDP_ENTRY_SIZE * m + 2];
+
+  spr->cell_addr = (val << 16) & 0x3F0000;
+
+  val = G_vdp_nametable_buf[VDP_ENTRY_SIZE * m + 3];
+
+  spr->cell_addr |= val & 0x00FFFF;
+  spr->cell_addr *= VDP_BYTES_PER_CELL;
+  spr->cell_addr += G_anim_cell_offset[m];
+
+  S_vdp_sprite_anim[m] = G_anim_cell_offset[m];
+
+  val = G_vdp_nametable_buf[VDP_ENTRY_SIZE * m + 4];
+
+  spr->pos_x |= (val >> 8) & 0x00FF;
+  spr->pos_y |= val & 0x00FF;
+
+  /* wrap positions that cross the edge of the coordinate space */
+  if (spr->pos_x + VDP_CELL_W_H * spr->num_columns > VDP_POS_WRAP)
+    spr->pos_x -= VDP_POS_WRAP;
+
+  if (spr->pos_y + VDP_CELL_W_H * spr->num_rows > VDP_POS_WRAP)
+    spr->pos_y -= VDP_POS_WRAP;
+
+  /* leave sprites that are offscreen or point past the end */
+  /* of the bank out of the bins                            */
+  cell_bytes = VDP_BYTES_PER_CELL * spr->num_columns * spr->num_rows;
+
+  if ((spr->pos_x >= VDP_SCREEN_W)                                      || 
+      (spr->pos_x + VDP_CELL_W_H * spr->num_columns <= 0)               || 
+      (spr->pos_y >= VDP_SCREEN_H)                                      || 
+      (spr->pos_y + VDP_CELL_W_H * spr->num_rows <= 0)                  || 
+      (spr->cell_addr + cell_bytes > G_vdp_bank_num_bytes))
+  {
+    vdp_bin_sprite(m, 0, 0);
+    return;
+  }
+
+  line_last = spr->pos_y + VDP_CELL_W_H * spr->num_rows;
+
+  if (line_last > VDP_SCREEN_H)
+    line_last = VDP_SCREEN_H;
+
+  /* find the lines with opaque pixels in any of their cells (all of */
+  /* them, if the cells are unclassified)                            */
+  cell_index = spr->cell_addr / VDP_BYTES_PER_CELL;
+
+  if (cell_index + spr->num_columns * spr->num_rows > G_cell_num_classified)
+    spr->lines_used = ~0UL;
+  else
+  {
+    spr->lines_used = 0;
+
+    for (r = 0; r < spr->num_rows; r++)
+    {
+      for (c = 0; c < spr->num_columns; c++, cell_index++)
+      {
+        spr->lines_used |= 
+          (unsigned long) G_cell_rows_used[cell_index] << (VDP_CELL_W_H * r);
+      }
+    }
+  }
+
+  /* sprites entirely onscreen across are drawn by the routine for */
+  /* their width, and the rest by the generic (clipping) routine   */
+  if ((spr->pos_x < 0) || 
+      (spr->pos_x + VDP_CELL_W_H * spr->num_columns > VDP_SCREEN_W))
+  {
+    spr->draw_line = vdp_draw_sprite_line;
+  }
+  else if (spr->num_columns == 1)
+    spr->draw_line = vdp_draw_sprite_line_1;
+  else if (spr->num_columns == 2)
+    spr->draw_line = vdp_draw_sprite_line_2;
+  else if (spr->num_columns == 3)
+    spr->draw_line = vdp_draw_sprite_line_3;
+  else
+    spr->draw_line = vdp_draw_sprite_line_4;
+
+  vdp_bin_sprite( m, 
+                  ((spr->pos_y < 0) ? 0 : spr->pos_y) / VDP_BAND_H, 
+                  (line_last - 1) / VDP_BAND_H + 1);
+}
+
+/******************************************************************************/
+/* vdp_build_sprite_lists()                                                   */
+/******************************************************************************/
+static int vdp_build_sprite_lists()
+{
+  int b;
+  int k;
+  int m;
+  int n;
+
+  int num_entries;
+  int num_words;
+  int num_listed;
+  int decode_all;
+
+  int count;
+  int delta[VDP_BAND_H + 1];
+
+  int line_first;
+  int line_last;
+  int band_first;
+  int band_last;
+
+  int dropped;
+  int listed;
+
+  unsigned long  total;
+  unsigned long  bits;
+  unsigned long  low;
+
+  unsigned short* swap_list;
+  unsigned long*  swap_start;
+  unsigned long*  swap_count;
+
+  vdp_sprite* spr;
+
+  /* keep the previous frame's lists for comparison */
+  swap_list = S_vdp_prev_line_list;
+  swap_start = S_vdp_prev_line_start;
+  swap_count = S_vdp_prev_line_count;
+
+  S_vdp_prev_line_list = S_vdp_line_list;
+  S_vdp_prev_line_start = S_vdp_line_start;
+  S_vdp_prev_line_count = S_vdp_line_count;
+
+  S_vdp_line_list = swap_list;
+  S_vdp_line_start = swap_start;
+  S_vdp_line_count = swap_count;
+
+  S_vdp_build_count += 1;
+
+  G_vdp_num_sprites_drawn = 0;
+  G_vdp_num_sprites_visited = 0;
+  G_vdp_num_sprites_dropped = 0;
+  G_vdp_num_sprites_unpaged = 0;
+
+  num_entries = G_vdp_nametable_num_words / VDP_ENTRY_SIZE;
+
+  decode_all = (S_vdp_sprite_bank_size != G_vdp_bank_num_bytes) || 
+               (S_vdp_sprite_cells_changed != 0);
+
+  S_vdp_sprite_bank_size = G_vdp_bank_num_bytes;
+  S_vdp_sprite_cells_changed = 0;
+
+  /* decode & rebin the entries that have changed, and note */
+  /* whether each sprite differs from the previous frame    */
+  for (m = 0; m < num_entries; m++)
+  {
+    if ((m >= S_vdp_num_entries) || decode_all                          || 
+        (S_vdp_sprite_anim[m] != G_anim_cell_offset[m])                 || 
+        memcmp( &G_vdp_nametable_buf[VDP_ENTRY_SIZE * m], 
+                &S_vdp_nametable_shadow[VDP_ENTRY_SIZE * m], 
+                VDP_ENTRY_SIZE * sizeof(unsigned short)))
+    {
+      memcpy( &S_vdp_nametable_shadow[VDP_ENTRY_SIZE * m], 
+              &G_vdp_nametable_buf[VDP_ENTRY_SIZE * m], 
+              VDP_ENTRY_SIZE * sizeof(unsigned short));
+
+      vdp_decode_sprite(m);
+
+      S_vdp_sprite_changed[m] = 1;
+    }
+    else
+    {
+      spr = &S_vdp_sprites[m];
+
+      S_vdp_sprite_changed[m] = S_vdp_pal_dirty[spr->pal_addr / 
+                                                VDP_COLORS_PER_PAL];
+    }
+  }
+
+  /* remove the entries past the end of the nametable */
+  for (m = num_entries; m < S_vdp_num_entries; m++)
+    vdp_bin_sprite(m, 0, 0);
+
+  S_vdp_num_entries = num_entries;
+
+  G_vdp_num_sprites_culled = num_entries - S_vdp_num_binned;
+
+  /* build the lists a band at a time, from the sprites in its bin */
+  num_words = (num_entries + 31) / 32;
+
+  total = 0;
+
+  for (b = 0; b < VDP_NUM_BANDS; b++)
+  {
+    band_first = VDP_BAND_H * b;
+    band_last = VDP_BAND_H * (b + 1);
+
+    for (n = 0; n <= VDP_BAND_H; n++)
+      delta[n] = 0;
+
+    /* count the sprites that land on each line of the band (as the */
+    /* change in the count from each line to the next)              */
+    num_listed = 0;
+
+    for (k = 0; k < num_words; k++)
+    {
+      bits = S_vdp_bins[b][k];
+
+      while (bits != 0)
+      {
+        low = bits & (~bits + 1);
+        bits ^= low;
+
+        m = 32 * k + VDP_BIT_INDEX(low);
+
+        spr = &S_vdp_sprites[m];
+
+        G_vdp_num_sprites_visited += 1;
+
+        /* the sprite's pages are loaded (if the bank is paged) */
+        /* in the first band it is in                          */
+        if (b == S_vdp_sprite_bin_first[m])
+        {
+          if (G_bank_active && 
+              bank_touch( spr->cell_addr, 
+                          VDP_BYTES_PER_CELL * spr->num_columns * 
+                                               spr->num_rows))
+          {
+            S_vdp_sprite_skipped[m] = S_vdp_build_count;
+            G_vdp_num_sprites_unpaged += 1;
+            continue;
+          }
+
+          /* find (or resolve) the sprite in the palette-resolved cache */
+          spr->cached = pcache_find(spr->cached, spr->cell_addr, 
+                                    spr->num_columns, spr->num_rows, 
+                                    spr->pal_addr);
+        }
+        else if (S_vdp_sprite_skipped[m] == S_vdp_build_count)
+          continue;
+
+        S_vdp_band_list[num_listed++] = m;
+
+        line_first = (spr->pos_y < band_first) ? band_first : spr->pos_y;
+        line_last = spr->pos_y + VDP_CELL_W_H * spr->num_rows;
+
+        if (line_last > band_last)
+          line_last = band_last;
+
+        delta[line_first - band_first] += 1;
+        delta[line_last - band_first] -= 1;
+      }
+    }
+
+    /* apply the line limit & determine where each line's list begins */
+    count = 0;
+
+    for (n = band_first; n < band_last; n++)
+    {
+      count += delta[n - band_first];
+
+      S_vdp_line_start[n] = total;
+      total += (count > S_vdp_line_limit) ? S_vdp_line_limit : count;
+
+      S_vdp_line_count[n] = 0;
+    }
+
+    /* fill the lists in nametable order, dropping sprites past the limit */
+    for (k = 0; k < num_listed; k++)
+    {
+      m = S_vdp_band_list[k];
+      spr = &S_vdp_sprites[m];
+
+      line_first = (spr->pos_y < band_first) ? band_first : spr->pos_y;
+      line_last = spr->pos_y + VDP_CELL_W_H * spr->num_rows;
+
+      if (line_last > band_last)
+        line_last = band_last;
+
+      dropped = 0;
+      listed = 0;
+
+      for (n = line_first; n < line_last; n++)
+      {
+        if (S_vdp_line_count[n] >= (unsigned long) S_vdp_line_limit)
+        {
+          dropped = 1;
+          continue;
+        }
+
+        S_vdp_line_list[S_vdp_line_start[n] + S_vdp_line_count[n]] = m;
+        S_vdp_line_count[n] += 1;
+
+        listed = 1;
+      }
+
+      /* (a sprite is drawn if any of its lines are, in any band) */
+      if ((listed != 0) && (S_vdp_sprite_listed[m] != S_vdp_build_count))
+      {
+        S_vdp_sprite_listed[m] = S_vdp_build_count;
+        G_vdp_num_sprites_drawn += 1;
+      }
+
+      if ((dropped != 0) && (S_vdp_sprite_dropped[m] != S_vdp_build_count))
+      {
+        S_vdp_sprite_dropped[m] = S_vdp_build_count;
+        G_vdp_num_sprites_dropped += 1;
+      }
+    }
+  }
+
+  G_vdp_num_sprite_lines = total;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_find_changed_lines()                                                   */
+/******************************************************************************/
+static int vdp_find_changed_lines()
+{
+  int m;
+  int n;
+
+  int tile_row;
+
+  unsigned long  start;
+  unsigned long  prev_start;
+
+  S_vdp_frame_count += 1;
+
+  for (n = 0; n < VDP_SCREEN_H; n++)
+  {
+    if (S_vdp_redraw_all != 0)
+    {
+      S_vdp_line_frame[n] = S_vdp_frame_count;
+      continue;
+    }
+
+    /* the affine background along this line has moved */
+    if (S_vdp_bg_affine != 0)
+    {
+      if (S_vdp_affine_changed[n] != 0)
+      {
+        S_vdp_line_frame[n] = S_vdp_frame_count;
+        continue;
+      }
+    }
+
+    /* the background under this line was redrawn */
+    else if (S_vdp_bg_enabled != 0)
+    {
+      tile_row = ((S_vdp_bg_latch_y + n) % VDP_LAYER_H) / VDP_CELL_W_H;
+
+      if (S_vdp_tile_row_changed[tile_row] != 0)
+      {
+        S_vdp_line_frame[n] = S_vdp_frame_count;
+        continue;
+      }
+    }
+
+    /* a different set of sprites, or a sprite that has changed */
+    if (S_vdp_line_count[n] != S_vdp_prev_line_count[n])
+    {
+      S_vdp_line_frame[n] = S_vdp_frame_count;
+      continue;
+    }
+
+    start = S_vdp_line_start[n];
+    prev_start = S_vdp_prev_line_start[n];
+
+    for (m = 0; m < (int) S_vdp_line_count[n]; m++)
+    {
+      if ((S_vdp_line_list[start + m] != S_vdp_prev_line_list[prev_start + m]) || 
+          (S_vdp_sprite_changed[S_vdp_line_list[start + m]] != 0))
+      {
+        S_vdp_line_frame[n] = S_vdp_frame_count;
+        break;
+      }
+    }
+  }
+
+  S_vdp_redraw_all = 0;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_draw_cell_row_clipped()                                                */
+/******************************************************************************/
+static int vdp_draw_cell_row_clipped( unsigned short* line_buf, 
+                                      int pixel_x, 
+                                      unsigned long cell_index, int row, 
+                                      unsigned short* pal)
+{
+  int n;
+
+  unsigned short pal_offset;
+
+  unsigned char  mask;
+
+  unsigned char* cell_row;
+
+  /* decoded cell: clip the row mask and copy the opaque pixels */
+  if (cell_index < G_cell_num_cached)
+  {
+    cell_row = &G_cell_pixels[CELL_PIXEL_BYTES * cell_index];
+    cell_row += VDP_CELL_W_H * row;
+
+    mask = G_cell_masks[CELL_MASK_BYTES * cell_index + row];
+
+    if (pixel_x < 0)
+      mask &= 0xFF << (-pixel_x);
+    else if (pixel_x + VDP_CELL_W_H > VDP_SCREEN_W)
+      mask &= 0xFF >> (pixel_x + VDP_CELL_W_H - VDP_SCREEN_W);
+
+    for (n = 0; n < VDP_CELL_W_H; n++)
+    {
+      if (mask & (1 << n))
+        line_buf[pixel_x + n] = pal[cell_row[n]];
+    }
+
+    return 0;
+  }
+
+  /* uncached cell: unpack the 4 bpp row (if it is not empty) */
+  if ((cell_index < G_cell_num_classified) && 
+      ((G_cell_rows_used[cell_index] & (1 << row)) == 0))
+  {
+    return 0;
+  }
+
+  cell_row = VDP_BANK_PTR(VDP_BYTES_PER_CELL * cell_index);
+  cell_row += (VDP_CELL_W_H / 2) * row;
+
+  for (n = 0; n < VDP_CELL_W_H; n++)
+  {
+    if ((pixel_x + n < 0) || (pixel_x + n >= VDP_SCREEN_W))
+      continue;
+
+    if (n % 2 == 0)
+      pal_offset = (cell_row[n / 2] >> 4) & 0x0F;
+    else
+      pal_offset = cell_row[n / 2] & 0x0F;
+
+    if (pal_offset == 0)
+      continue;
+
+    line_buf[pixel_x + n] = pal[pal_offset];
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_draw_cached_line()                                                     */
+/******************************************************************************/
+static int vdp_draw_cached_line(unsigned short* line_buf, 
+                                vdp_sprite* spr, int row)
+{
+  int m;
+  int n;
+
+  int first;
+  int last;
+  int pixel_x;
+
+  unsigned short* pixels;
+  unsigned char*  masks;
+
+  pixels = &spr->cached->pixels[VDP_CELL_W_H * spr->num_columns * row];
+  masks = &spr->cached->masks[spr->num_columns * row];
+
+  /* determine the run of cells that are entirely onscreen */
+  first = 0;
+  last = spr->num_columns;
+
+  if (spr->pos_x < 0)
+    first = (VDP_CELL_W_H - 1 - spr->pos_x) / VDP_CELL_W_H;
+
+  if (spr->pos_x + VDP_CELL_W_H * last > VDP_SCREEN_W)
+    last = (VDP_SCREEN_W - spr->pos_x) / VDP_CELL_W_H;
+
+  if (last < first)
+    last = first;
+
+  /* copy the opaque onscreen pixels of the cells at either edge */
+  for (m = 0; m < spr->num_columns; m++)
+  {
+    if ((m >= first) && (m < last))
+      continue;
+
+    for (n = 0; n < VDP_CELL_W_H; n++)
+    {
+      pixel_x = spr->pos_x + VDP_CELL_W_H * m + n;
+
+      if ((pixel_x < 0) || (pixel_x >= VDP_SCREEN_W))
+        continue;
+
+      if (masks[m] & (1 << n))
+        line_buf[pixel_x] = pixels[VDP_CELL_W_H * m + n];
+    }
+  }
+
+  /* blit the onscreen run */
+  if (last > first)
+  {
+    G_blit_cells_rgb( line_buf + spr->pos_x + VDP_CELL_W_H * first, 
+                      pixels + VDP_CELL_W_H * first, 
+                      masks + first, 
+                      last - first);
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_draw_sprite_line()                                                     */
+/******************************************************************************/
+static int vdp_draw_sprite_line(unsigned short* line_buf, 
+                                vdp_sprite* spr, int row)
+{
+  int m;
+
+  int first;
+  int last;
+
+  int num_cells;
+  int num_cached;
+  int num_run;
+  int page_cells;
+
+  unsigned long  cell_index;
+
+  unsigned short* pal;
+
+  /* palette-resolved sprites are copied straight from the cache */
+  if (spr->cached != NULL)
+    return vdp_draw_cached_line(line_buf, spr, row);
+
+  pal = &G_vdp_pals_native[spr->pal_addr];
+
+  /* find the first cell in this row of the sprite */
+  cell_index = spr->cell_addr / VDP_BYTES_PER_CELL;
+  cell_index += spr->num_columns * (row / VDP_CELL_W_H);
+
+  row %= VDP_CELL_W_H;
+
+  /* determine the run of cells that are entirely onscreen */
+  first = 0;
+  last = spr->num_columns;
+
+  if (spr->pos_x < 0)
+    first = (VDP_CELL_W_H - 1 - spr->pos_x) / VDP_CELL_W_H;
+
+  if (spr->pos_x + VDP_CELL_W_H * last > VDP_SCREEN_W)
+    last = (VDP_SCREEN_W - spr->pos_x) / VDP_CELL_W_H;
+
+  if (last < first)
+    last = first;
+
+  /* draw the partially onscreen cells at either edge */
+  for (m = 0; m < first; m++)
+  {
+    vdp_draw_cell_row_clipped(line_buf, spr->pos_x + VDP_CELL_W_H * m, 
+                              cell_index + m, row, pal);
+  }
+
+  for (m = last; m < spr->num_columns; m++)
+  {
+    vdp_draw_cell_row_clipped(line_buf, spr->pos_x + VDP_CELL_W_H * m, 
+                              cell_index + m, row, pal);
+  }
+
+  if (first == last)
+    return 0;
+
+  /* blit the onscreen run, from the cache where possible */
+  line_buf += spr->pos_x + VDP_CELL_W_H * first;
+  cell_index += first;
+
+  num_cells = last - first;
+  num_cached = 0;
+
+  if (cell_index < G_cell_num_cached)
+  {
+    num_cached = num_cells;
+
+    if (cell_index + num_cells > G_cell_num_cached)
+      num_cached = G_cell_num_cached - cell_index;
+
+    G_blit_cells_8bpp(line_buf, 
+                      &G_cell_pixels[CELL_PIXEL_BYTES * cell_index + 
+                                     VDP_CELL_W_H * row], 
+                      &G_cell_masks[CELL_MASK_BYTES * cell_index + row], 
+                      num_cached, pal);
+  }
+
+  line_buf += VDP_CELL_W_H * num_cached;
+  cell_index += num_cached;
+  num_cells -= num_cached;
+
+  /* blit the rest from the bank (splitting the run where it crosses */
+  /* from one page to the next, if the bank is paged, and around the */
+  /* cells that are empty along this row, if they are classified)    */
+  while (num_cells > 0)
+  {
+    num_run = num_cells;
+
+    if (G_bank_active)
+    {
+      page_cells = BANK_PAGE_SIZE / VDP_BYTES_PER_CELL;
+      page_cells -= cell_index % (BANK_PAGE_SIZE / VDP_BYTES_PER_CELL);
+
+      if (num_run > page_cells)
+        num_run = page_cells;
+    }
+    else if (cell_index + num_run <= G_cell_num_classified)
+    {
+      for (m = 0; m < num_run; m++)
+      {
+        if ((G_cell_rows_used[cell_index + m] & (1 << row)) == 0)
+          break;
+      }
+
+      /* skip an empty cell, or blit up to the next one */
+      if (m == 0)
+      {
+        line_buf += VDP_CELL_W_H;
+        cell_index += 1;
+        num_cells -= 1;
+        continue;
+      }
+
+      num_run = m;
+    }
+
+    G_blit_cells_4bpp(line_buf, 
+                      VDP_BANK_PTR(VDP_BYTES_PER_CELL * cell_index + 
+                                   (VDP_CELL_W_H / 2) * row), 
+                      num_run, pal);
+
+    line_buf += VDP_CELL_W_H * num_run;
+    cell_index += num_run;
+    num_cells -= num_run;
+  }
+
+  return 0;
+}
+
+/* unclipped sprite line, for a sprite num_columns cells across whose   */
+/* row of cells is entirely in the cell cache (or that is cached with   */
+/* its palette resolved). the width is a constant, so the row offsets   */
+/* fold away & the blitters are called for a fixed run, with none of    */
+/* the clipping or bank fallback of vdp_draw_sprite_line(), which       */
+/* draws the row otherwise.                                             */
+#define VDP_DEFINE_SPRITE_LINE(name, num_columns)                              \
+static int name(unsigned short* line_buf, vdp_sprite* spr, int row)            \
+{                                                                              \
+  unsigned long cell_index;                                                    \
+                                                                               \
+  if (spr->cached != NULL)                                                     \
+  {                                                                            \
+    G_blit_sprite_rgb[num_columns - 1](                                        \
+                      line_buf + spr->pos_x,                                   \
+                      &spr->cached->pixels[VDP_CELL_W_H * num_columns * row],  \
+                      &spr->cached->masks[num_columns * row],                  \
+                      num_columns);                                            \
+                                                                               \
+    return 0;                                                                  \
+  }                                                                            \
+                                                                               \
+  cell_index = spr->cell_addr / VDP_BYTES_PER_CELL;                            \
+  cell_index += num_columns * (row / VDP_CELL_W_H);                            \
+                                                                               \
+  if (cell_index + num_columns > G_cell_num_cached)                            \
+    return vdp_draw_sprite_line(line_buf, spr, row);                           \
+                                                                               \
+  G_blit_sprite_8bpp[num_columns - 1](                                         \
+                    line_buf + spr->pos_x,                                     \
+                    &G_cell_pixels[CELL_PIXEL_BYTES * cell_index +             \
+                                   VDP_CELL_W_H * (row % VDP_CELL_W_H)],       \
+                    &G_cell_masks[CELL_MASK_BYTES * cell_index +               \
+                                  (row % VDP_CELL_W_H)],                       \
+                    num_columns,                                               \
+                    &G_vdp_pals_native[spr->pal_addr]);                        \
+                                                                               \
+  return 0;                                                                    \
+}
+
+VDP_DEFINE_SPRITE_LINE(vdp_draw_sprite_line_1, 1)
+VDP_DEFINE_SPRITE_LINE(vdp_draw_sprite_line_2, 2)
+VDP_DEFINE_SPRITE_LINE(vdp_draw_sprite_line_3, 3)
+VDP_DEFINE_SPRITE_LINE(vdp_draw_sprite_line_4, 4)
+
+/******************************************************************************/
+/* vdp_draw_band()                                                            */
+/******************************************************************************/
+static void vdp_draw_band(int band)
+{
+  int m;
+  int n;
+
+  int line_first;
+  int line_last;
+
+  int layer_x;
+  int layer_y;
+  int span;
+
+  int first;
+  int last;
+
+  unsigned short* line_buf;
+
+  vdp_sprite* spr;
+
+  /* clip the band to the lines being drawn */
+  band += S_vdp_draw_band_first;
+
+  line_first = VDP_BAND_H * band;
+  line_last = VDP_BAND_H * (band + 1);
+
+  if (line_first < S_vdp_draw_first)
+    line_first = S_vdp_draw_first;
+
+  if (line_last > S_vdp_draw_last)
+    line_last = S_vdp_draw_last;
+
+  /* composite each line, with lower nametable entries drawn on top */
+  for (n = line_first; n < line_last; n++)
+  {
+    if (S_vdp_draw_wide != 0)
+      line_buf = S_vdp_wide_buf[band];
+    else
+    {
+      line_buf = (unsigned short*) S_vdp_draw_buf + 
+                 S_vdp_draw_pitch * (n - S_vdp_draw_first);
+    }
+
+    /* sample the affine background along the line, leaving the */
+    /* pixels outside the layer transparent if it is clipped    */
+    if (S_vdp_bg_affine != 0)
+    {
+      first = S_vdp_affine_first[n];
+      last = S_vdp_affine_last[n];
+
+      memset(line_buf, 0, first * sizeof(unsigned short));
+
+      G_blit_affine(line_buf + first, S_vdp_bg_layer, 
+                    S_vdp_affine_u[n] + first * S_vdp_affine_du[n], 
+                    S_vdp_affine_v[n] + first * S_vdp_affine_dv[n], 
+                    S_vdp_affine_du[n], S_vdp_affine_dv[n], 
+                    last - first);
+
+      memset( line_buf + last, 0, 
+              (VDP_SCREEN_W - last) * sizeof(unsigned short));
+    }
+
+    /* copy the scrolled background, wrapping around the layer */
+    else if (S_vdp_bg_enabled != 0)
+    {
+      layer_x = S_vdp_bg_latch_x;
+      layer_y = (S_vdp_bg_latch_y + n) % VDP_LAYER_H;
+
+      span = VDP_LAYER_W - layer_x;
+
+      if (span > VDP_SCREEN_W)
+        span = VDP_SCREEN_W;
+
+      memcpy( line_buf, 
+              &S_vdp_bg_layer[VDP_LAYER_W * layer_y + layer_x], 
+              span * sizeof(unsigned short));
+
+      memcpy( line_buf + span, 
+              &S_vdp_bg_layer[VDP_LAYER_W * layer_y], 
+              (VDP_SCREEN_W - span) * sizeof(unsigned short));
+    }
+    else
+      memset(line_buf, 0, VDP_SCREEN_W * sizeof(unsigned short));
+
+    /* (the sprites' transparent lines still count toward the limit) */
+    for (m = S_vdp_line_count[n] - 1; m >= 0; m--)
+    {
+      spr = &S_vdp_sprites[S_vdp_line_list[S_vdp_line_start[n] + m]];
+
+      if ((spr->lines_used & (1UL << (n - spr->pos_y))) == 0)
+        continue;
+
+      if (S_vdp_generic_sprites != 0)
+        vdp_draw_sprite_line(line_buf, spr, n - spr->pos_y);
+      else
+        spr->draw_line(line_buf, spr, n - spr->pos_y);
+    }
+
+    /* widen the line into the target */
+    if (S_vdp_draw_wide != 0)
+    {
+      vdp_widen_line( (unsigned int*) S_vdp_draw_buf + 
+                        S_vdp_draw_pitch * (n - S_vdp_draw_first), 
+                      line_buf, S_vdp_format);
+    }
+  }
+}
+
+/******************************************************************************/
+/* vdp_prepare_frame()                                                        */
+/******************************************************************************/
+int vdp_prepare_frame()
+{
+  int enabled;
+  int affine;
+  int latch_x;
+  int latch_y;
+
+  PROF_BEGIN(PROF_STAGE_PREPARE);
+
+  /* unpin the pages & cached sprites used by the previous frame */
+  if (G_bank_active)
+    bank_begin_frame();
+
+  pcache_begin_frame();
+
+  /* palette or scroll changes affect the whole screen */
+  vdp_check_pals();
+
+  enabled = (G_vdp_tilemap_num_words > 0) ? 1 : 0;
+  affine = ((enabled != 0) && (G_vdp_bg_mode & VDP_BG_MODE_AFFINE)) ? 1 : 0;
+  latch_x = G_vdp_bg_scroll_x % VDP_LAYER_W;
+  latch_y = G_vdp_bg_scroll_y % VDP_LAYER_H;
+
+  if ((enabled != S_vdp_bg_enabled) || (affine != S_vdp_bg_affine) || 
+      ((enabled != 0) && (affine == 0) && 
+       ((latch_x != S_vdp_bg_latch_x) || (latch_y != S_vdp_bg_latch_y))))
+  {
+    S_vdp_redraw_all = 1;
+  }
+
+  S_vdp_bg_enabled = enabled;
+  S_vdp_bg_affine = affine;
+  S_vdp_bg_latch_x = latch_x;
+  S_vdp_bg_latch_y = latch_y;
+
+  /* bring the background layer up to date (when it is rotated or */
+  /* scaled, any line may show a tile that was redrawn)           */
+  G_vdp_num_tiles_drawn = 0;
+
+  if (S_vdp_bg_enabled != 0)
+    vdp_update_bg_layer();
+
+  if (S_vdp_bg_affine != 0)
+  {
+    vdp_setup_affine();
+
+    if (G_vdp_num_tiles_drawn > 0)
+      S_vdp_redraw_all = 1;
+  }
+
+  /* bin the sprites by scanline */
+  vdp_build_sprite_lists();
+
+  /* note the lines that differ from the previous frame */
+  vdp_find_changed_lines();
+
+  PROF_END(PROF_STAGE_PREPARE);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_dirty_lines()                                                          */
+/******************************************************************************/
+int vdp_dirty_lines(void* target, int* first, int* last)
+{
+  int k;
+  int n;
+
+  unsigned long  since;
+
+  /* find the target (unknown targets replace the oldest entry, */
+  /* and have everything redrawn)                               */
+  for (k = 0; k < VDP_MAX_TARGETS; k++)
+  {
+    if (S_vdp_target_id[k] == target)
+      break;
+  }
+
+  if (k == VDP_MAX_TARGETS)
+  {
+    k = S_vdp_target_next;
+
+    S_vdp_target_next = (S_vdp_target_next + 1) % VDP_MAX_TARGETS;
+
+    S_vdp_target_id[k] = target;
+    S_vdp_target_frame[k] = 0;
+  }
+
+  since = S_vdp_target_frame[k];
+
+  S_vdp_target_frame[k] = S_vdp_frame_count;
+
+  /* return the range of lines that changed after the target was drawn */
+  *first = VDP_SCREEN_H;
+  *last = 0;
+
+  for (n = 0; n < VDP_SCREEN_H; n++)
+  {
+    if ((S_vdp_line_frame[n] > since) || (since == 0))
+    {
+      if (*first > n)
+        *first = n;
+
+      *last = n + 1;
+    }
+  }
+
+  if (*first >= *last)
+  {
+    *first = 0;
+    *last = 0;
+  }
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_draw_target()                                                          */
+/******************************************************************************/
+static int vdp_draw_target(void* buf, int pitch, int first, int last, 
+                           int wide)
+{
+  int k;
+
+  int num_bands;
+
+  if (first >= last)
+    return 0;
+
+  /* buf points at line 'first', with 'pitch' pixels between lines */
+  /* (of 32 bits each, if the lines are widened)                   */
+  S_vdp_draw_buf = buf;
+  S_vdp_draw_pitch = pitch;
+  S_vdp_draw_first = first;
+  S_vdp_draw_last = last;
+  S_vdp_draw_wide = wide;
+
+  /* draw the bands (the lists are read only from here on, */
+  /* so the workers can share them without locking)        */
+  S_vdp_draw_band_first = first / VDP_BAND_H;
+
+  num_bands = (last + VDP_BAND_H - 1) / VDP_BAND_H - S_vdp_draw_band_first;
+
+  PROF_BEGIN(PROF_STAGE_DRAW);
+
+  if ((G_pool_num_threads > 0) && (num_bands > 1))
+    pool_run(vdp_draw_band, num_bands);
+  else
+  {
+    for (k = 0; k < num_bands; k++)
+      vdp_draw_band(k);
+  }
+
+  PROF_END(PROF_STAGE_DRAW);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* vdp_draw_lines()                                                           */
+/******************************************************************************/
+int vdp_draw_lines(void* buf, int pitch, int first, int last)
+{
+  return vdp_draw_target( buf, pitch, first, last, 
+                          (VDP_FORMAT_BYTES(S_vdp_format) == 4) ? 1 : 0);
+}
+
+/******************************************************************************/
+/* vdp_draw_frame()                                                           */
+/******************************************************************************/
+int vdp_draw_frame()
+{
+  vdp_prepare_frame();
+
+  /* redraw the lines of the framebuffer that are out of date */
+  vdp_dirty_lines(G_vdp_fb_rgb, &G_vdp_dirty_first, &G_vdp_dirty_last);
+
+  vdp_draw_target(&G_vdp_fb_rgb[VDP_SCREEN_W * G_vdp_dirty_first], 
+                  VDP_SCREEN_W, G_vdp_dirty_first, G_vdp_dirty_last, 0);
+
+  return 0;
+}
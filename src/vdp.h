@@ -11,13 +11,26 @@
 
 #define VDP_SCREEN_SIZE (VDP_SCREEN_W * VDP_SCREEN_H)
 
-extern unsigned short G_vdp_fb_rgb[VDP_SCREEN_SIZE];
+/* frames are drawn to whichever buffer this points at */
+extern unsigned short* G_vdp_fb_rgb;
 
 /* nametable */
 #define VDP_ENTRY_SIZE      5
 #define VDP_MAX_ENTRIES     (1 << 12)
 #define VDP_NAMETABLE_SIZE  (VDP_ENTRY_SIZE * VDP_MAX_ENTRIES)
 
+/* nametable entry layout (5 words per entry)                 */
+/*   word 0: bit 9 = y pos bit 8, bit 8 = x pos bit 8,        */
+/*           bits 0-7 = palette                               */
+/*   word 1: bits 13-14 = columns - 1, bits 11-12 = rows - 1, */
+/*           bits 8-10 = frames - 1, bits 0-7 = delay time    */
+/*   word 2: bits 0-5 = cell address (high)                   */
+/*   word 3: bits 0-15 = cell address (low)                   */
+/*   word 4: bits 8-15 = x pos (low), bits 0-7 = y pos (low)  */
+/* positions are 9 bits and wrap at 512, so a sprite that     */
+/* would cross the wrap point is drawn at a negative position */
+/* (anim.h describes how the frames & delay time are played)  */
+
 extern unsigned short G_vdp_nametable_buf[VDP_NAMETABLE_SIZE];
 extern unsigned long  G_vdp_nametable_num_words;
 
@@ -30,6 +43,26 @@ extern unsigned long  G_vdp_nametable_num_words;
 extern unsigned short G_vdp_pals_buf[VDP_PALS_SIZE];
 extern unsigned long  G_vdp_pals_num_words;
 
+/* pixel formats (colors are stored as rgb555, and drawn with the   */
+/* palettes converted to the 16 bit formats once per change; the 32 */
+/* bit formats are drawn as rgb555, then widened a line at a time)  */
+enum
+{
+  VDP_FORMAT_RGB555 = 0, 
+  VDP_FORMAT_RGB565, 
+  VDP_FORMAT_BGR555, 
+  VDP_FORMAT_BGR565, 
+  VDP_FORMAT_ARGB8888, 
+  VDP_FORMAT_ABGR8888, 
+  VDP_NUM_FORMATS 
+};
+
+#define VDP_FORMAT_BYTES(format)                                               \
+  (((format) >= VDP_FORMAT_ARGB8888) ? 4 : 2)
+
+/* the palettes as they are drawn */
+extern unsigned short* G_vdp_pals_native;
+
 /* cells */
 #define VDP_CELL_W_H        8
 #define VDP_PIXELS_PER_CELL (VDP_CELL_W_H * VDP_CELL_W_H)
@@ -37,12 +70,114 @@ extern unsigned long  G_vdp_pals_num_words;
 
 #define VDP_BANK_SIZE       (1 << 22) /* 4 MB total size */
 
-extern unsigned char  G_vdp_bank_buf[VDP_BANK_SIZE];
+/* the bank normally points at internal storage, but a cart */
+/* can point it directly at its own (read only) memory       */
+extern unsigned char* G_vdp_bank_buf;
 extern unsigned long  G_vdp_bank_num_bytes;
 
-/* function declarations */
+/* background layer */
+#define VDP_LAYER_W         512
+#define VDP_LAYER_H         512
+
+#define VDP_LAYER_SIZE      (VDP_LAYER_W * VDP_LAYER_H)
+
+/* tilemap (one cell per tile, covering the background layer) */
+/*   word 0: bits 8-13 = cell address (high),                 */
+/*           bits 0-7 = palette                               */
+/*   word 1: bits 0-15 = cell address (low)                   */
+#define VDP_TILE_SIZE       2
+#define VDP_TILEMAP_W       (VDP_LAYER_W / VDP_CELL_W_H)
+#define VDP_TILEMAP_H       (VDP_LAYER_H / VDP_CELL_W_H)
+#define VDP_MAX_TILES       (VDP_TILEMAP_W * VDP_TILEMAP_H)
+#define VDP_TILEMAP_SIZE    (VDP_TILE_SIZE * VDP_MAX_TILES)
+
+extern unsigned short G_vdp_tilemap_buf[VDP_TILEMAP_SIZE];
+extern unsigned long  G_vdp_tilemap_num_words;
+
+/* registers */
+extern unsigned short G_vdp_bg_scroll_x;
+extern unsigned short G_vdp_bg_scroll_y;
+
+/* background mode (normally the layer is scrolled, & wraps around) */
+#define VDP_BG_MODE_AFFINE    0x0001  /* rotate / scale the layer      */
+#define VDP_BG_MODE_PER_LINE  0x0002  /* a matrix per line (affine)    */
+#define VDP_BG_MODE_CLIP      0x0004  /* transparent outside the layer */
+
+extern unsigned short G_vdp_bg_mode;
+
+/* affine background: screen pixel (x, y) shows layer pixel       */
+/*   | a b | | x + scroll_x - center_x |   | center_x |           */
+/*   | c d | | y + scroll_y - center_y | + | center_y |           */
+/* where the matrix entries are signed 8.8 fixed point, and the   */
+/* scroll & center are signed pixels. with per line matrices, the */
+/* line table holds a, b, c & d for each line of the screen.      */
+#define VDP_MATRIX_A          0
+#define VDP_MATRIX_B          1
+#define VDP_MATRIX_C          2
+#define VDP_MATRIX_D          3
+#define VDP_MATRIX_SIZE       4
+
+#define VDP_LINE_MATRIX_SIZE  (VDP_MATRIX_SIZE * VDP_SCREEN_H)
+
+extern unsigned short G_vdp_bg_matrix[VDP_MATRIX_SIZE];
+extern unsigned short G_vdp_bg_center_x;
+extern unsigned short G_vdp_bg_center_y;
+
+extern unsigned short G_vdp_bg_line_matrix[VDP_LINE_MATRIX_SIZE];
+
+/* sprites */
+#define VDP_SPRITE_MAX_W_H  (4 * VDP_CELL_W_H)
+#define VDP_POS_WRAP        512
+
+#define VDP_LINE_LIMIT_DEFAULT  VDP_MAX_ENTRIES
+
+/* statistics (from the most recent frame) */
+/* (drawn counts the sprites with a line within the line limit,        */
+/* visited counts each sprite once per band of lines it was binned in, */
+/* culled counts the entries that were offscreen or could not be drawn, */
+/* unpaged counts the sprites skipped as their pages could not be      */
+/* loaded (the page cache is too small for the frame), and sprite      */
+/* lines counts each sprite once per line it is listed on)             */
+extern unsigned long  G_vdp_num_sprites_drawn;
+extern unsigned long  G_vdp_num_sprites_visited;
+extern unsigned long  G_vdp_num_sprites_culled;
+extern unsigned long  G_vdp_num_sprites_dropped;
+extern unsigned long  G_vdp_num_sprites_unpaged;
+
+extern unsigned long  G_vdp_num_sprite_lines;
+
+extern unsigned long  G_vdp_num_tiles_drawn;
+
+/* lines of G_vdp_fb_rgb redrawn by the most recent vdp_draw_frame() */
+extern int            G_vdp_dirty_first;
+extern int            G_vdp_dirty_last;
+
+/* function declarations (vdp_reset() clears only the first *_num_* */
+/* words / bytes of each buffer, so nothing may be written past them) */
 int vdp_reset();
 
+int vdp_set_line_limit(int limit);
+
+/* (the format is that of the targets drawn by vdp_draw_lines(); the */
+/* framebuffer is drawn in its 16 bit counterpart, which is rgb555   */
+/* for the 32 bit formats, so frames are rgb555 unless it is changed) */
+int vdp_set_format(int format);
+
+unsigned long vdp_convert_color(int format, unsigned short color);
+int vdp_convert_lines(void* dst, int dst_pitch, int format, 
+                      unsigned short* src, int src_pitch, int num_lines);
+
+/* (the generic sprite line routine handles every sprite, and is kept */
+/* to check the routines specialized by width against)                 */
+int vdp_set_generic_sprites(int generic);
+
+int vdp_invalidate_cells(unsigned long addr, unsigned long num_bytes);
+int vdp_invalidate_frame();
+
+int vdp_prepare_frame();
+int vdp_dirty_lines(void* target, int* first, int* last);
+int vdp_draw_lines(void* buf, int pitch, int first, int last);
+
 int vdp_draw_frame();
 
 #endif
@@ -6,9 +6,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "video.h"
 
+#include "prof.h"
 #include "vdp.h"
 
 /* sdl window, renderer, etc */
@@ -30,16 +32,90 @@ static short  S_video_window_size_table[2 * VIDEO_NUM_WINDOW_SIZES] =
 #define VIDEO_FB_TEXTURE_W 512
 #define VIDEO_FB_TEXTURE_H 256
 
+/* texture formats the vdp can draw, in order of preference when the */
+/* renderer lists more than one (the renderer's own formats are used */
+/* so the driver does not have to convert each frame on upload)      */
+typedef struct video_format
+{
+  Uint32  sdl_format;
+  int     vdp_format;
+} video_format;
+
+static video_format S_video_format_table[] = 
+  { { SDL_PIXELFORMAT_ARGB8888, VDP_FORMAT_ARGB8888 }, 
+    { SDL_PIXELFORMAT_RGB888,   VDP_FORMAT_ARGB8888 }, 
+    { SDL_PIXELFORMAT_ABGR8888, VDP_FORMAT_ABGR8888 }, 
+    { SDL_PIXELFORMAT_BGR888,   VDP_FORMAT_ABGR8888 }, 
+    { SDL_PIXELFORMAT_RGB555,   VDP_FORMAT_RGB555 }, 
+    { SDL_PIXELFORMAT_ARGB1555, VDP_FORMAT_RGB555 }, 
+    { SDL_PIXELFORMAT_RGB565,   VDP_FORMAT_RGB565 }, 
+    { SDL_PIXELFORMAT_BGR555,   VDP_FORMAT_BGR555 }, 
+    { SDL_PIXELFORMAT_ABGR1555, VDP_FORMAT_BGR555 }, 
+    { SDL_PIXELFORMAT_BGR565,   VDP_FORMAT_BGR565 } 
+  };
+
+#define VIDEO_NUM_FORMATS                                                      \
+  ((int) (sizeof(S_video_format_table) / sizeof(video_format)))
+
+static Uint32 S_video_sdl_format;
+static int    S_video_format;
+
+#ifdef PROF_ENABLE
+/* the timing overlay is drawn into its own texture, which */
+/* is blended over the top of the frame when it is shown   */
+static SDL_Texture*   S_video_sdl_overlay_texture;
+static unsigned short S_video_overlay_buf[VDP_SCREEN_W * PROF_OVERLAY_H];
+#endif
+
+/*******************************************************************************
+** video_choose_format()
+*******************************************************************************/
+static short int video_choose_format()
+{
+  int k;
+  int n;
+
+  SDL_RendererInfo info;
+
+  /* default to rgb555 (which sdl converts if it must) */
+  S_video_sdl_format = SDL_PIXELFORMAT_RGB555;
+  S_video_format = VDP_FORMAT_RGB555;
+
+  if (SDL_GetRendererInfo(S_video_sdl_renderer, &info) != 0)
+    return 1;
+
+  /* use the renderer's first listed format that the vdp can draw */
+  for (k = 0; k < (int) info.num_texture_formats; k++)
+  {
+    for (n = 0; n < VIDEO_NUM_FORMATS; n++)
+    {
+      if (info.texture_formats[k] == S_video_format_table[n].sdl_format)
+      {
+        S_video_sdl_format = S_video_format_table[n].sdl_format;
+        S_video_format = S_video_format_table[n].vdp_format;
+
+        return 0;
+      }
+    }
+  }
+
+  return 0;
+}
+
 /*******************************************************************************
 ** video_init()
 *******************************************************************************/
-short int video_init()
+short int video_init(int vsync)
 {
   /* initialize pointers to null */
   S_video_sdl_window = NULL;
   S_video_sdl_renderer = NULL;
   S_video_sdl_frame_texture = NULL;
 
+#ifdef PROF_ENABLE
+  S_video_sdl_overlay_texture = NULL;
+#endif
+
   /* set default window size */
   S_video_window_size = VIDEO_WINDOW_SIZE_480P;
 
@@ -57,10 +133,10 @@ short int video_init()
     return 1;
   }
 
-  /* create the renderer */
+  /* create the renderer (optionally syncing present to the display) */
   S_video_sdl_renderer = SDL_CreateRenderer(S_video_sdl_window, 
                                             -1, 
-                                            0);
+                                            vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
 
   if (S_video_sdl_renderer == NULL)
   {
@@ -77,9 +153,13 @@ short int video_init()
                             VDP_SCREEN_H);
 */
 
-  /* create the framebuffer texture */
+  /* create the framebuffer texture in the renderer's own format */
+  video_choose_format();
+
+  printf("Texture format: %s\n", SDL_GetPixelFormatName(S_video_sdl_format));
+
   S_video_sdl_frame_texture = SDL_CreateTexture(S_video_sdl_renderer,
-                                                SDL_PIXELFORMAT_RGB555,
+                                                S_video_sdl_format,
                                                 SDL_TEXTUREACCESS_STREAMING,
                                                 VIDEO_FB_TEXTURE_W, 
                                                 VIDEO_FB_TEXTURE_H);
@@ -90,6 +170,26 @@ short int video_init()
     return 1;
   }
 
+  /* (the frame is opaque, even in the formats with alpha) */
+  SDL_SetTextureBlendMode(S_video_sdl_frame_texture, SDL_BLENDMODE_NONE);
+
+#ifdef PROF_ENABLE
+  /* create the overlay texture */
+  S_video_sdl_overlay_texture = SDL_CreateTexture(S_video_sdl_renderer,
+                                                  SDL_PIXELFORMAT_ARGB4444,
+                                                  SDL_TEXTUREACCESS_STREAMING,
+                                                  VDP_SCREEN_W, 
+                                                  PROF_OVERLAY_H);
+
+  if (S_video_sdl_overlay_texture == NULL)
+  {
+    printf("Failed to create overlay texture: %s\n", SDL_GetError());
+    return 1;
+  }
+
+  SDL_SetTextureBlendMode(S_video_sdl_overlay_texture, SDL_BLENDMODE_BLEND);
+#endif
+
   /* initialize window to black */
   SDL_SetRenderDrawColor(S_video_sdl_renderer, 0, 0, 0, 255);
   SDL_RenderClear(S_video_sdl_renderer);
@@ -103,6 +203,10 @@ short int video_init()
 *******************************************************************************/
 short int video_deinit()
 {
+#ifdef PROF_ENABLE
+  SDL_DestroyTexture(S_video_sdl_overlay_texture);
+#endif
+
   SDL_DestroyTexture(S_video_sdl_frame_texture);
   SDL_DestroyRenderer(S_video_sdl_renderer);
   SDL_DestroyWindow(S_video_sdl_window);
@@ -110,13 +214,60 @@ short int video_deinit()
   return 0;
 }
 
+#ifdef PROF_ENABLE
 /*******************************************************************************
-** video_display_frame()
+** video_update_overlay()
 *******************************************************************************/
-short int video_display_frame()
+static short int video_update_overlay()
+{
+  int k;
+
+  unsigned short color;
+
+  /* draw the overlay over black, then convert it to argb4444, with */
+  /* the black translucent (darkening the frame behind it as before) */
+  memset(S_video_overlay_buf, 0, sizeof(S_video_overlay_buf));
+
+  prof_draw_overlay(S_video_overlay_buf, VDP_SCREEN_W);
+
+  for (k = 0; k < VDP_SCREEN_W * PROF_OVERLAY_H; k++)
+  {
+    color = S_video_overlay_buf[k];
+
+    if (color == 0)
+      S_video_overlay_buf[k] = 0xC000;
+    else
+    {
+      S_video_overlay_buf[k] = 0xF000 | 
+                               ((color >> 3) & 0x0F00) | 
+                               ((color >> 2) & 0x00F0) | 
+                               ((color >> 1) & 0x000F);
+    }
+  }
+
+  SDL_UpdateTexture(S_video_sdl_overlay_texture, 
+                    NULL, 
+                    S_video_overlay_buf, 
+                    VDP_SCREEN_W * sizeof (unsigned short));
+
+  return 0;
+}
+#endif
+
+/*******************************************************************************
+** video_present()
+*******************************************************************************/
+static short int video_present()
 {
   SDL_Rect screen_rect;
 
+#ifdef PROF_ENABLE
+  SDL_Rect overlay_rect;
+
+  int output_w;
+  int output_h;
+#endif
+
   /* setup rectangle */
   screen_rect.x = 0;
   screen_rect.y = 0;
@@ -124,25 +275,183 @@ short int video_display_frame()
   screen_rect.h = VDP_SCREEN_H;
 
   /* clear screen */
+  PROF_BEGIN(PROF_STAGE_CLEAR);
+
   SDL_SetRenderDrawColor(S_video_sdl_renderer, 0, 0, 0, 255);
   SDL_RenderClear(S_video_sdl_renderer);
 
-  /* copy the framebuffer to the texture and draw it on screen */
-  SDL_UpdateTexture(S_video_sdl_frame_texture, 
-                    &screen_rect, 
-                    G_vdp_fb_rgb, 
-                    VDP_SCREEN_W * sizeof (unsigned short));
+  PROF_END(PROF_STAGE_CLEAR);
+
+  /* draw the texture on screen */
+  PROF_BEGIN(PROF_STAGE_COPY);
 
   SDL_RenderCopy( S_video_sdl_renderer, 
                   S_video_sdl_frame_texture, 
                   &screen_rect, 
                   NULL);
 
+#ifdef PROF_ENABLE
+  /* draw the overlay across the top of the frame */
+  if (G_prof_overlay)
+  {
+    video_update_overlay();
+
+    SDL_GetRendererOutputSize(S_video_sdl_renderer, &output_w, &output_h);
+
+    overlay_rect.x = 0;
+    overlay_rect.y = 0;
+    overlay_rect.w = output_w;
+    overlay_rect.h = output_h * PROF_OVERLAY_H / VDP_SCREEN_H;
+
+    SDL_RenderCopy( S_video_sdl_renderer, 
+                    S_video_sdl_overlay_texture, 
+                    NULL, 
+                    &overlay_rect);
+  }
+#endif
+
+  PROF_END(PROF_STAGE_COPY);
+
+  PROF_BEGIN(PROF_STAGE_PRESENT);
+
   SDL_RenderPresent(S_video_sdl_renderer);
 
+  PROF_END(PROF_STAGE_PRESENT);
+
+  return 0;
+}
+
+/*******************************************************************************
+** video_upload_lines()
+*******************************************************************************/
+static short int video_upload_lines(unsigned short* src, int first, int last)
+{
+  SDL_Rect dirty_rect;
+
+  void* pixels;
+  int   pitch;
+
+  dirty_rect.x = 0;
+  dirty_rect.y = first;
+  dirty_rect.w = VDP_SCREEN_W;
+  dirty_rect.h = last - first;
+
+  /* rgb555 lines are copied as they are, otherwise they are */
+  /* converted straight into the locked texture              */
+  if (S_video_format == VDP_FORMAT_RGB555)
+  {
+    SDL_UpdateTexture(S_video_sdl_frame_texture, 
+                      &dirty_rect, 
+                      src, 
+                      VDP_SCREEN_W * sizeof (unsigned short));
+
+    return 0;
+  }
+
+  if (SDL_LockTexture(S_video_sdl_frame_texture, 
+                      &dirty_rect, &pixels, &pitch) != 0)
+  {
+    return 1;
+  }
+
+  vdp_convert_lines(pixels, pitch / VDP_FORMAT_BYTES(S_video_format), 
+                    S_video_format, src, VDP_SCREEN_W, last - first);
+
+  SDL_UnlockTexture(S_video_sdl_frame_texture);
+
   return 0;
 }
 
+/*******************************************************************************
+** video_render_frame()
+*******************************************************************************/
+short int video_render_frame()
+{
+  SDL_Rect dirty_rect;
+
+  void* pixels;
+  int   pitch;
+
+  int first;
+  int last;
+
+  /* find the lines that changed since the texture was last drawn */
+  /* (in the texture's format, with the palettes converted to it) */
+  vdp_set_format(S_video_format);
+
+  vdp_prepare_frame();
+  vdp_dirty_lines(S_video_sdl_frame_texture, &first, &last);
+
+  /* draw them straight into the locked texture (no staging copy) */
+  if (first < last)
+  {
+    dirty_rect.x = 0;
+    dirty_rect.y = first;
+    dirty_rect.w = VDP_SCREEN_W;
+    dirty_rect.h = last - first;
+
+    PROF_BEGIN(PROF_STAGE_UPLOAD);
+
+    if (SDL_LockTexture(S_video_sdl_frame_texture, 
+                        &dirty_rect, &pixels, &pitch) != 0)
+    {
+      /* lost the texture, so draw everything next time */
+      PROF_END(PROF_STAGE_UPLOAD);
+
+      vdp_invalidate_frame();
+      return 1;
+    }
+
+    PROF_END(PROF_STAGE_UPLOAD);
+
+    vdp_draw_lines( pixels, 
+                    pitch / VDP_FORMAT_BYTES(S_video_format), first, last);
+
+    PROF_BEGIN(PROF_STAGE_UPLOAD);
+
+    SDL_UnlockTexture(S_video_sdl_frame_texture);
+
+    PROF_END(PROF_STAGE_UPLOAD);
+  }
+
+  return video_present();
+}
+
+/*******************************************************************************
+** video_display_frame()
+*******************************************************************************/
+short int video_display_frame()
+{
+  /* copy the lines redrawn by the last vdp_draw_frame() to the texture */
+  /* (they are rgb555, since only video_render_frame() sets the format) */
+  if (G_vdp_dirty_first < G_vdp_dirty_last)
+  {
+    PROF_BEGIN(PROF_STAGE_UPLOAD);
+
+    video_upload_lines( &G_vdp_fb_rgb[VDP_SCREEN_W * G_vdp_dirty_first], 
+                        G_vdp_dirty_first, G_vdp_dirty_last);
+
+    PROF_END(PROF_STAGE_UPLOAD);
+  }
+
+  return video_present();
+}
+
+/*******************************************************************************
+** video_display_buffer()
+*******************************************************************************/
+short int video_display_buffer(unsigned short* fb)
+{
+  /* copy the whole framebuffer to the texture */
+  PROF_BEGIN(PROF_STAGE_UPLOAD);
+
+  video_upload_lines(fb, 0, VDP_SCREEN_H);
+
+  PROF_END(PROF_STAGE_UPLOAD);
+
+  return video_present();
+}
+
 /*******************************************************************************
 ** video_resize_window()
 *******************************************************************************/
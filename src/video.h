@@ -16,10 +16,12 @@ enum
 };
 
 /* function declarations */
-short int video_init();
+short int video_init(int vsync);
 short int video_deinit();
 
+short int video_render_frame();
 short int video_display_frame();
+short int video_display_buffer(unsigned short* fb);
 
 short int video_increase_window_size();
 short int video_decrease_window_size();
@@ -0,0 +1,226 @@
+/******************************************************************************/
+/* watch.c (cart file watcher)                                                */
+/******************************************************************************/
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#if defined(__linux__)
+#define WATCH_INOTIFY
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef WATCH_INOTIFY
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "watch.h"
+
+/* the directory is watched rather than the file itself, since editors */
+/* and build tools often replace the file (write a new one & rename)   */
+#define WATCH_EVENT_BUF_SIZE  4096
+
+#ifdef WATCH_INOTIFY
+static int            S_watch_fd = -1;
+
+static union
+{
+  long align;
+  char buf[WATCH_EVENT_BUF_SIZE];
+} S_watch_events;
+#endif
+
+/* watched file */
+static char*          S_watch_filename = NULL;
+static char*          S_watch_basename = NULL;
+
+/* modification time & size as of the last check (without inotify) */
+static time_t         S_watch_mtime;
+static long           S_watch_size;
+static int            S_watch_count;
+
+/******************************************************************************/
+/* watch_stat()                                                               */
+/******************************************************************************/
+static int watch_stat(time_t* mtime, long* size)
+{
+  struct stat st;
+
+  if (stat(S_watch_filename, &st) != 0)
+    return 1;
+
+  *mtime = st.st_mtime;
+  *size = (long) st.st_size;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* watch_start()                                                              */
+/******************************************************************************/
+int watch_start(char* filename)
+{
+#ifdef WATCH_INOTIFY
+  char* dir;
+#endif
+
+  watch_stop();
+
+  if (filename == NULL)
+    return 1;
+
+  /* keep a copy of the filename (the basename points into it) */
+  S_watch_filename = malloc(strlen(filename) + 1);
+
+  if (S_watch_filename == NULL)
+    return 1;
+
+  strcpy(S_watch_filename, filename);
+
+  S_watch_basename = strrchr(S_watch_filename, '/');
+
+  if (S_watch_basename != NULL)
+    S_watch_basename += 1;
+  else
+    S_watch_basename = S_watch_filename;
+
+  if (watch_stat(&S_watch_mtime, &S_watch_size))
+  {
+    watch_stop();
+    return 1;
+  }
+
+  S_watch_count = 0;
+
+#ifdef WATCH_INOTIFY
+  /* watch the file's directory (falling back to checking the */
+  /* modification time if that is not possible)               */
+  S_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  if (S_watch_fd < 0)
+    return 0;
+
+  if (S_watch_basename == S_watch_filename)
+    dir = ".";
+  else
+  {
+    dir = malloc(S_watch_basename - S_watch_filename + 1);
+
+    if (dir != NULL)
+    {
+      memcpy(dir, S_watch_filename, S_watch_basename - S_watch_filename);
+      dir[S_watch_basename - S_watch_filename] = '\0';
+    }
+  }
+
+  if ((dir == NULL) ||
+      (inotify_add_watch(S_watch_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0))
+  {
+    close(S_watch_fd);
+    S_watch_fd = -1;
+  }
+
+  if ((dir != NULL) && (S_watch_basename != S_watch_filename))
+    free(dir);
+#endif
+
+  return 0;
+}
+
+/******************************************************************************/
+/* watch_stop()                                                               */
+/******************************************************************************/
+int watch_stop()
+{
+#ifdef WATCH_INOTIFY
+  if (S_watch_fd >= 0)
+  {
+    close(S_watch_fd);
+    S_watch_fd = -1;
+  }
+#endif
+
+  if (S_watch_filename != NULL)
+  {
+    free(S_watch_filename);
+    S_watch_filename = NULL;
+  }
+
+  S_watch_basename = NULL;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* watch_poll()                                                               */
+/******************************************************************************/
+int watch_poll()
+{
+  int changed;
+
+  time_t mtime;
+  long   size;
+
+#ifdef WATCH_INOTIFY
+  long num_bytes;
+  long pos;
+
+  struct inotify_event* event;
+#endif
+
+  if (S_watch_filename == NULL)
+    return 0;
+
+  changed = 0;
+
+#ifdef WATCH_INOTIFY
+  /* drain the pending events, looking for the file's name */
+  if (S_watch_fd >= 0)
+  {
+    while ((num_bytes = read(S_watch_fd, S_watch_events.buf,
+                             WATCH_EVENT_BUF_SIZE)) > 0)
+    {
+      for (pos = 0; pos < num_bytes;
+           pos += sizeof(struct inotify_event) + event->len)
+      {
+        event = (struct inotify_event*) &S_watch_events.buf[pos];
+
+        if ((event->len > 0) && (!strcmp(event->name, S_watch_basename)))
+          changed = 1;
+      }
+    }
+
+    return changed;
+  }
+#endif
+
+  /* check the modification time & size every so often */
+  S_watch_count += 1;
+
+  if (S_watch_count < WATCH_STAT_INTERVAL)
+    return 0;
+
+  S_watch_count = 0;
+
+  if (watch_stat(&mtime, &size))
+    return 0;
+
+  if ((mtime != S_watch_mtime) || (size != S_watch_size))
+  {
+    S_watch_mtime = mtime;
+    S_watch_size = size;
+
+    changed = 1;
+  }
+
+  return changed;
+}
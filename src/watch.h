@@ -0,0 +1,19 @@
+/******************************************************************************/
+/* watch.h (cart file watcher)                                                */
+/******************************************************************************/
+
+#ifndef WATCH_H
+#define WATCH_H
+
+/* without inotify, the file's modification time is checked once */
+/* every this many polls (polls are once per frame)              */
+#define WATCH_STAT_INTERVAL 30
+
+/* function declarations (watch_poll() returns 1 once the file has */
+/* been written or replaced since the last poll, and 0 otherwise)  */
+int watch_start(char* filename);
+int watch_stop();
+
+int watch_poll();
+
+#endif
@@ -0,0 +1,570 @@
+/******************************************************************************/
+/* knpack.c (cart packer)                                                     */
+/******************************************************************************/
+
+/* converts a cart file between the raw format (KUNO / ICHI / CART) and  */
+/* the packed format (KUNO / ICHI / PACK + version), in which each       */
+/* section has a storage method byte after its count, and lz sections    */
+/* are a series of blocks, each with a 24 bit big endian packed size.    */
+/*                                                                       */
+/*   knpack in.kn1 out.kn1      (pack)                                   */
+/*   knpack -p in.kn1 out.kn1   (pack, with the cells paged)             */
+/*   knpack -u in.kn1 out.kn1   (unpack)                                 */
+/*                                                                       */
+/* paged cells are stored as a page count, a 32 bit bank size, and a     */
+/* directory entry per page (32 bit file offset, 24 bit stored size, 8   */
+/* bit method), followed by the pages, each one stored raw or as a       */
+/* single lz block, so that they can be read independently.             */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bank.h"
+#include "lz.h"
+
+#define KNPACK_HEADER_SIZE    12
+#define KNPACK_PACK_VERSION   2 /* version 2 adds paged cells */
+
+#define KNPACK_METHOD_RAW     0
+#define KNPACK_METHOD_LZ      1
+#define KNPACK_METHOD_PAGED   2
+
+#define KNPACK_SECTION_CELLS  2
+
+#define KNPACK_DIR_ENTRY_SIZE 8
+
+/* sections (nametable, palettes, cells, tilemap), the last is optional */
+#define KNPACK_NUM_SECTIONS   4
+
+static int S_knpack_unit_size[KNPACK_NUM_SECTIONS] = { 2, 2, 1, 2 };
+
+static char* S_knpack_section_name[KNPACK_NUM_SECTIONS] =
+              { "nametable", "palettes", "cells", "tilemap" };
+
+static unsigned char S_knpack_block_buf[LZ_BLOCK_BOUND(LZ_BLOCK_SIZE)];
+
+/******************************************************************************/
+/* knpack_read_file()                                                         */
+/******************************************************************************/
+static unsigned char* knpack_read_file(char* filename, unsigned long* size)
+{
+  FILE* fp;
+
+  unsigned char* buf;
+
+  long file_size;
+
+  fp = fopen(filename, "rb");
+
+  if (fp == NULL)
+    return NULL;
+
+  if ((fseek(fp, 0, SEEK_END) != 0) || ((file_size = ftell(fp)) < 0))
+  {
+    fclose(fp);
+    return NULL;
+  }
+
+  rewind(fp);
+
+  buf = malloc(file_size + 1);
+
+  if (buf == NULL)
+  {
+    fclose(fp);
+    return NULL;
+  }
+
+  if (fread(buf, 1, file_size, fp) < (size_t) file_size)
+  {
+    free(buf);
+    fclose(fp);
+    return NULL;
+  }
+
+  fclose(fp);
+
+  *size = file_size;
+
+  return buf;
+}
+
+/******************************************************************************/
+/* knpack_write_24()                                                          */
+/******************************************************************************/
+static int knpack_write_24(FILE* fp, unsigned long val)
+{
+  fputc((val >> 16) & 0xFF, fp);
+  fputc((val >> 8) & 0xFF, fp);
+  fputc(val & 0xFF, fp);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* knpack_write_32()                                                          */
+/******************************************************************************/
+static int knpack_write_32(FILE* fp, unsigned long val)
+{
+  fputc((val >> 24) & 0xFF, fp);
+  knpack_write_24(fp, val);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* knpack_pack_section()                                                      */
+/******************************************************************************/
+static unsigned long knpack_pack_section( FILE* fp,
+                                          unsigned char* data,
+                                          unsigned long num_bytes)
+{
+  unsigned long k;
+  unsigned long block_size;
+  unsigned long packed_size;
+  unsigned long total;
+
+  /* find the packed size first, and store the section raw if it is */
+  /* no smaller                                                    */
+  total = 0;
+
+  for (k = 0; k < num_bytes; k += LZ_BLOCK_SIZE)
+  {
+    block_size = num_bytes - k;
+
+    if (block_size > LZ_BLOCK_SIZE)
+      block_size = LZ_BLOCK_SIZE;
+
+    total += 3 + lz_encode_block(S_knpack_block_buf, data + k, block_size);
+  }
+
+  if (total >= num_bytes)
+  {
+    fputc(KNPACK_METHOD_RAW, fp);
+    fwrite(data, 1, num_bytes, fp);
+
+    return num_bytes;
+  }
+
+  fputc(KNPACK_METHOD_LZ, fp);
+
+  for (k = 0; k < num_bytes; k += LZ_BLOCK_SIZE)
+  {
+    block_size = num_bytes - k;
+
+    if (block_size > LZ_BLOCK_SIZE)
+      block_size = LZ_BLOCK_SIZE;
+
+    packed_size = lz_encode_block(S_knpack_block_buf, data + k, block_size);
+
+    knpack_write_24(fp, packed_size);
+    fwrite(S_knpack_block_buf, 1, packed_size, fp);
+  }
+
+  return total;
+}
+
+/******************************************************************************/
+/* knpack_unpack_section()                                                    */
+/******************************************************************************/
+static int knpack_unpack_section( FILE* fp,
+                                  unsigned char* buf, unsigned long size,
+                                  unsigned long* pos,
+                                  unsigned long num_bytes)
+{
+  unsigned char* dst;
+
+  unsigned long k;
+  unsigned long block_size;
+  unsigned long packed_size;
+
+  dst = malloc(num_bytes + 1);
+
+  if (dst == NULL)
+    return 1;
+
+  for (k = 0; k < num_bytes; k += LZ_BLOCK_SIZE)
+  {
+    block_size = num_bytes - k;
+
+    if (block_size > LZ_BLOCK_SIZE)
+      block_size = LZ_BLOCK_SIZE;
+
+    if (*pos + 3 > size)
+    {
+      free(dst);
+      return 1;
+    }
+
+    packed_size = (buf[*pos] << 16) | (buf[*pos + 1] << 8) | buf[*pos + 2];
+    *pos += 3;
+
+    if ((*pos + packed_size > size) ||
+        lz_decode_block(dst + k, block_size, buf + *pos, packed_size))
+    {
+      free(dst);
+      return 1;
+    }
+
+    *pos += packed_size;
+  }
+
+  fwrite(dst, 1, num_bytes, fp);
+
+  free(dst);
+
+  return 0;
+}
+
+/******************************************************************************/
+/* knpack_page_section()                                                      */
+/******************************************************************************/
+static unsigned long knpack_page_section( FILE* fp,
+                                          unsigned char* data,
+                                          unsigned long num_bytes)
+{
+  unsigned long k;
+  unsigned long num_pages;
+  unsigned long page_bytes;
+  unsigned long offset;
+  unsigned long total;
+
+  unsigned char* pages;
+
+  unsigned long* sizes;
+  unsigned char* methods;
+
+  num_pages = (num_bytes + BANK_PAGE_SIZE - 1) / BANK_PAGE_SIZE;
+
+  pages = malloc(num_pages * LZ_BLOCK_BOUND(BANK_PAGE_SIZE) + 1);
+  sizes = malloc(num_pages * sizeof(unsigned long) + 1);
+  methods = malloc(num_pages + 1);
+
+  if ((pages == NULL) || (sizes == NULL) || (methods == NULL))
+  {
+    free(pages);
+    free(sizes);
+    free(methods);
+    return 0;
+  }
+
+  /* pack each page on its own (raw if it does not shrink) */
+  for (k = 0; k < num_pages; k++)
+  {
+    page_bytes = num_bytes - k * BANK_PAGE_SIZE;
+
+    if (page_bytes > BANK_PAGE_SIZE)
+      page_bytes = BANK_PAGE_SIZE;
+
+    sizes[k] = lz_encode_block( pages + k * LZ_BLOCK_BOUND(BANK_PAGE_SIZE),
+                                data + k * BANK_PAGE_SIZE, page_bytes);
+    methods[k] = KNPACK_METHOD_LZ;
+
+    if (sizes[k] >= page_bytes)
+    {
+      memcpy( pages + k * LZ_BLOCK_BOUND(BANK_PAGE_SIZE),
+              data + k * BANK_PAGE_SIZE, page_bytes);
+
+      sizes[k] = page_bytes;
+      methods[k] = KNPACK_METHOD_RAW;
+    }
+  }
+
+  /* write the directory, with the pages right after it */
+  knpack_write_24(fp, num_pages);
+  fputc(KNPACK_METHOD_PAGED, fp);
+  knpack_write_32(fp, num_bytes);
+
+  offset = ftell(fp) + KNPACK_DIR_ENTRY_SIZE * num_pages;
+  total = 4 + KNPACK_DIR_ENTRY_SIZE * num_pages;
+
+  for (k = 0; k < num_pages; k++)
+  {
+    knpack_write_32(fp, offset);
+    knpack_write_24(fp, sizes[k]);
+    fputc(methods[k], fp);
+
+    offset += sizes[k];
+  }
+
+  for (k = 0; k < num_pages; k++)
+  {
+    fwrite(pages + k * LZ_BLOCK_BOUND(BANK_PAGE_SIZE), 1, sizes[k], fp);
+    total += sizes[k];
+  }
+
+  free(pages);
+  free(sizes);
+  free(methods);
+
+  return total;
+}
+
+/******************************************************************************/
+/* knpack_unpage_section()                                                    */
+/******************************************************************************/
+static int knpack_unpage_section( FILE* fp,
+                                  unsigned char* buf, unsigned long size,
+                                  unsigned long* pos,
+                                  unsigned long num_pages,
+                                  unsigned long* num_bytes)
+{
+  unsigned long k;
+  unsigned long page_bytes;
+  unsigned long offset;
+  unsigned long packed_size;
+  unsigned long end;
+
+  unsigned char* dir;
+  unsigned char* dst;
+
+  if (*pos + 4 + KNPACK_DIR_ENTRY_SIZE * num_pages > size)
+    return 1;
+
+  dir = buf + *pos;
+
+  *num_bytes = ((unsigned long) dir[0] << 24) |
+               (dir[1] << 16) | (dir[2] << 8) | dir[3];
+
+  /* a raw cart can hold at most 16 MB of cells */
+  if ((*num_bytes > 0xFFFFFF) ||
+      (num_pages != (*num_bytes + BANK_PAGE_SIZE - 1) / BANK_PAGE_SIZE))
+  {
+    return 1;
+  }
+
+  dst = malloc(BANK_PAGE_SIZE);
+
+  if (dst == NULL)
+    return 1;
+
+  knpack_write_24(fp, *num_bytes);
+
+  /* decode each page in turn, noting where the last one ends */
+  end = *pos + 4 + KNPACK_DIR_ENTRY_SIZE * num_pages;
+
+  for (k = 0, dir += 4; k < num_pages; k++, dir += KNPACK_DIR_ENTRY_SIZE)
+  {
+    page_bytes = *num_bytes - k * BANK_PAGE_SIZE;
+
+    if (page_bytes > BANK_PAGE_SIZE)
+      page_bytes = BANK_PAGE_SIZE;
+
+    offset = ((unsigned long) dir[0] << 24) |
+             (dir[1] << 16) | (dir[2] << 8) | dir[3];
+    packed_size = (dir[4] << 16) | (dir[5] << 8) | dir[6];
+
+    if (offset + packed_size > size)
+      break;
+
+    if (dir[7] == KNPACK_METHOD_LZ)
+    {
+      if (lz_decode_block(dst, page_bytes, buf + offset, packed_size))
+        break;
+    }
+    else if ((dir[7] != KNPACK_METHOD_RAW) || (packed_size != page_bytes))
+      break;
+    else
+      memcpy(dst, buf + offset, page_bytes);
+
+    fwrite(dst, 1, page_bytes, fp);
+
+    if (end < offset + packed_size)
+      end = offset + packed_size;
+  }
+
+  free(dst);
+
+  if (k < num_pages)
+    return 1;
+
+  *pos = end;
+
+  return 0;
+}
+
+/******************************************************************************/
+/* main()                                                                     */
+/******************************************************************************/
+int main(int argc, char *argv[])
+{
+  int k;
+  int unpack;
+  int page;
+  int packed;
+  int method;
+
+  char* in_filename;
+  char* out_filename;
+
+  unsigned char* buf;
+
+  unsigned long size;
+  unsigned long pos;
+  unsigned long start;
+  unsigned long count;
+  unsigned long num_bytes;
+  unsigned long out_bytes;
+
+  FILE* fp;
+
+  /* parse command line */
+  unpack = 0;
+  page = 0;
+
+  if ((argc > 1) && (!strcmp(argv[1], "-u")))
+  {
+    unpack = 1;
+    argc -= 1;
+    argv += 1;
+  }
+  else if ((argc > 1) && (!strcmp(argv[1], "-p")))
+  {
+    page = 1;
+    argc -= 1;
+    argv += 1;
+  }
+
+  if (argc != 3)
+  {
+    fprintf(stdout, "Usage: knpack [-p | -u] in.kn1 out.kn1\n");
+    return 1;
+  }
+
+  in_filename = argv[1];
+  out_filename = argv[2];
+
+  /* read the input cart */
+  buf = knpack_read_file(in_filename, &size);
+
+  if (buf == NULL)
+  {
+    fprintf(stdout, "Failed to read %s\n", in_filename);
+    return 1;
+  }
+
+  if ((size < KNPACK_HEADER_SIZE) ||
+      memcmp(buf, "KUNOICHI", 8) ||
+      (memcmp(buf + 8, "CART", 4) && memcmp(buf + 8, "PACK", 4)))
+  {
+    fprintf(stdout, "%s is not a cart file\n", in_filename);
+    free(buf);
+    return 1;
+  }
+
+  packed = memcmp(buf + 8, "PACK", 4) ? 0 : 1;
+
+  pos = KNPACK_HEADER_SIZE;
+
+  if (packed)
+  {
+    if ((pos >= size) || (buf[pos] < 1) || (buf[pos] > KNPACK_PACK_VERSION))
+    {
+      fprintf(stdout, "Unsupported packed cart version\n");
+      free(buf);
+      return 1;
+    }
+
+    pos += 1;
+  }
+
+  if (packed != unpack)
+  {
+    fprintf(stdout, "%s is already %s\n",
+            in_filename, packed ? "packed" : "unpacked");
+    free(buf);
+    return 1;
+  }
+
+  /* write the output cart */
+  fp = fopen(out_filename, "wb");
+
+  if (fp == NULL)
+  {
+    fprintf(stdout, "Failed to open %s\n", out_filename);
+    free(buf);
+    return 1;
+  }
+
+  fwrite(unpack ? "KUNOICHICART" : "KUNOICHIPACK", 1, KNPACK_HEADER_SIZE, fp);
+
+  /* (carts without paged cells are written as version 1) */
+  if (unpack == 0)
+    fputc(page ? KNPACK_PACK_VERSION : 1, fp);
+
+  for (k = 0; (k < KNPACK_NUM_SECTIONS) && (pos < size); k++)
+  {
+    /* read the section header */
+    if (pos + 3 + packed > size)
+      break;
+
+    count = (buf[pos] << 16) | (buf[pos + 1] << 8) | buf[pos + 2];
+    pos += 3;
+
+    method = KNPACK_METHOD_RAW;
+
+    if (packed)
+      method = buf[pos++];
+
+    num_bytes = count * S_knpack_unit_size[k];
+
+    /* convert the section */
+    start = pos;
+
+    if ((method == KNPACK_METHOD_PAGED) && (k == KNPACK_SECTION_CELLS))
+    {
+      if (knpack_unpage_section(fp, buf, size, &pos, count, &out_bytes))
+        break;
+    }
+    else if (method == KNPACK_METHOD_LZ)
+    {
+      knpack_write_24(fp, count);
+
+      if (knpack_unpack_section(fp, buf, size, &pos, num_bytes))
+        break;
+
+      out_bytes = num_bytes;
+    }
+    else if (method == KNPACK_METHOD_RAW)
+    {
+      if (pos + num_bytes > size)
+        break;
+
+      if (unpack)
+      {
+        knpack_write_24(fp, count);
+        fwrite(buf + pos, 1, num_bytes, fp);
+
+        out_bytes = num_bytes;
+      }
+      else if (page && (k == KNPACK_SECTION_CELLS))
+        out_bytes = knpack_page_section(fp, buf + pos, num_bytes);
+      else
+      {
+        knpack_write_24(fp, count);
+        out_bytes = knpack_pack_section(fp, buf + pos, num_bytes);
+      }
+
+      pos += num_bytes;
+    }
+    else
+      break;
+
+    fprintf(stdout, "%-10s %8lu -> %8lu bytes\n",
+            S_knpack_section_name[k], pos - start, out_bytes);
+  }
+
+  free(buf);
+
+  if ((pos != size) || ferror(fp))
+  {
+    fprintf(stdout, "Failed to convert %s\n", in_filename);
+    fclose(fp);
+    return 1;
+  }
+
+  fclose(fp);
+
+  return 0;
+}